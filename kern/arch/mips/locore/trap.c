@@ -35,6 +35,7 @@
 #include <mips/trapframe.h>
 #include <cpu.h>
 #include <spl.h>
+#include <synch.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -115,14 +116,17 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 		code, sig, trapcodenames[code], epc, vaddr);
 
 	/*
-	 * Call proc_exit, creating an exit status that reflects the
-	 * signal number we died on. Since we don't implement core
-	 * dumps, we don't ever use _MKWAIT_CORE().
+	 * Record an exit status that reflects the signal number we
+	 * died on, and leave the way sys__exit does: other threads in
+	 * the process carry on, and the status is reported when the
+	 * last one exits. Since we don't implement core dumps, we
+	 * don't ever use _MKWAIT_CORE().
 	 */
-	proc_exit(_MKWAIT_SIG(sig));
+	lock_acquire(curproc->p_utlock);
+	curproc->p_exitstatus = _MKWAIT_SIG(sig);
+	lock_release(curproc->p_utlock);
 
-	/* Now, the thread can go away too. */
-	thread_exit();
+	proc_thread_exit(NULL);
 }
 
 /*
@@ -444,3 +448,27 @@ enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 	mips_usermode(&tf);
 }
+
+/*
+ * enter_new_thread: go to user mode in a new thread of an existing
+ * process, calling ENTRY with arguments ARG0 and ARG1 on the stack
+ * STACK, with the global pointer GP. ENTRY must not return, since
+ * there's nothing to return to.
+ */
+void
+enter_new_thread(userptr_t arg0, userptr_t arg1, vaddr_t stack, vaddr_t gp,
+		 vaddr_t entry)
+{
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+
+	tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	tf.tf_epc = entry;
+	tf.tf_a0 = (vaddr_t)arg0;
+	tf.tf_a1 = (vaddr_t)arg1;
+	tf.tf_sp = stack;
+	tf.tf_gp = gp;
+
+	mips_usermode(&tf);
+}
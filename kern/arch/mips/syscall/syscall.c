@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <kern/sysbatch.h>
 #include <endian.h>
 #include <lib.h>
 #include <mips/trapframe.h>
@@ -37,70 +38,26 @@
 #include <current.h>
 #include <copyinout.h>
 #include <syscall.h>
+#include <sysprof.h>
 
 
+static int syscall_batch(userptr_t ucalls, unsigned ncalls, int flags,
+			 int32_t *retval);
+
 /*
- * System call dispatcher.
- *
- * A pointer to the trapframe created during exception entry (in
- * exception-*.S) is passed in.
- *
- * The calling conventions for syscalls are as follows: Like ordinary
- * function calls, the first 4 32-bit arguments are passed in the 4
- * argument registers a0-a3. 64-bit arguments are passed in *aligned*
- * pairs of registers, that is, either a0/a1 or a2/a3. This means that
- * if the first argument is 32-bit and the second is 64-bit, a1 is
- * unused.
- *
- * This much is the same as the calling conventions for ordinary
- * function calls. In addition, the system call number is passed in
- * the v0 register.
- *
- * On successful return, the return value is passed back in the v0
- * register, or v0 and v1 if 64-bit. This is also like an ordinary
- * function call, and additionally the a3 register is also set to 0 to
- * indicate success.
- *
- * On an error return, the error code is passed back in the v0
- * register, and the a3 register is set to 1 to indicate failure.
- * (Userlevel code takes care of storing the error code in errno and
- * returning the value -1 from the actual userlevel syscall function.
- * See src/user/lib/libc/arch/mips/syscalls-mips.S and related files.)
- *
- * Upon syscall return the program counter stored in the trapframe
- * must be incremented by one instruction; otherwise the exception
- * return code will restart the "syscall" instruction and the system
- * call will repeat forever.
- *
- * If you run out of registers (which happens quickly with 64-bit
- * values) further arguments must be fetched from the user-level
- * stack, starting at sp+16 to skip over the slots for the
- * registerized values, with copyin().
+ * Call the system call function for the call in TF. Returns the
+ * error, and the return value in *RETVAL. (lseek, with its 64-bit
+ * return value, also sets tf_v0 and tf_v1 itself.)
  */
-void
-syscall(struct trapframe *tf)
+static
+int
+syscall_dispatch(struct trapframe *tf, int32_t *retval)
 {
 	int callno;
-	int32_t retval;
 	int err;
 
-	KASSERT(curthread != NULL);
-	KASSERT(curthread->t_curspl == 0);
-	KASSERT(curthread->t_iplhigh_count == 0);
-
 	callno = tf->tf_v0;
 
-	/*
-	 * Initialize retval to 0. Many of the system calls don't
-	 * really return a value, just 0 for success and -1 on
-	 * error. Since retval is the value returned on success,
-	 * initialize it to 0 by default; thus it's not necessary to
-	 * deal with it except for calls that return other values,
-	 * like write.
-	 */
-
-	retval = 0;
-
 	/* note the casts to userptr_t */
 
 	switch (callno) {
@@ -113,11 +70,20 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
 	    case SYS_fork:
-		err = sys_fork(tf, &retval);
+		err = sys_fork(tf, retval);
+		break;
+
+	    case SYS_vfork:
+		err = sys_vfork(tf, retval);
 		break;
 
 	    case SYS_execv:
@@ -135,11 +101,88 @@ syscall(struct trapframe *tf)
 			tf->tf_a0,
 			(userptr_t)tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
 		break;
 
 	    case SYS_getpid:
-		err = sys_getpid(&retval);
+		err = sys_getpid(retval);
+		break;
+
+	    case SYS_getppid:
+		err = sys_getppid(retval);
+		break;
+
+	    case SYS_sched_setaffinity:
+		err = sys_sched_setaffinity(
+			tf->tf_a0,
+			tf->tf_a1,
+			(const_userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_sched_getaffinity:
+		err = sys_sched_getaffinity(
+			tf->tf_a0,
+			tf->tf_a1,
+			(userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS___thread_create:
+		err = sys___thread_create(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			tf->tf_a3,
+			tf->tf_sp,
+			tf->tf_gp,
+			retval);
+		break;
+
+	    case SYS_thread_exit:
+		sys_thread_exit((userptr_t)tf->tf_a0);
+		panic("Returning from thread_exit\n");
+
+	    case SYS_thread_join:
+		err = sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1, retval);
+		break;
+
+	    case SYS_uring_setup:
+		err = sys_uring_setup((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_uring_enter:
+		err = sys_uring_enter(tf->tf_a0, tf->tf_a1, retval);
+		break;
+
+	    case SYS_syscall_batch:
+		err = syscall_batch(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			retval);
+		break;
+
+#if OPT_SYSPROF
+	    case SYS_sysprof:
+		err = sys_sysprof((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+				  retval);
+		break;
+#endif
+
+	    case SYS___spawn:
+		err = sys___spawn(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			tf->tf_a3,
+			retval);
 		break;
 
 
@@ -150,14 +193,43 @@ syscall(struct trapframe *tf)
 			(userptr_t)tf->tf_a0,
 			tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
 		break;
 
 	    case SYS_dup2:
 		err = sys_dup2(
 			tf->tf_a0,
 			tf->tf_a1,
-			&retval);
+			retval);
+		break;
+
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0, 0);
+		break;
+
+	    case SYS_pipe2:
+		err = sys_pipe((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_copy_file_range:
+		{
+			/* The last two arguments are on the stack. */
+			uint32_t stackargs[2];
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     stackargs, sizeof(stackargs));
+			if (err) {
+				break;
+			}
+			err = sys_copy_file_range(
+				tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				tf->tf_a2,
+				(userptr_t)tf->tf_a3,
+				stackargs[0],
+				stackargs[1],
+				retval);
+		}
 		break;
 
 	    case SYS_close:
@@ -169,15 +241,62 @@ syscall(struct trapframe *tf)
 			tf->tf_a0,
 			(userptr_t)tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
 		break;
 	    case SYS_write:
 		err = sys_write(
 			tf->tf_a0,
 			(userptr_t)tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
+		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			retval);
+		break;
+
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			retval);
+		break;
+
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The 64-bit position is the fourth argument,
+			 * but 64-bit values go in aligned register
+			 * pairs, so it ends up on the stack after a3.
+			 */
+			uint32_t pos32[2];
+			uint64_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     pos32, sizeof(pos32));
+			if (err) {
+				break;
+			}
+			join32to64(pos32[0], pos32[1], &pos);
+
+			if (callno == SYS_pread) {
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, retval);
+			}
+			else {
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, retval);
+			}
+		}
 		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -207,7 +326,32 @@ syscall(struct trapframe *tf)
 			}
 
 			split64to32(retval64, &tf->tf_v0, &tf->tf_v1);
-			retval = tf->tf_v0;
+			*retval = tf->tf_v0;
+		}
+		break;
+
+	    case SYS_poll:
+		err = sys_poll((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+			       retval);
+		break;
+
+	    case SYS_select:
+		{
+			/* The timeout is the fifth argument, on the stack. */
+			userptr_t timeout;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &timeout, sizeof(timeout));
+			if (err) {
+				break;
+			}
+			err = sys_select(
+				tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				(userptr_t)tf->tf_a2,
+				(userptr_t)tf->tf_a3,
+				timeout,
+				retval);
 		}
 		break;
 
@@ -219,7 +363,7 @@ syscall(struct trapframe *tf)
 		err = sys___getcwd(
 			(userptr_t)tf->tf_a0,
 			tf->tf_a1,
-			&retval);
+			retval);
 		break;
 
 
@@ -243,11 +387,20 @@ syscall(struct trapframe *tf)
 		break;
 	    case SYS_getdirentry:
 		err = sys_getdirentry(tf->tf_a0, (userptr_t)tf->tf_a1,
-				      tf->tf_a2, &retval);
+				      tf->tf_a2, retval);
 		break;
 	    case SYS_fstat:
 		err = sys_fstat(tf->tf_a0, (userptr_t)tf->tf_a1);
 		break;
+	    case SYS_stat:
+		err = sys_stat((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+	    case SYS_lstat:
+		err = sys_lstat((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+	    case SYS_access:
+		err = sys_access((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
 	    case SYS_fsync:
 		err = sys_fsync(tf->tf_a0);
 		break;
@@ -270,6 +423,147 @@ syscall(struct trapframe *tf)
 	}
 
 
+	return err;
+}
+
+/*
+ * Make the NCALLS calls in the records at UCALLS; see
+ * <kern/sysbatch.h>. Each gets a trapframe of its own made up from
+ * its record, with the stack pointer at the record so the arguments
+ * past a3 are at sp+16 as usual. The results go back in the records.
+ * Returns the number of calls made.
+ */
+static
+int
+syscall_batch(userptr_t ucalls, unsigned ncalls, int flags, int32_t *retval)
+{
+	struct sysbatch_call call;
+	struct trapframe calltf;
+	userptr_t ucall;
+	int32_t callret;
+	unsigned i;
+	int err;
+
+	if (flags & ~SYSBATCH_STOPONERR) {
+		return EINVAL;
+	}
+	if (ncalls > SYSBATCH_MAX) {
+		return EINVAL;
+	}
+
+	for (i=0; i<ncalls; i++) {
+		ucall = ucalls + i * sizeof(call);
+		err = copyin(ucall, &call, sizeof(call));
+		if (err) {
+			return err;
+		}
+
+		bzero(&calltf, sizeof(calltf));
+		callret = 0;
+
+		switch (call.sbc_callno) {
+		    case SYS_fork:
+		    case SYS_vfork:
+		    case SYS_execv:
+		    case SYS__exit:
+		    case SYS___thread_create:
+		    case SYS_thread_exit:
+		    case SYS_syscall_batch:
+			/* these need the real trapframe, or don't return */
+			err = EINVAL;
+			break;
+		    default:
+			calltf.tf_v0 = call.sbc_callno;
+			calltf.tf_a0 = call.sbc_args[0];
+			calltf.tf_a1 = call.sbc_args[1];
+			calltf.tf_a2 = call.sbc_args[2];
+			calltf.tf_a3 = call.sbc_args[3];
+			calltf.tf_sp = (vaddr_t)ucall;
+			err = syscall_dispatch(&calltf, &callret);
+			break;
+		}
+
+		call.sbc_err = err;
+		call.sbc_ret[0] = err ? 0 : callret;
+		call.sbc_ret[1] = err ? 0 : calltf.tf_v1;
+		err = copyout(&call, ucall, sizeof(call));
+		if (err) {
+			return err;
+		}
+
+		if (call.sbc_err && (flags & SYSBATCH_STOPONERR)) {
+			i++;
+			break;
+		}
+	}
+
+	*retval = i;
+	return 0;
+}
+
+/*
+ * System call dispatcher.
+ *
+ * A pointer to the trapframe created during exception entry (in
+ * exception-*.S) is passed in.
+ *
+ * The calling conventions for syscalls are as follows: Like ordinary
+ * function calls, the first 4 32-bit arguments are passed in the 4
+ * argument registers a0-a3. 64-bit arguments are passed in *aligned*
+ * pairs of registers, that is, either a0/a1 or a2/a3. This means that
+ * if the first argument is 32-bit and the second is 64-bit, a1 is
+ * unused.
+ *
+ * This much is the same as the calling conventions for ordinary
+ * function calls. In addition, the system call number is passed in
+ * the v0 register.
+ *
+ * On successful return, the return value is passed back in the v0
+ * register, or v0 and v1 if 64-bit. This is also like an ordinary
+ * function call, and additionally the a3 register is also set to 0 to
+ * indicate success.
+ *
+ * On an error return, the error code is passed back in the v0
+ * register, and the a3 register is set to 1 to indicate failure.
+ * (Userlevel code takes care of storing the error code in errno and
+ * returning the value -1 from the actual userlevel syscall function.
+ * See src/user/lib/libc/arch/mips/syscalls-mips.S and related files.)
+ *
+ * Upon syscall return the program counter stored in the trapframe
+ * must be incremented by one instruction; otherwise the exception
+ * return code will restart the "syscall" instruction and the system
+ * call will repeat forever.
+ *
+ * If you run out of registers (which happens quickly with 64-bit
+ * values) further arguments must be fetched from the user-level
+ * stack, starting at sp+16 to skip over the slots for the
+ * registerized values, with copyin().
+ */
+void
+syscall(struct trapframe *tf)
+{
+	int32_t retval;
+	int err;
+	SYSPROF_TIMER(prof);
+
+	KASSERT(curthread != NULL);
+	KASSERT(curthread->t_curspl == 0);
+	KASSERT(curthread->t_iplhigh_count == 0);
+
+	/*
+	 * Initialize retval to 0. Many of the system calls don't
+	 * really return a value, just 0 for success and -1 on
+	 * error. Since retval is the value returned on success,
+	 * initialize it to 0 by default; thus it's not necessary to
+	 * deal with it except for calls that return other values,
+	 * like write.
+	 */
+
+	retval = 0;
+	SYSPROF_START(prof, tf->tf_v0);
+	err = syscall_dispatch(tf, &retval);
+	SYSPROF_END(prof, err);
+
 	if (err) {
 		/*
 		 * Return the error code. This gets converted at
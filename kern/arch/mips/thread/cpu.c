@@ -178,6 +178,21 @@ cpu_identify(char *buf, size_t max)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Cycle counter: cop0 register 9 (Count), which sys161 increments
+ * once per cycle.
+ */
+uint32_t
+cpu_getcycles(void)
+{
+	uint32_t count;
+
+	__asm volatile("mfc0 %0,$9" : "=r" (count));
+	return count;
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Interrupt control.
  *
@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/vdso.h>
 #include <lib.h>
 #include <spl.h>
 #include <cpu.h>
@@ -64,6 +65,9 @@
  */
 static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 
+/* The shared vdso clock page, set by the first as_define_vdso. */
+static paddr_t dumbvm_vdsoclock;
+
 void
 vm_bootstrap(void)
 {
@@ -133,6 +137,51 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+/*
+ * Find the kernel address of the page holding user address UADDR in
+ * the current address space. dumbvm never frees anything, so it stays
+ * good. Everything is writable, so WRITE doesn't matter.
+ */
+int
+vm_getkpage(vaddr_t uaddr, bool write, vaddr_t *ret)
+{
+	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
+	paddr_t paddr;
+	struct addrspace *as;
+
+	(void)write;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+
+	uaddr &= PAGE_FRAME;
+
+	vbase1 = as->as_vbase1;
+	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
+	vbase2 = as->as_vbase2;
+	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
+	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+	stacktop = USERSTACK;
+
+	if (uaddr >= vbase1 && uaddr < vtop1) {
+		paddr = (uaddr - vbase1) + as->as_pbase1;
+	}
+	else if (uaddr >= vbase2 && uaddr < vtop2) {
+		paddr = (uaddr - vbase2) + as->as_pbase2;
+	}
+	else if (uaddr >= stackbase && uaddr < stacktop) {
+		paddr = (uaddr - stackbase) + as->as_stackpbase;
+	}
+	else {
+		return EFAULT;
+	}
+
+	*ret = PADDR_TO_KVADDR(paddr);
+	return 0;
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
@@ -141,6 +190,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
+	bool readonly = false;
 	int spl;
 
 	faultaddress &= PAGE_FRAME;
@@ -149,8 +199,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
+		/* Only the vdso pages are read-only. */
+		return EFAULT;
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -206,10 +256,22 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress == VDSO_PROC && as->as_vdsopbase != 0) {
+		paddr = as->as_vdsopbase;
+		readonly = true;
+	}
+	else if (faultaddress == VDSO_CLOCK && as->as_vdsopbase != 0) {
+		paddr = dumbvm_vdsoclock;
+		readonly = true;
+	}
 	else {
 		return EFAULT;
 	}
 
+	if (readonly && faulttype == VM_FAULT_WRITE) {
+		return EFAULT;
+	}
+
 	/* make sure it's page-aligned */
 	KASSERT((paddr & PAGE_FRAME) == paddr);
 
@@ -222,7 +284,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 			continue;
 		}
 		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+		elo = paddr | TLBLO_VALID;
+		if (!readonly) {
+			elo |= TLBLO_DIRTY;
+		}
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -249,6 +314,7 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	as->as_vdsopbase = 0;
 
 	return as;
 }
@@ -383,6 +449,41 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_threadstack(struct addrspace *as, unsigned slot, vaddr_t *stackptr)
+{
+	/* dumbvm has room for only the one stack. */
+	(void)as;
+	(void)slot;
+	(void)stackptr;
+	return ENOSYS;
+}
+
+int
+as_define_vdso(struct addrspace *as, vaddr_t clockpage)
+{
+	KASSERT(as->as_vdsopbase == 0);
+
+	dumbvm_can_sleep();
+
+	as->as_vdsopbase = getppages(1);
+	if (as->as_vdsopbase == 0) {
+		return ENOMEM;
+	}
+	as_zero_region(as->as_vdsopbase, 1);
+	dumbvm_vdsoclock = KVADDR_TO_PADDR(clockpage);
+	return 0;
+}
+
+void *
+as_vdso_proc(struct addrspace *as)
+{
+	if (as->as_vdsopbase == 0) {
+		return NULL;
+	}
+	return (void *)PADDR_TO_KVADDR(as->as_vdsopbase);
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -422,6 +523,17 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
 
+	if (old->as_vdsopbase != 0) {
+		new->as_vdsopbase = getppages(1);
+		if (new->as_vdsopbase == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)PADDR_TO_KVADDR(new->as_vdsopbase),
+			(const void *)PADDR_TO_KVADDR(old->as_vdsopbase),
+			PAGE_SIZE);
+	}
+
 	*ret = new;
 	return 0;
 }
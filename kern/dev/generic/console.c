@@ -52,6 +52,7 @@
 #include <lib.h>
 #include <uio.h>
 #include <cpu.h>
+#include <spl.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
@@ -174,6 +175,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollqueue_wakeup(&cs->cs_pollq);
 }
 
 /*
@@ -302,10 +304,43 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * A read waits for a whole line (or a full buffer), so only call the
+ * console readable once there is one. Output never waits for long.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollentry *entry)
+{
+	struct con_softc *cs = dev->d_data;
+	unsigned i, head, tail;
+	int ready, spl;
+
+	pollqueue_add(&cs->cs_pollq, entry);
+
+	/* Keep con_input out of the buffer while we look at it. */
+	spl = splhigh();
+	ready = POLLOUT;
+	head = cs->cs_gotchars_head;
+	tail = cs->cs_gotchars_tail;
+	if ((head + 1) % CONSOLE_INPUT_BUFFER_SIZE == tail) {
+		ready |= POLLIN;
+	}
+	for (i = tail; i != head; i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+		if (cs->cs_gotchars[i] == '\n' || cs->cs_gotchars[i] == '\r') {
+			ready |= POLLIN;
+			break;
+		}
+	}
+	splx(spl);
+	return ready & events;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +421,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollqueue_init(&cs->cs_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
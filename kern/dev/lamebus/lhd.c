@@ -33,6 +33,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
@@ -165,6 +166,19 @@ lhd_ioctl(struct device *d, int op, userptr_t data)
 	return EIOCTL;
 }
 
+/*
+ * VFS poll function. Disk I/O always completes, so never counts as
+ * blocking.
+ */
+static
+int
+lhd_poll(struct device *d, int events, struct pollentry *entry)
+{
+	(void)d;
+	(void)entry;
+	return events & (POLLIN | POLLOUT);
+}
+
 #if 0
 /*
  * Reset the device.
@@ -268,6 +282,7 @@ static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_poll = lhd_poll,
 };
 
 /*
@@ -41,6 +41,9 @@
 
 #define STACK_PAGE 16
 
+/* Distance between user thread stacks: one stack plus a guard page. */
+#define THREADSTACK_STRIDE (PAGE_SIZE * (STACK_PAGE + 1))
+
 struct vnode;
 
 
@@ -60,6 +63,7 @@ struct addrspace {
         paddr_t as_pbase2;
         size_t as_npages2;
         paddr_t as_stackpbase;
+        paddr_t as_vdsopbase;
 #else
 #endif
 };
@@ -101,6 +105,19 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_threadstack - set up the stack for an additional
+ *                user-level thread. SLOT numbers the stacks from 1
+ *                (0 being the one from as_define_stack). Hands back
+ *                the initial stack pointer.
+ *
+ *    as_define_vdso - map the vdso pages (see <kern/vdso.h>) read-only
+ *                at VDSO_BASE: a new page of the address space's own,
+ *                and CLOCKPAGE (a kernel address), which is shared and
+ *                isn't copied or freed along with the address space.
+ *
+ *    as_vdso_proc - hand back the kernel address of the address
+ *                space's own vdso page, or NULL if it has none.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -119,6 +136,10 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, unsigned slot,
+                                        vaddr_t *initstackptr);
+int               as_define_vdso(struct addrspace *as, vaddr_t clockpage);
+void             *as_vdso_proc(struct addrspace *as);
 
 
 /*
@@ -0,0 +1,68 @@
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: functions to be called at some point in the future.
+ *
+ * Callouts are kept in a hierarchical timer wheel that is advanced
+ * once per hardclock tick (see clock.c), so their resolution is
+ * 1/HZ seconds. Scheduling, cancelling, and rescheduling a callout
+ * are all constant-time operations.
+ *
+ * The callout function is called from the timer interrupt on CPU 0,
+ * so it must not sleep; it may take spinlocks and wake up threads.
+ * No wheel locks are held while it runs, so it may reschedule its
+ * own callout.
+ *
+ * The structure is public so callouts can be embedded in other
+ * structures (e.g. struct thread) instead of being malloc'd; but
+ * code that uses callouts should not look inside it.
+ */
+
+struct callout {
+	struct callout *co_next;	/* Link on wheel slot */
+	struct callout **co_prevp;	/* Pointer to link that points to us */
+	unsigned co_expire;		/* Tick at which to fire */
+	void (*co_func)(void *);	/* Function to call */
+	void *co_data;			/* Argument for co_func */
+	bool co_pending;		/* True if on the wheel */
+};
+
+/*
+ * Callout functions.
+ *
+ * init		Initialize a callout to call FUNC(DATA) when it fires.
+ * cleanup	Opposite of init. Must not be pending or running.
+ *
+ * schedule	Arrange for the callout to fire TICKS hardclock ticks
+ *		from now. If it was already pending, it is rescheduled.
+ *		Zero ticks means "at the next tick".
+ * stop		Cancel the callout. Returns true if it was pending (and
+ *		thus will now not fire). If the function is currently
+ *		running on another CPU, waits for it to finish; so once
+ *		stop returns the function is neither queued nor running.
+ *		Don't call stop while holding a spinlock the callout
+ *		function takes.
+ * pending	Return true if the callout is scheduled and has not fired.
+ */
+void callout_init(struct callout *co, void (*func)(void *), void *data);
+void callout_cleanup(struct callout *co);
+
+void callout_schedule(struct callout *co, unsigned ticks);
+bool callout_stop(struct callout *co);
+bool callout_pending(struct callout *co);
+
+/*
+ * callout_ticks returns the number of hardclock ticks since boot (as
+ * seen by the wheel; it wraps after a long time).
+ */
+unsigned callout_ticks(void);
+
+/* Call once during system startup. */
+void callout_bootstrap(void);
+
+/* Called from hardclock() to advance the wheel and run expired callouts. */
+void callout_hardclock(void);
+
+
+#endif /* _CALLOUT_H_ */
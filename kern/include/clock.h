@@ -79,5 +79,12 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * ticksleep() is the same, but takes hardclock ticks, and
+ * timespec_to_ticks() converts an interval to ticks (rounding up).
+ */
+void ticksleep(unsigned ticks);
+unsigned timespec_to_ticks(const struct timespec *ts);
+
 
 #endif /* _CLOCK_H_ */
@@ -36,27 +36,32 @@
 
 #include <limits.h> /* for OPEN_MAX */
 
+struct lock;
+struct openfile;
+struct fdarray;
 
 /*
- * The file table is an array of open files.
+ * The file table maps file descriptors to open files.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * The array itself (struct fdarray, private to filetable.c) starts
+ * small and grows as higher descriptors are used, up to OPEN_MAX. A
+ * bitmap of the descriptors in use, with a second level marking which
+ * words of the first are full, finds the lowest free descriptor
+ * without a scan.
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * On fork the array is not copied: parent and child share it until
+ * one of them changes it, and only then does that one get its own
+ * copy. So fork and exit cost nothing per open file unless something
+ * changes, and then only per open file, not per slot.
+ *
+ * Threads in a process share its file table, so it is protected by
+ * ft_lock. An openfile returned from filetable_get carries a
+ * reference of its own, so it stays valid even if another thread
+ * closes the descriptor before filetable_put.
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct lock *ft_lock;		/* protects ft_fds */
+	struct fdarray *ft_fds;		/* the array, possibly shared */
 };
 
 /*
@@ -71,7 +76,7 @@ struct filetable {
  *           is not NULL.) Call put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
- *           previously there.
+ *           previously there. Fails only if out of memory.
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +88,8 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
 
 
 #endif /* _FILETABLE_H_ */
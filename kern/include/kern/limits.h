@@ -74,6 +74,9 @@
  *
  * Most modern systems don't have OPEN_MAX at all, and instead go by
  * whatever limit is set with setrlimit().
+ *
+ * File tables grow on demand, so a large OPEN_MAX costs nothing for
+ * processes that don't use it.
  */
 
 /* Min value for a process ID (that can be assigned to a user process) */
@@ -83,13 +86,13 @@
 #define __PID_MAX       32767
 
 /* Max open files per process */
-#define __OPEN_MAX      128
+#define __OPEN_MAX      4096
 
 /* Max bytes for atomic pipe I/O -- see description in the pipe() man page */
 #define __PIPE_BUF      512
 
-/* Max number of processes at once. */
-#define __PROCS_MAX       128
+/* Max number of processes at once (one per pid). */
+#define __PROCS_MAX       (__PID_MAX - __PID_MIN + 1)
 
 
 /*
@@ -108,8 +111,11 @@
  * Not very important at all.
  */
 
-/* Max number of iovec structures at once for readv/writev/preadv/pwritev */
-#define __IOV_MAX       1024
+/*
+ * Max number of iovec structures at once for readv/writev/preadv/pwritev
+ * (kept to one page of iovecs, as with ARG_MAX)
+ */
+#define __IOV_MAX       512
 
 
 #endif /* _KERN_LIMITS_H_ */
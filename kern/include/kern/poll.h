@@ -0,0 +1,48 @@
+#ifndef _KERN_POLL_H_
+#define _KERN_POLL_H_
+
+/*
+ * Definitions for poll() and select(), which wait for any of several
+ * file handles to become ready.
+ */
+
+/* Event bits for events and revents */
+#define POLLIN		0x0001	/* can read without blocking */
+#define POLLPRI		0x0002	/* urgent data (never happens) */
+#define POLLOUT		0x0004	/* can write without blocking */
+#define POLLERR		0x0008	/* error (revents only) */
+#define POLLHUP		0x0010	/* other end closed (revents only) */
+#define POLLNVAL	0x0020	/* not an open file (revents only) */
+
+struct pollfd {
+	int fd;			/* file handle, or negative to skip */
+	short events;		/* events to wait for */
+	short revents;		/* out: events that happened */
+};
+
+/*
+ * File handle sets for select. Only handles below FD_SETSIZE can be
+ * used with select; poll has no such limit.
+ */
+#define FD_SETSIZE	1024
+#define __NFDBITS	32
+
+typedef struct {
+	__u32 fds_bits[FD_SETSIZE / __NFDBITS];
+} fd_set;
+
+#define FD_SET(fd, set) \
+	((set)->fds_bits[(fd) / __NFDBITS] |= (__u32)1 << ((fd) % __NFDBITS))
+#define FD_CLR(fd, set) \
+	((set)->fds_bits[(fd) / __NFDBITS] &= ~((__u32)1 << ((fd) % __NFDBITS)))
+#define FD_ISSET(fd, set) \
+	(((set)->fds_bits[(fd) / __NFDBITS] >> ((fd) % __NFDBITS)) & 1)
+#define FD_ZERO(set) \
+	do { \
+		unsigned __i; \
+		for (__i = 0; __i < FD_SETSIZE / __NFDBITS; __i++) { \
+			(set)->fds_bits[__i] = 0; \
+		} \
+	} while (0)
+
+#endif /* _KERN_POLL_H_ */
@@ -0,0 +1,33 @@
+#ifndef _KERN_SPAWN_H_
+#define _KERN_SPAWN_H_
+
+/*
+ * Definitions for __spawn(), which starts a new process running a
+ * program without forking first.
+ *
+ * Before the program is loaded, the new process's copy of the file
+ * table is adjusted by a list of actions, carried out in order.
+ */
+
+/* Values for sfa_op */
+#define SPAWN_FDA_CLOSE  1	/* close(sfa_fd) */
+#define SPAWN_FDA_DUP2   2	/* dup2(sfa_oldfd, sfa_fd) */
+#define SPAWN_FDA_OPEN   3	/* open sfa_path on sfa_fd */
+
+/* Most actions one call can take. */
+#define SPAWN_MAXACTIONS 64
+
+struct spawn_fdaction {
+	int sfa_op;			/* SPAWN_FDA_* */
+	int sfa_fd;			/* fd to act on */
+	int sfa_oldfd;			/* DUP2: fd to copy */
+	int sfa_flags;			/* OPEN: open flags */
+	__mode_t sfa_mode;		/* OPEN: mode for O_CREAT */
+#ifdef _KERNEL
+	userptr_t sfa_path;		/* OPEN: file to open */
+#else
+	const char *sfa_path;		/* OPEN: file to open */
+#endif
+};
+
+#endif /* _KERN_SPAWN_H_ */
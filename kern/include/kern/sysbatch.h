@@ -0,0 +1,42 @@
+#ifndef _KERN_SYSBATCH_H_
+#define _KERN_SYSBATCH_H_
+
+/*
+ * Definitions for syscall_batch(), which makes a series of system
+ * calls, in order, in one trip into the kernel.
+ *
+ * Each call's arguments go in sbc_args the way the calling
+ * convention lays them out: the words that would be in registers a0
+ * through a3, then the words that would be on the stack after the
+ * register slots. So a 64-bit argument takes an aligned pair of
+ * words, as usual.
+ *
+ * Calls that replace or end the caller (fork, vfork, execv, _exit,
+ * thread_exit), __thread_create, and syscall_batch itself can't be
+ * batched; they fail with EINVAL.
+ */
+
+/* Values for the flags argument */
+#define SYSBATCH_STOPONERR 1	/* stop after the first call that fails */
+
+/* Most calls one batch can make. */
+#define SYSBATCH_MAX	64
+
+/* Most argument words one call can use. */
+#define SYSBATCH_NARGS	6
+
+struct sysbatch_call {
+	/* This comes first; the kernel uses it as the call's stack. */
+	__u32 sbc_args[SYSBATCH_NARGS];	/* arguments */
+	int sbc_callno;			/* SYS_* */
+	int sbc_err;			/* out: 0, or the error */
+	__u32 sbc_ret[2];		/* out: return value; see below */
+};
+
+/*
+ * sbc_ret[0] is the return value (if any). For lseek, whose return
+ * value is 64 bits, sbc_ret[0] is the upper half and sbc_ret[1] the
+ * lower.
+ */
+
+#endif /* _KERN_SYSBATCH_H_ */
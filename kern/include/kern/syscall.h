@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -196,6 +196,27 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (scheduling)
+#define SYS_sched_setaffinity 121
+#define SYS_sched_getaffinity 122
+//                              (threads)
+#define SYS___thread_create 123
+#define SYS_thread_exit  124
+#define SYS_thread_join  125
+#define SYS_futex_wait   126
+#define SYS_futex_wake   127
+//                              (process creation)
+#define SYS___spawn      128
+//                              (file handles)
+#define SYS_pipe2        129
+#define SYS_copy_file_range 130
+//                              (asynchronous I/O)
+#define SYS_uring_setup  131
+#define SYS_uring_enter  132
+//                              (batching)
+#define SYS_syscall_batch 133
+//                              (profiling)
+#define SYS_sysprof      134
 
 /*CALLEND*/
 
@@ -0,0 +1,35 @@
+#ifndef _KERN_SYSPROF_H_
+#define _KERN_SYSPROF_H_
+
+/*
+ * Definitions for sysprof(), which reads the system call profile
+ * kept by kernels built with "options sysprof". (Other kernels fail
+ * it with ENOSYS.)
+ *
+ * For each call number the kernel counts the calls, how many failed,
+ * and how many cycles they took in all. It also keeps a histogram of
+ * the time each call took: sps_hist[i] counts the calls that took
+ * from 2^i up to 2^(i+1) cycles (with 0 cycles falling in sps_hist[0]).
+ *
+ * Calls that don't return (_exit, and execv when it works) aren't
+ * counted. Calls made through syscall_batch are counted as part of
+ * the syscall_batch call.
+ */
+
+/* Values for the flags argument */
+#define SYSPROF_RESET	1	/* zero the counters after reading them */
+
+/* Number of call numbers profiled; more than the highest SYS_*. */
+#define SYSPROF_NCALLS	160
+
+/* Number of histogram buckets. */
+#define SYSPROF_NBUCKETS 32
+
+struct sysprof_stat {
+	__u32 sps_calls;			/* times called */
+	__u32 sps_errors;			/* times failed */
+	__u64 sps_cycles;			/* total cycles taken */
+	__u32 sps_hist[SYSPROF_NBUCKETS];	/* latency histogram */
+};
+
+#endif /* _KERN_SYSPROF_H_ */
@@ -35,5 +35,14 @@
 #define STDOUT_FILENO 1      /* Standard output */
 #define STDERR_FILENO 2      /* Standard error */
 
+/* Flags for __thread_create */
+#define THREAD_CREATE_DETACHED 1  /* Free on exit; can't be joined */
+
+/* Modes for access */
+#define F_OK 0      /* File exists */
+#define X_OK 1      /* Executable */
+#define W_OK 2      /* Writable */
+#define R_OK 4      /* Readable */
+
 
 #endif /* _KERN_UNISTD_H_ */
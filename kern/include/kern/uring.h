@@ -0,0 +1,83 @@
+#ifndef _KERN_URING_H_
+#define _KERN_URING_H_
+
+/*
+ * Definitions for uring_setup() and uring_enter(), which let a
+ * process queue up reads, writes, and fsyncs to be done in the
+ * background and collect the results later.
+ *
+ * The rings live in memory the process and the kernel share. The
+ * process sets aside URING_SIZE(n) bytes of page-aligned memory for
+ * rings of n entries (a power of 2, at most URING_MAXENTRIES) and
+ * passes it to uring_setup. The first page holds struct uring_hdr;
+ * the submission queue starts on the next page, and the completion
+ * queue on the page after that.
+ *
+ * To submit an operation, fill in sq[sq_tail % n] and then advance
+ * sq_tail; the kernel takes everything from sq_head up to sq_tail
+ * when uring_enter is called. Each finished operation puts an entry
+ * at cq[cq_tail % n]; consume it and then advance cq_head. Only the
+ * kernel changes sq_head and cq_tail, and only the process changes
+ * sq_tail and cq_head.
+ *
+ * The kernel won't take a submission unless the completion queue is
+ * sure to have room for its result, so the completion queue can't
+ * overflow if the process keeps cq_head honest.
+ */
+
+/* Values for sqe_op */
+#define URING_OP_NOP	0	/* just complete */
+#define URING_OP_READ	1	/* read into sqe_buf */
+#define URING_OP_WRITE	2	/* write from sqe_buf */
+#define URING_OP_FSYNC	3	/* fsync(sqe_fd) */
+
+/* Most entries a ring can have. */
+#define URING_MAXENTRIES 128
+
+/* Most one read or write transfers; larger ones come up short. */
+#define URING_MAXIO	(64*1024)
+
+/* Page size the ring layout assumes. */
+#define URING_PAGESIZE	4096
+
+/* A submission. sqe_pos of -1 means use (and advance) the seek position. */
+struct uring_sqe {
+	int sqe_op;			/* URING_OP_* */
+	int sqe_fd;			/* file to act on */
+#ifdef _KERNEL
+	userptr_t sqe_buf;		/* READ/WRITE: buffer */
+#else
+	void *sqe_buf;			/* READ/WRITE: buffer */
+#endif
+	__u32 sqe_len;			/* READ/WRITE: buffer size */
+	__off_t sqe_pos;		/* READ/WRITE: file position, or -1 */
+	__u32 sqe_data;			/* passed back in cqe_data */
+	__u32 sqe_flags;		/* must be 0 */
+};
+
+/* A completion: the byte count, or 0 for NOP/FSYNC, or minus an errno. */
+struct uring_cqe {
+	__u32 cqe_data;			/* sqe_data of the operation */
+	int cqe_res;			/* result */
+};
+
+struct uring_hdr {
+	volatile unsigned sq_head;	/* next submission the kernel takes */
+	volatile unsigned sq_tail;	/* next free submission slot */
+	volatile unsigned cq_head;	/* next completion to consume */
+	volatile unsigned cq_tail;	/* next completion the kernel fills */
+};
+
+#define URING_ROUNDPAGE(sz) \
+	(((sz) + URING_PAGESIZE - 1) / URING_PAGESIZE * URING_PAGESIZE)
+
+/* Where the queues are, in bytes from the start of the shared memory. */
+#define URING_SQOFFSET(n)	URING_PAGESIZE
+#define URING_CQOFFSET(n) \
+	(URING_SQOFFSET(n) + URING_ROUNDPAGE((n) * sizeof(struct uring_sqe)))
+
+/* How much memory rings of N entries take. */
+#define URING_SIZE(n) \
+	(URING_CQOFFSET(n) + URING_ROUNDPAGE((n) * sizeof(struct uring_cqe)))
+
+#endif /* _KERN_URING_H_ */
@@ -0,0 +1,38 @@
+#ifndef _KERN_VDSO_H_
+#define _KERN_VDSO_H_
+
+/*
+ * The vdso pages: two read-only pages the kernel maps into every user
+ * address space, so that libc can answer some questions without a
+ * system call.
+ *
+ * The first page belongs to the process and holds its pid and its
+ * parent's. A vfork child, which borrows its parent's address space,
+ * finds its parent's ids there until it execs or exits, so libc asks
+ * the kernel instead while a vfork child is running.
+ *
+ * The second page is the same for everyone and holds the time of day,
+ * updated every hardclock tick, so it's only good to 1/HZ seconds. It
+ * is protected by a sequence count: vc_seq is odd while an update is
+ * in progress and changes with every update. To read it, wait for
+ * vc_seq to be even, read the time, and start over if vc_seq changed.
+ */
+
+#define VDSO_BASE	0x00100000	/* below where programs are linked */
+#define VDSO_PAGESIZE	4096
+#define VDSO_PROC	VDSO_BASE			/* struct vdso_proc */
+#define VDSO_CLOCK	(VDSO_BASE + VDSO_PAGESIZE)	/* struct vdso_clock */
+#define VDSO_SIZE	(2 * VDSO_PAGESIZE)
+
+struct vdso_proc {
+	__pid_t vp_pid;			/* getpid() */
+	__pid_t vp_ppid;		/* getppid() */
+};
+
+struct vdso_clock {
+	__u32 vc_seq;			/* sequence count */
+	__u32 vc_nsec;			/* nanoseconds */
+	__time_t vc_sec;		/* seconds since the epoch */
+};
+
+#endif /* _KERN_VDSO_H_ */
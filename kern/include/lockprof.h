@@ -0,0 +1,91 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+/*
+ * Lock contention profiler. Enable with "options lockprof" in the
+ * kernel config; otherwise all of this compiles away to nothing.
+ *
+ * Each spinlock, lock, and semaphore carries a struct lockprof that
+ * counts how often it was acquired, how often the acquirer had to
+ * wait, how long it waited (in cycles), and how long the lock was
+ * held. The structure is only updated while holding the thing being
+ * profiled, so it needs no locking of its own. It is added to a
+ * global list the first time it's acquired, which is what the "lkprof"
+ * menu command reports from; it's removed again by spinlock_cleanup,
+ * lock_destroy, or sem_destroy. (So a spinlock that has ever been
+ * acquired must be cleaned up before its memory is freed; "lkprof"
+ * panics if it finds the list damaged by one that wasn't.)
+ *
+ * Sleep locks and semaphores are reported by name, with all the ones
+ * of the same name added together. Spinlocks don't have names, so they
+ * are reported by the address that first acquired them.
+ *
+ * Times come from the cycle counter of whichever cpu looked. A thread
+ * that sleeps on a lock may wake up on a different cpu, so sleeping
+ * waits and hold times are only approximate.
+ */
+
+#include "opt-lockprof.h"
+
+#if OPT_LOCKPROF
+
+struct lockprof {
+	const char *lp_name;		/* Name, or NULL for spinlocks */
+	const void *lp_site;		/* First acquirer, for spinlocks */
+	struct lockprof *lp_next;	/* Global list */
+	struct lockprof **lp_prevp;	/* NULL if not on the list */
+	unsigned lp_acquires;		/* Times acquired */
+	unsigned lp_contended;		/* Times acquired after waiting */
+	uint64_t lp_waitcycles;		/* Total cycles waited */
+	uint32_t lp_maxwait;		/* Longest wait */
+	uint32_t lp_maxhold;		/* Longest hold */
+	uint32_t lp_holdstart;		/* Cycle count when last acquired */
+};
+
+/* Per-acquire state, a local variable of the acquiring function. */
+struct lockprof_wait {
+	bool w_waited;
+	uint32_t w_start;
+};
+
+void lockprof_init(struct lockprof *lp, const char *name);
+void lockprof_cleanup(struct lockprof *lp);
+void lockprof_wait(struct lockprof_wait *w);
+void lockprof_acquired(struct lockprof *lp, struct lockprof_wait *w,
+		       const void *site);
+void lockprof_released(struct lockprof *lp);
+
+void lockprof_print(unsigned max);
+void lockprof_reset(void);
+
+#define LOCKPROF(sym)			struct lockprof sym
+#define LOCKPROF_WAITER(sym)		struct lockprof_wait sym = { false, 0 }
+
+/* Note the trailing comma, for use in SPINLOCK_INITIALIZER. */
+#define LOCKPROF_INITIALIZER	{ NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0 },
+
+#define LOCKPROF_INIT(lp, name)		lockprof_init(lp, name)
+#define LOCKPROF_CLEANUP(lp)		lockprof_cleanup(lp)
+
+/* Note that we're about to wait; only the first call counts. */
+#define LOCKPROF_WAIT(w)	((w).w_waited ? (void)0 : lockprof_wait(&(w)))
+#define LOCKPROF_ACQUIRED(lp, w, site)	lockprof_acquired(lp, &(w), site)
+#define LOCKPROF_RELEASED(lp)		lockprof_released(lp)
+
+#else
+
+#define LOCKPROF(sym)
+#define LOCKPROF_WAITER(sym)
+
+#define LOCKPROF_INITIALIZER
+
+#define LOCKPROF_INIT(lp, name)
+#define LOCKPROF_CLEANUP(lp)
+
+#define LOCKPROF_WAIT(w)
+#define LOCKPROF_ACQUIRED(lp, w, site)
+#define LOCKPROF_RELEASED(lp)
+
+#endif
+
+#endif /* LOCKPROF_H */
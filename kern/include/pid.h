@@ -65,8 +65,9 @@ void pid_disown(pid_t targetpid);
 void pid_setexitstatus(int status);
 
 /*
- * Causes the current thread to wait for the thread with pid PID to
- * exit, returning the exit status when it does.
+ * Causes the current thread to wait for the thread with pid PID (or,
+ * if PID is -1, any child) to exit, returning the exit status when it
+ * does.
  */
 int pid_wait(pid_t targetpid, int *status, int flags, pid_t *retpid);
 
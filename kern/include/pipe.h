@@ -0,0 +1,20 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a pair of vnodes that aren't in any file system: what's
+ * written to the write end can be read from the read end. Each end
+ * goes away when its last reference is dropped, and the pipe with
+ * the second one.
+ *
+ * If NONBLOCK is set, reads and writes fail with EAGAIN instead of
+ * waiting.
+ */
+
+struct vnode;
+
+int pipe_create(bool nonblock, struct vnode **readvn, struct vnode **writevn);
+
+#endif /* _PIPE_H_ */
@@ -0,0 +1,78 @@
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Waiting for file objects to become ready, for poll and select.
+ *
+ * A poller is one thread waiting on any of several objects. Each
+ * object it waits on gets a pollentry, which goes on that object's
+ * pollqueue. An object that can make a poller wait embeds a
+ * pollqueue, and calls pollqueue_wakeup whenever it might have
+ * become ready; that may be done from an interrupt handler.
+ *
+ * vop_poll gets a pollentry, or NULL if the caller only wants to
+ * know what's ready now. If it gets one, it must put it on (at most
+ * one) pollqueue with pollqueue_add *before* checking whether it's
+ * ready. That way, if it becomes ready in between, the wakeup isn't
+ * lost. Objects that are always ready needn't bother.
+ *
+ * The caller holds a reference to the object until the entry has
+ * come off the queue again, so the queue can't go away first.
+ */
+
+#include <spinlock.h>
+#include <kern/poll.h>
+
+struct wchan;
+
+struct poller {
+	struct spinlock pl_lock;	/* lock for pl_woken */
+	struct wchan *pl_wchan;		/* where the thread sleeps */
+	bool pl_woken;			/* something might be ready */
+};
+
+struct pollentry {
+	struct poller *pe_poller;	/* who's waiting */
+	struct pollqueue *pe_queue;	/* queue we're on, or NULL */
+	struct pollentry *pe_next;	/* next on the queue */
+	struct pollentry **pe_prevp;	/* link that points to us */
+};
+
+struct pollqueue {
+	struct spinlock pq_lock;	/* lock for pq_entries */
+	struct pollentry *pq_entries;	/* pollers waiting */
+};
+
+/* Set up and clean up a poller. */
+int poller_init(struct poller *pl);
+void poller_cleanup(struct poller *pl);
+
+/*
+ * Get ready to make another pass over the objects: forget any
+ * earlier wakeup.
+ */
+void poller_reset(struct poller *pl);
+
+/*
+ * Sleep until an object the poller is queued on wakes it, or for at
+ * most TICKS hardclock ticks if TIMED. Returns ETIMEDOUT if the time
+ * ran out. Returns right away if there's been a wakeup since the
+ * last reset.
+ */
+int poller_wait(struct poller *pl, bool timed, unsigned ticks);
+
+/* Set up an entry for a poller; and take it off its queue, if any. */
+void pollentry_init(struct pollentry *pe, struct poller *pl);
+void pollentry_remove(struct pollentry *pe);
+
+/* Set up and clean up a queue. It must be empty when cleaned up. */
+void pollqueue_init(struct pollqueue *pq);
+void pollqueue_cleanup(struct pollqueue *pq);
+
+/* Put an entry on a queue; does nothing if PE is NULL. */
+void pollqueue_add(struct pollqueue *pq, struct pollentry *pe);
+
+/* Wake all the pollers on a queue. */
+void pollqueue_wakeup(struct pollqueue *pq);
+
+#endif /* _POLL_H_ */
@@ -41,6 +41,29 @@
 
 struct addrspace;
 struct vnode;
+struct lock;
+struct cv;
+struct semaphore;
+struct uring;
+
+/*
+ * A user-level thread. A process gets a table of these the first time
+ * it creates a thread, with its existing thread as the first entry.
+ * The index of the entry is also the slot of the thread's user stack
+ * (see as_define_threadstack). An entry stays in use after its thread
+ * exits until thread_join collects the result, unless it's detached.
+ */
+struct uthread {
+	int ut_tid;			/* Thread id, or 0 if entry is free */
+	struct thread *ut_thread;	/* The thread, once it has started */
+	bool ut_exited;			/* It has called thread_exit */
+	bool ut_detached;		/* Nobody will join it */
+	bool ut_joining;		/* Someone is waiting in thread_join */
+	userptr_t ut_result;		/* Value passed to thread_exit */
+};
+
+/* Most threads one process can have at once. */
+#define PROC_UTHREADS_MAX	32
 
 /*
  * Process structure.
@@ -57,13 +80,23 @@ struct proc {
 	struct threadarray p_threads;	/* Threads in this process */
 	struct spinlock p_lock;		/* Lock for rest of this structure */
 	pid_t p_pid;			/* Process ID */
+	pid_t p_ppid;			/* Parent's process ID */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
+	struct semaphore *p_vforksem;	/* Parent in vfork, if borrowed */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct uring *p_uring;		/* async I/O rings, or NULL */
+
+	/* User-level threads */
+	struct lock *p_utlock;		/* Lock for the fields below */
+	struct cv *p_utcv;		/* Broadcast when a thread exits */
+	struct uthread *p_uthreads;	/* Thread table, or NULL */
+	int p_nexttid;			/* Next thread id to try */
+	int p_exitstatus;		/* Status of the last _exit or fault */
 
 	/* add more material here as needed */
 };
@@ -80,6 +113,15 @@ int proc_create_runprogram(const char *name, struct proc **ret);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
+/* Same, but named NAME and without an address space. */
+int proc_fork_noas(const char *name, struct proc **ret);
+
+/*
+ * Give the address space borrowed by a vfork child back to the parent
+ * and let the parent run again. Called on exec and exit.
+ */
+void proc_vforkdone(struct proc *proc);
+
 /* Undo proc_fork if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
 
@@ -95,6 +137,13 @@ void proc_destroy(struct proc *proc);
  */
 void proc_exit(int status);
 
+/*
+ * Make the current thread exit, passing RESULT to thread_join. If it
+ * is the last thread in its process, the process exits too, with the
+ * status given to the last _exit (or 0 if none).
+ */
+__DEAD void proc_thread_exit(userptr_t result);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
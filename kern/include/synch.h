@@ -48,11 +48,22 @@ struct semaphore {
         struct wchan *sem_wchan;
         struct spinlock sem_lock;
         volatile unsigned sem_count;
+        bool sem_handoff;               /* FIFO direct handoff mode */
+        LOCKPROF(sem_prof);             /* Contention profiling. */
 };
 
 struct semaphore *sem_create(const char *name, unsigned initial_count);
 void sem_destroy(struct semaphore *);
 
+/*
+ * By default a thread woken by V() has to compete for the count with
+ * any thread that calls P() in the meantime, and may lose and go back
+ * to sleep. In handoff mode, V() gives the count directly to the
+ * longest-waiting thread instead, so waiters are served strictly in
+ * FIFO order and a woken thread always gets through.
+ */
+void sem_sethandoff(struct semaphore *, bool handoff);
+
 /*
  * Operations (both atomic):
  *     P (proberen): decrement count. If the count is 0, block until
@@ -78,11 +89,27 @@ struct lock {
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        bool lk_handoff;                /* FIFO direct handoff mode */
+        bool lk_granted;                /* Handed off, not yet taken */
+        LOCKPROF(lk_prof);              /* Contention profiling. */
 };
 
 struct lock *lock_create(const char *name);
 void lock_destroy(struct lock *);
 
+/*
+ * Locks are adaptive: a thread that finds the lock held spins for a
+ * while if the holder is currently running on another CPU (and so is
+ * likely to release it soon), and only sleeps if the holder is not
+ * running or the spin runs out.
+ *
+ * In handoff mode, lock_release instead passes the lock directly to
+ * the longest-waiting thread, as with sem_sethandoff. Handoff locks
+ * are strictly FIFO and never spin, since a spinning newcomer would
+ * be jumping the queue.
+ */
+void lock_sethandoff(struct lock *, bool handoff);
+
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
@@ -91,12 +118,16 @@ void lock_destroy(struct lock *);
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
+ *    lock_timedacquire - Like lock_acquire, but give up and return
+ *                   ETIMEDOUT if the lock can't be had within TICKS
+ *                   hardclock ticks. Returns 0 on success.
  *
  * These operations must be atomic. You get to write them.
  */
 void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
+int lock_timedacquire(struct lock *, unsigned ticks);
 
 
 /*
@@ -128,6 +159,10 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - Like cv_wait, but stop sleeping after TICKS
+ *                   hardclock ticks if not woken first. Returns 0 if
+ *                   woken, ETIMEDOUT otherwise; the lock is
+ *                   re-acquired in either case.
  *
  * For all three operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
@@ -138,6 +173,59 @@ void cv_destroy(struct cv *);
 void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers queue
+ * up behind it, so a steady stream of readers can't starve writers
+ * out. When a writer releases, waiting writers go first; the waiting
+ * readers get in (all together) once no writer is waiting.
+ *
+ * For the deadlock detector, a writer holds the lock in the usual
+ * way; readers are only tracked while they are waiting, since
+ * hangman has no way to represent multiple holders. So it can see a
+ * reader blocked behind a writer, but not a writer blocked behind
+ * readers.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        HANGMAN_LOCKABLE(rwlock_hangman); /* Deadlock detector hook. */
+        struct wchan *rwlock_rwchan;    /* Readers wait here */
+        struct wchan *rwlock_wwchan;    /* Writers wait here */
+        struct spinlock rwlock_lock;
+        unsigned rwlock_readers;        /* Readers holding the lock */
+        unsigned rwlock_wwaiting;       /* Writers waiting */
+        struct thread *rwlock_writer;   /* Writer holding the lock */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Multiple threads
+ *                          can hold the lock for reading at once.
+ *    rwlock_release_read  - Free the lock after reading.
+ *    rwlock_acquire_write - Get the lock for writing. Only one thread
+ *                          can hold it for writing, and only if no
+ *                          threads hold it for reading.
+ *    rwlock_release_write - Free the lock after writing.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                          the lock for writing. (There is no reader
+ *                          equivalent, since readers aren't recorded.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
 
 
 #endif /* _SYNCH_H_ */
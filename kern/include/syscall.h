@@ -33,6 +33,8 @@
 
 #include <cdefs.h> /* for __DEAD */
 struct trapframe; /* from <machine/trapframe.h> */
+struct proc; /* from <proc.h> */
+struct addrspace; /* from <addrspace.h> */
 
 /*
  * The system call dispatcher.
@@ -51,9 +53,22 @@ void enter_forked_process(struct trapframe *tf);
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
+/* Enter user mode in a new thread of the current process. */
+__DEAD void enter_new_thread(userptr_t arg0, userptr_t arg1,
+			     vaddr_t stackptr, vaddr_t gp, vaddr_t entrypoint);
+
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futexes. */
+void futex_bootstrap(void);
+
+/* Setup function for async I/O rings. */
+void uring_bootstrap(void);
+
+/* Drop a process's rings; they may keep its old address space. */
+bool uring_release(struct proc *proc, struct addrspace *as);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,19 +79,48 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
+int sys___spawn(userptr_t prog, userptr_t args, userptr_t actions,
+		int nactions, pid_t *retval);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys_getppid(pid_t *retval);
+int sys_sched_setaffinity(pid_t pid, size_t size, const_userptr_t mask);
+int sys_sched_getaffinity(pid_t pid, size_t size, userptr_t mask);
+
+int sys___thread_create(userptr_t start, userptr_t arg0, userptr_t arg1,
+			int flags, vaddr_t callersp, vaddr_t callergp,
+			int *retval);
+__DEAD void sys_thread_exit(userptr_t result);
+int sys_thread_join(int tid, userptr_t resultp);
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int count, int *retval);
+int sys_uring_setup(userptr_t mem, unsigned entries);
+int sys_uring_enter(unsigned tosubmit, unsigned mincomplete, int *retval);
+int sys_sysprof(userptr_t stats, unsigned nstats, int flags, int *retval);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds, int flags);
+int sys_copy_file_range(int infd, userptr_t inoffp, int outfd,
+			userptr_t outoffp, size_t len, unsigned flags,
+			int *retval);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t readfds, userptr_t writefds,
+	       userptr_t exceptfds, userptr_t timeout, int *retval);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
@@ -89,6 +133,9 @@ int sys_link(userptr_t oldpath, userptr_t newpath);
 int sys_rename(userptr_t oldpath, userptr_t newpath);
 int sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval);
 int sys_fstat(int fd, userptr_t statptr);
+int sys_stat(userptr_t path, userptr_t statptr);
+int sys_lstat(userptr_t path, userptr_t statptr);
+int sys_access(userptr_t path, int mode);
 int sys_fsync(int fd);
 int sys_ftruncate(int fd, off_t len);
 
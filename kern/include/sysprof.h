@@ -0,0 +1,50 @@
+#ifndef SYSPROF_H
+#define SYSPROF_H
+
+/*
+ * System call profiler. Enable with "options sysprof" in the kernel
+ * config; otherwise all of this compiles away to nothing, and the
+ * sysprof() system call fails with ENOSYS.
+ *
+ * syscall() times each call with the cycle counter and adds it to
+ * the counters for its call number (see <kern/sysprof.h>). Each cpu
+ * has its own set of counters, updated with interrupts off, so no
+ * locking is needed; they're allocated when the cpu is created, while
+ * large allocations still work. Reports add the cpus' counters up.
+ *
+ * The "sp" menu command prints the busiest calls, and userland can
+ * read everything with sysprof().
+ */
+
+#include "opt-sysprof.h"
+
+#if OPT_SYSPROF
+
+/* Per-call state, a local variable of syscall(). */
+struct sysprof_timer {
+	int t_callno;
+	uint32_t t_start;
+};
+
+void sysprof_cpu_init(unsigned cpunum);
+void sysprof_start(struct sysprof_timer *t, int callno);
+void sysprof_end(struct sysprof_timer *t, int err);
+
+void sysprof_print(unsigned max);
+void sysprof_reset(void);
+
+#define SYSPROF_TIMER(sym)		struct sysprof_timer sym
+#define SYSPROF_CPU_INIT(cpunum)	sysprof_cpu_init(cpunum)
+#define SYSPROF_START(t, callno)	sysprof_start(&(t), callno)
+#define SYSPROF_END(t, err)		sysprof_end(&(t), err)
+
+#else
+
+#define SYSPROF_TIMER(sym)
+#define SYSPROF_CPU_INIT(cpunum)
+#define SYSPROF_START(t, callno)
+#define SYSPROF_END(t, err)
+
+#endif
+
+#endif /* SYSPROF_H */
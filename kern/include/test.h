@@ -42,6 +42,7 @@
 
 /* For testing the wait implementation. */
 int waittest(int, char **);
+int pidtest(int, char **);
 
 /* data structure tests */
 int arraytest(int, char **);
@@ -57,6 +58,17 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int handofftest(int, char **);
+int spinlocktest(int, char **);
+int rwtest(int, char **);
+int callouttest(int, char **);
+int affinitytest(int, char **);
+
+/* pipe test */
+int pipetest(int, char **);
+
+/* poll test */
+int polltest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -39,8 +39,10 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include <callout.h>
 
 struct cpu;
+struct wchan;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -82,9 +84,21 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	uint32_t t_affinity;		/* CPUs thread may run on */
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
+	/*
+	 * Sleep state. t_wchan is the wait channel we're on while
+	 * sleeping, and is protected by that channel's spinlock,
+	 * t_sleeplock. t_timeout is used by wchan_timedsleep to take
+	 * us back off the channel if nobody wakes us in time.
+	 */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
+	struct spinlock *t_sleeplock;	/* Lock for t_wchan */
+	struct callout t_timeout;	/* Timeout for timed sleeps */
+	bool t_timedout;		/* True if t_timeout woke us */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -125,6 +139,9 @@ void thread_bootstrap(void);
 /* Call late in system startup to get secondary CPUs running. */
 void thread_start_cpus(void);
 
+/* Number of CPUs (all are known once mainbus_bootstrap has run). */
+unsigned thread_numcpus(void);
+
 /* Call during panic to stop other threads in their tracks */
 void thread_panic(void);
 
@@ -145,6 +162,29 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * CPU affinity. Each thread has a mask of the cpus it may run on, bit
+ * N for cpu number N; a new thread gets the mask of the thread that
+ * forked it. The scheduler never puts a thread on a cpu outside its
+ * mask, except that a thread that's waking up on the cpu it went to
+ * sleep on (because that cpu has nothing else to do) may run there
+ * until its next context switch.
+ *
+ * thread_setaffinity sets the current thread's mask, moving it to a
+ * cpu in the mask if necessary. Bits for cpus that don't exist are
+ * ignored; returns EINVAL if the mask has no usable cpus at all.
+ */
+#define THREAD_AFFINITY_ALL	0xffffffffU
+int thread_setaffinity(uint32_t mask);
+uint32_t thread_getaffinity(void);
+
+/*
+ * Free the dead threads (and their stacks) that are being kept around
+ * for reuse by thread_fork. Call when memory is short. Returns the
+ * number of threads freed.
+ */
+unsigned thread_reclaim(void);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -144,5 +144,18 @@ void uio_kinit(struct iovec *, struct uio *,
 void uio_uinit(struct iovec *, struct uio *,
 	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * The same, for several user buffers at once (as for readv/writev).
+ * LEN must be the total of their lengths.
+ */
+void uio_uinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		size_t len, off_t pos, enum uio_rw rw);
+
+/*
+ * Vectored I/O with up to this many buffers doesn't need to allocate
+ * memory for the iovecs.
+ */
+#define UIO_SMALLIOV	8
+
 
 #endif /* _UIO_H_ */
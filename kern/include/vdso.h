@@ -0,0 +1,25 @@
+#ifndef _VDSO_H_
+#define _VDSO_H_
+
+/*
+ * Kernel side of the vdso pages (see <kern/vdso.h>).
+ *
+ * vdso_bootstrap allocates the clock page, which every address space
+ * shares; vdso_hardclock keeps it up to date. vdso_define maps both
+ * pages into a new address space for PROC, and vdso_setproc rewrites
+ * the process page (for fork, whose copy still has the parent's ids,
+ * and for vfork, which lends the child its parent's).
+ *
+ * The address space code does the mapping: see as_define_vdso and
+ * as_vdso_proc.
+ */
+
+struct addrspace;
+struct proc;
+
+void vdso_bootstrap(void);
+void vdso_hardclock(void);
+int vdso_define(struct addrspace *as, struct proc *proc);
+void vdso_setproc(struct addrspace *as, struct proc *proc);
+
+#endif /* _VDSO_H_ */
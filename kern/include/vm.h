@@ -63,6 +63,7 @@
 #define HPTABLE_WRITE          4
 #define HPTABLE_EXECUTE        2
 #define HPTABLE_SWRITE         1
+#define HPTABLE_SHARED        16 /* frame isn't ours: don't copy or free */
 
 #define HPTABLE_PERMISSION    15
 #define HPTABLE_STATEBITS     31
@@ -90,6 +91,9 @@ void vm_bootstrap(void);
 /* Fault handling function called by trap code */
 int vm_fault(int faulttype, vaddr_t faultaddress);
 
+/* Kernel address of a page of the current process's memory */
+int vm_getkpage(vaddr_t uaddr, bool write, vaddr_t *ret);
+
 /* Allocate/free kernel heap pages (called by kmalloc/kfree) */
 vaddr_t alloc_kpages(unsigned npages);
 void free_kpages(vaddr_t addr);
@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct thread; /* in thread.h */
 struct wchan; /* Opaque */
 
 /*
@@ -66,15 +67,31 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Like wchan_sleep, but give up after TICKS hardclock ticks if nobody
+ * has woken us by then. Returns 0 if woken, ETIMEDOUT if the time ran
+ * out. Either way the associated lock is relocked upon return.
+ */
+int wchan_timedsleep(struct wchan *wc, struct spinlock *lk, unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
- * The associated spinlock should be locked.
+ * The associated spinlock should be locked. wchan_wakeone returns
+ * true if there was a thread to wake.
  *
  * The current implementation is FIFO but this is not promised by the
  * interface.
  */
-void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
+bool wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Wake up a particular thread, if it's sleeping on the wait channel.
+ * The associated spinlock should be locked. Returns true if the
+ * thread was there to wake.
+ */
+bool wchan_wakethread(struct wchan *wc, struct spinlock *lk,
+		      struct thread *target);
+
 
 #endif /* _WCHAN_H_ */
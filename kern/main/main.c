@@ -48,6 +48,7 @@
 #include <device.h>
 #include <pid.h>
 #include <syscall.h>
+#include <vdso.h>
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
@@ -128,8 +129,11 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	vdso_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
+	uring_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/reboot.h>
+#include <kern/sysprof.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
 #include <limits.h>
@@ -45,8 +46,12 @@
 #include <pid.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockprof.h>
+#include <sysprof.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockprof.h"
+#include "opt-sysprof.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -500,6 +505,61 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKPROF
+/*
+ * Show the most contended locks since the last time, and start
+ * counting again.
+ */
+static
+int
+cmd_lockprof(int nargs, char **args)
+{
+	int max = 10;
+
+	if (nargs == 2) {
+		max = atoi(args[1]);
+	}
+	if (nargs > 2 || max <= 0) {
+		kprintf("Usage: lkprof [count]\n");
+		return EINVAL;
+	}
+
+	lockprof_print(max);
+	lockprof_reset();
+
+	return 0;
+}
+#endif
+
+#if OPT_SYSPROF
+/*
+ * Show the system calls that took the most time since the last
+ * time, and start counting again.
+ */
+static
+int
+cmd_sysprof(int nargs, char **args)
+{
+	int max = 10;
+
+	if (nargs == 2) {
+		max = atoi(args[1]);
+	}
+	if (nargs > 2 || max <= 0) {
+		kprintf("Usage: sp [count]\n");
+		return EINVAL;
+	}
+	if (max > SYSPROF_NCALLS) {
+		max = SYSPROF_NCALLS;
+	}
+
+	sysprof_print(max);
+	sysprof_reset();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -576,8 +636,16 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] Lock/semaphore handoff test   ",
+	"[sp1] Spinlock contention test      ",
+	"[rwt1] Reader-writer lock test      ",
+	"[co1] Callout test                  ",
+	"[af1] CPU affinity test             ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
+	"[wt2] Many-process pid test         ",
+	"[pp1] Pipe test                     ",
+	"[pl1] Poll test                     ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
@@ -606,6 +674,12 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+#if OPT_LOCKPROF
+	"[lkprof] Lock contention stats      ",
+#endif
+#if OPT_SYSPROF
+	"[sp] System call stats              ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +731,12 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+#if OPT_LOCKPROF
+	{ "lkprof",     cmd_lockprof },
+#endif
+#if OPT_SYSPROF
+	{ "sp",		cmd_sysprof },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -679,6 +759,11 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	handofftest },
+	{ "sp1",	spinlocktest },
+	{ "rwt1",	rwtest },
+	{ "co1",	callouttest },
+	{ "af1",	affinitytest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -707,6 +792,9 @@ static struct {
 	/* system call assignment tests */
 	/* For testing the wait implementation. */
 	{ "wt",		waittest },
+	{ "wt2",	pidtest },
+	{ "pp1",	pipetest },
+	{ "pl1",	polltest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
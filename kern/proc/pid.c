@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+
 /*
  * Process ID management.
  */
@@ -36,43 +37,81 @@
 #include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
-#include <array.h>
-#include <clock.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <wchan.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
-#include <synch.h>
 #include <pid.h>
 
 /*
- * Structure for holding exit data of a thread.
+ * Structure for holding exit data of a process.
+ *
+ * Each process's pidinfo keeps two lists of its children: the ones
+ * still running (and not disowned), and the zombies (exited but not yet waited for), in
+ * the order they exited. Waiting for any child just takes the first
+ * zombie, and exiting only has to deal with our own zombies; running
+ * children find out we're gone when they exit themselves, and then
+ * reap themselves.
+ *
+ * pi_lock protects the fields of this pidinfo marked (own), and the
+ * fields of its children marked (parent). pi_parent never changes,
+ * but is only meaningful until the parent has waited for us: after
+ * that we may stay in the table for our own children's sake, and the
+ * parent may go away, so we're marked disowned and lookups skip us.
+ * The lock order is parent, then child, then the process table.
  *
- * If pi_ppid is INVALID_PID, the parent has gone away and will not be
- * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
- * structure can be freed.
+ * pi_refs counts the parent's interest in this pidinfo (1 until it's
+ * been waited for, or the parent has gone or disowned it) plus one
+ * for each child on either list, since their pi_parent points here.
+ * When it drops to 0, the pidinfo can be freed.
  */
 struct pidinfo {
-	pid_t pi_pid;			// process id of this thread
-	pid_t pi_ppid;			// process id of parent thread
-	volatile bool pi_exited;	// true if thread has exited
-	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	pid_t pi_pid;			// process id of this process
+	struct pidinfo *pi_parent;	// parent, or NULL for the kernel
+	struct spinlock pi_lock;	// lock for this and our children
+	struct wchan *pi_wchan;		// (own) wait here for a child
+	struct pidinfo *pi_kids;	// (own) children still running
+	struct pidinfo *pi_zombies;	// (own) exited children, oldest first
+	struct pidinfo **pi_zombtail;	// (own) end of pi_zombies
+	unsigned pi_refs;		// (own) see above
+	bool pi_nowait;			// (own) exited; children reap themselves
+	struct pidinfo *pi_next;	// (parent) link on pi_kids/pi_zombies
+	struct pidinfo **pi_prevp;	// (parent) link on pi_kids/pi_zombies
+	bool pi_exited;			// (parent) true if process has exited
+	bool pi_disowned;		// (parent) parent won't wait (or did)
+	int pi_exitstatus;		// (parent) status (only valid if exited)
 };
 
-
 /*
- * Global pid and exit data.
+ * The process table is a two-level radix tree indexed by pid. The top
+ * level is a fixed array with room for every possible pid; the leaves
+ * are allocated as pids in their range are first used, and then kept.
+ * Each leaf has a spinlock for its slots. Only a parent looks up
+ * pidinfos, and only to find its own children, which can't go away
+ * while it holds its own pi_lock.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * Which pids are in use is kept in a separate bitmap, which is all
+ * pid_alloc needs to look at. It's protected by pidmaplock.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
-static int nprocs;			// number of allocated pids
+#define PID_LEAFBITS	8
+#define PID_LEAFSIZE	(1 << PID_LEAFBITS)
+#define PID_NLEAVES	((PID_MAX + PID_LEAFSIZE) / PID_LEAFSIZE)
+
+struct pidleaf {
+	struct spinlock pl_lock;
+	struct pidinfo *pl_info[PID_LEAFSIZE];
+};
+
+static struct pidleaf *pidleaves[PID_NLEAVES];
+
+#define PID_MAPWORDS	((PID_MAX + 32) / 32)
 
+static struct spinlock pidmaplock = SPINLOCK_INITIALIZER;
+static uint32_t pidmap[PID_MAPWORDS];	// set bits are pids in use
+static pid_t nextpid;			// next candidate pid
+static unsigned nfreepids;		// number of unused pids
 
 
 /*
@@ -80,26 +119,33 @@ static int nprocs;			// number of allocated pids
  */
 static
 struct pidinfo *
-pidinfo_create(pid_t pid, pid_t ppid)
+pidinfo_create(pid_t pid, struct pidinfo *parent)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid != INVALID_PID);
-
 	pi = kmalloc(sizeof(struct pidinfo));
 	if (pi==NULL) {
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
+	pi->pi_wchan = wchan_create("pidinfo");
+	if (pi->pi_wchan == NULL) {
 		kfree(pi);
 		return NULL;
 	}
+	spinlock_init(&pi->pi_lock);
 
 	pi->pi_pid = pid;
-	pi->pi_ppid = ppid;
+	pi->pi_parent = parent;
+	pi->pi_kids = NULL;
+	pi->pi_zombies = NULL;
+	pi->pi_zombtail = &pi->pi_zombies;
+	pi->pi_refs = 1;
+	pi->pi_nowait = false;
+	pi->pi_next = NULL;
+	pi->pi_prevp = NULL;
 	pi->pi_exited = false;
+	pi->pi_disowned = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
 
 	return pi;
@@ -112,168 +158,397 @@ static
 void
 pidinfo_destroy(struct pidinfo *pi)
 {
-	KASSERT(pi->pi_exited == true);
-	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
+	KASSERT(pi->pi_refs == 0);
+	KASSERT(pi->pi_kids == NULL);
+	KASSERT(pi->pi_zombies == NULL);
+	spinlock_cleanup(&pi->pi_lock);
+	wchan_destroy(pi->pi_wchan);
 	kfree(pi);
 }
 
+/*
+ * Child list handling. Call with the parent's pi_lock held.
+ */
+static
+void
+pi_unlink(struct pidinfo *parent, struct pidinfo *kid)
+{
+	KASSERT(spinlock_do_i_hold(&parent->pi_lock));
+	KASSERT(kid->pi_parent == parent);
+
+	*kid->pi_prevp = kid->pi_next;
+	if (kid->pi_next != NULL) {
+		kid->pi_next->pi_prevp = kid->pi_prevp;
+	}
+	else if (kid->pi_exited) {
+		/* It was the last zombie. */
+		parent->pi_zombtail = kid->pi_prevp;
+	}
+	kid->pi_next = NULL;
+	kid->pi_prevp = NULL;
+}
+
+static
+void
+pi_addkid(struct pidinfo *parent, struct pidinfo *kid)
+{
+	KASSERT(spinlock_do_i_hold(&parent->pi_lock));
+
+	kid->pi_next = parent->pi_kids;
+	if (kid->pi_next != NULL) {
+		kid->pi_next->pi_prevp = &kid->pi_next;
+	}
+	kid->pi_prevp = &parent->pi_kids;
+	parent->pi_kids = kid;
+}
+
+static
+void
+pi_addzombie(struct pidinfo *parent, struct pidinfo *kid)
+{
+	KASSERT(spinlock_do_i_hold(&parent->pi_lock));
+	KASSERT(kid->pi_exited);
+
+	kid->pi_next = NULL;
+	kid->pi_prevp = parent->pi_zombtail;
+	*parent->pi_zombtail = kid;
+	parent->pi_zombtail = &kid->pi_next;
+}
+
+/*
+ * Drop a reference to PI. Returns true if it was the last one, in
+ * which case the caller must pi_drop it once it has let go of any
+ * locks.
+ */
+static
+bool
+pi_decref(struct pidinfo *pi)
+{
+	bool last;
+
+	spinlock_acquire(&pi->pi_lock);
+	KASSERT(pi->pi_refs > 0);
+	pi->pi_refs--;
+	last = (pi->pi_refs == 0);
+	spinlock_release(&pi->pi_lock);
+	return last;
+}
+
+/*
+ * Forget about a child that has exited: take it off our list and
+ * drop the references between us. Returns true if the child must now
+ * be pi_drop'd. Call with the parent's pi_lock held.
+ */
+static
+bool
+pi_release(struct pidinfo *parent, struct pidinfo *kid)
+{
+	KASSERT(kid->pi_exited);
+
+	pi_unlink(parent, kid);
+	/* Its children may keep it around; it isn't ours any more. */
+	kid->pi_disowned = true;
+	KASSERT(parent->pi_refs > 1);
+	parent->pi_refs--;
+	return pi_decref(kid);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
- * pid_bootstrap: initialize.
+ * Get the leaf for PID, or NULL if there isn't one.
  */
-void
-pid_bootstrap(void)
+static
+struct pidleaf *
+pi_leaf(pid_t pid)
 {
-	int i;
+	KASSERT(pid >= 0 && pid <= PID_MAX);
+	return pidleaves[pid >> PID_LEAFBITS];
+}
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
+/*
+ * Make sure there's a leaf for PID.
+ */
+static
+int
+pi_makeleaf(pid_t pid)
+{
+	struct pidleaf *leaf;
+	unsigned i;
+
+	if (pi_leaf(pid) != NULL) {
+		return 0;
 	}
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	leaf = kmalloc(sizeof(*leaf));
+	if (leaf == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&leaf->pl_lock);
+	for (i=0; i<PID_LEAFSIZE; i++) {
+		leaf->pl_info[i] = NULL;
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
-		panic("Out of memory creating kernel pid data\n");
+	spinlock_acquire(&pidmaplock);
+	if (pidleaves[pid >> PID_LEAFBITS] == NULL) {
+		/* Lookups don't lock; make sure they see it set up. */
+		membar_store_store();
+		pidleaves[pid >> PID_LEAFBITS] = leaf;
+		leaf = NULL;
 	}
+	spinlock_release(&pidmaplock);
 
-	nextpid = PID_MIN;
-	nprocs = 1;
+	if (leaf != NULL) {
+		/* Someone else got there first. */
+		spinlock_cleanup(&leaf->pl_lock);
+		kfree(leaf);
+	}
+	return 0;
 }
 
 /*
- * pi_get: look up a pidinfo in the process table.
+ * pi_self: get the current process's pidinfo. It can't go away while
+ * we're running, as our parent's reference to it lasts until we exit.
  */
 static
 struct pidinfo *
-pi_get(pid_t pid)
+pi_self(void)
 {
+	struct pidleaf *leaf;
 	struct pidinfo *pi;
+	pid_t pid;
+
+	pid = curproc->p_pid;
+	KASSERT(pid != INVALID_PID);
 
+	leaf = pi_leaf(pid);
+	KASSERT(leaf != NULL);
+	spinlock_acquire(&leaf->pl_lock);
+	pi = leaf->pl_info[pid % PID_LEAFSIZE];
+	spinlock_release(&leaf->pl_lock);
+	KASSERT(pi != NULL);
+	return pi;
+}
+
+/*
+ * pi_getkid: look up a child of US in the process table. Call with
+ * us->pi_lock held; the child stays put as long as that is. Returns
+ * NULL if there's no such process, or sets *NOTOURS and returns NULL
+ * if it isn't our child. A process that has exited and been disowned
+ * or waited for is only still there for its children's sake, and
+ * doesn't count.
+ */
+static
+struct pidinfo *
+pi_getkid(struct pidinfo *us, pid_t pid, bool *notours)
+{
+	struct pidleaf *leaf;
+	struct pidinfo *pi;
+
+	KASSERT(spinlock_do_i_hold(&us->pi_lock));
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
+	*notours = false;
+	if (pid > PID_MAX) {
 		return NULL;
 	}
-	if (pi->pi_pid != pid) {
+	leaf = pi_leaf(pid);
+	if (leaf == NULL) {
 		return NULL;
 	}
+
+	spinlock_acquire(&leaf->pl_lock);
+	pi = leaf->pl_info[pid % PID_LEAFSIZE];
+	if (pi != NULL && pi->pi_exited && pi->pi_disowned) {
+		pi = NULL;
+	}
+	else if (pi != NULL && (pi->pi_parent != us || pi->pi_disowned)) {
+		*notours = true;
+		pi = NULL;
+	}
+	spinlock_release(&leaf->pl_lock);
 	return pi;
 }
 
 /*
  * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * must be empty, and its leaf must exist.
  */
 static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidleaf *leaf;
 
 	KASSERT(pid != INVALID_PID);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	leaf = pi_leaf(pid);
+	KASSERT(leaf != NULL);
+
+	spinlock_acquire(&leaf->pl_lock);
+	KASSERT(leaf->pl_info[pid % PID_LEAFSIZE] == NULL);
+	leaf->pl_info[pid % PID_LEAFSIZE] = pi;
+	spinlock_release(&leaf->pl_lock);
 }
 
 /*
- * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * Mark a pid free in the bitmap.
  */
 static
 void
-pi_drop(pid_t pid)
+pidmap_free(pid_t pid)
 {
-	struct pidinfo *pi;
+	spinlock_acquire(&pidmaplock);
+	KASSERT((pidmap[pid / 32] & ((uint32_t)1 << (pid % 32))) != 0);
+	pidmap[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+	nfreepids++;
+	spinlock_release(&pidmaplock);
+}
 
-	KASSERT(lock_do_i_hold(pidlock));
+/*
+ * pi_drop: remove a pidinfo structure from the process table and free
+ * it, once its last reference is gone. The caller must not hold any
+ * pi_lock.
+ */
+static
+void
+pi_drop(struct pidinfo *pi)
+{
+	struct pidleaf *leaf;
+	pid_t pid = pi->pi_pid;
 
-	pi = pidinfo[pid % PROCS_MAX];
-	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+	leaf = pi_leaf(pid);
+	spinlock_acquire(&leaf->pl_lock);
+	KASSERT(leaf->pl_info[pid % PID_LEAFSIZE] == pi);
+	leaf->pl_info[pid % PID_LEAFSIZE] = NULL;
+	spinlock_release(&leaf->pl_lock);
 
 	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	pidmap_free(pid);
 }
 
 ////////////////////////////////////////////////////////////
 
 /*
- * Helper function for pid_alloc.
+ * pid_bootstrap: initialize.
  */
-static
 void
-inc_nextpid(void)
+pid_bootstrap(void)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidinfo *pi;
+	pid_t pid;
 
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
+	/* not really necessary - should start zeroed */
+	for (pid=0; pid<PID_NLEAVES; pid++) {
+		pidleaves[pid] = NULL;
 	}
+
+	/* Pids below PID_MIN (and above PID_MAX) are never handed out. */
+	bzero(pidmap, sizeof(pidmap));
+	for (pid=0; pid<PID_MIN; pid++) {
+		pidmap[pid / 32] |= (uint32_t)1 << (pid % 32);
+	}
+	for (pid=PID_MAX+1; pid<PID_MAPWORDS*32; pid++) {
+		pidmap[pid / 32] |= (uint32_t)1 << (pid % 32);
+	}
+	nfreepids = PID_MAX - PID_MIN + 1;
+
+	pi = pidinfo_create(KERNEL_PID, NULL);
+	if (pi == NULL || pi_makeleaf(KERNEL_PID)) {
+		panic("Out of memory creating kernel pid data\n");
+	}
+	pi_put(KERNEL_PID, pi);
+
+	nextpid = PID_MIN;
 }
 
 /*
- * pid_alloc: allocate a process id.
+ * Helper function for pid_alloc: take the first free pid at or after
+ * nextpid (wrapping around), skipping whole words of the bitmap at a
+ * time where they're full.
  */
-int
-pid_alloc(pid_t *retval)
+static
+pid_t
+pidmap_alloc(void)
 {
-	struct pidinfo *pi;
 	pid_t pid;
-	int count;
-
-	KASSERT(curproc->p_pid != INVALID_PID);
+	unsigned word;
+	uint32_t bit;
 
-	/* lock the table */
-	lock_acquire(pidlock);
+	KASSERT(spinlock_do_i_hold(&pidmaplock));
+	KASSERT(nfreepids > 0);
 
-	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
-		return EAGAIN;
+	pid = nextpid;
+	while (1) {
+		word = pid / 32;
+		if (pidmap[word] == 0xffffffff) {
+			pid = (word + 1) * 32;
+		}
+		else {
+			bit = (uint32_t)1 << (pid % 32);
+			if ((pidmap[word] & bit) == 0) {
+				pidmap[word] |= bit;
+				break;
+			}
+			pid++;
+		}
+		if (pid > PID_MAX) {
+			pid = PID_MIN;
+		}
 	}
 
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
-
-		inc_nextpid();
+	nfreepids--;
+	nextpid = pid + 1;
+	if (nextpid > PID_MAX) {
+		nextpid = PID_MIN;
 	}
+	return pid;
+}
 
-	pid = nextpid;
+/*
+ * pid_alloc: allocate a process id for a new child of the current
+ * process.
+ */
+int
+pid_alloc(pid_t *retval)
+{
+	struct pidinfo *us, *pi;
+	pid_t pid;
+	int result;
 
-	pi = pidinfo_create(pid, curproc->p_pid);
+	us = pi_self();
+
+	pi = pidinfo_create(INVALID_PID, us);
 	if (pi==NULL) {
-		lock_release(pidlock);
 		return ENOMEM;
 	}
 
-	pi_put(pid, pi);
+	spinlock_acquire(&pidmaplock);
+	if (nfreepids == 0) {
+		spinlock_release(&pidmaplock);
+		pi->pi_refs = 0;
+		pidinfo_destroy(pi);
+		return EAGAIN;
+	}
+	pid = pidmap_alloc();
+	spinlock_release(&pidmaplock);
+
+	result = pi_makeleaf(pid);
+	if (result) {
+		pidmap_free(pid);
+		pi->pi_refs = 0;
+		pidinfo_destroy(pi);
+		return result;
+	}
 
-	inc_nextpid();
+	pi->pi_pid = pid;
+	pi_put(pid, pi);
 
-	lock_release(pidlock);
+	spinlock_acquire(&us->pi_lock);
+	pi_addkid(us, pi);
+	us->pi_refs++;
+	spinlock_release(&us->pi_lock);
 
 	*retval = pid;
 	return 0;
@@ -286,25 +561,24 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	bool notours;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
+	us = pi_self();
+	spinlock_acquire(&us->pi_lock);
+	them = pi_getkid(us, theirpid, &notours);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_exited == false);
-	KASSERT(them->pi_ppid == curproc->p_pid);
-
-	/* keep pidinfo_destroy from complaining */
-	them->pi_exitstatus = 0xdead;
-	them->pi_exited = true;
-	them->pi_ppid = INVALID_PID;
 
-	pi_drop(theirpid);
+	pi_unlink(us, them);
+	us->pi_refs--;
+	spinlock_release(&us->pi_lock);
 
-	lock_release(pidlock);
+	KASSERT(them->pi_kids == NULL);
+	them->pi_refs = 0;
+	pi_drop(them);
 }
 
 /*
@@ -314,28 +588,45 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	bool notours, drop;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
+	us = pi_self();
+	spinlock_acquire(&us->pi_lock);
+	them = pi_getkid(us, theirpid, &notours);
 	KASSERT(them != NULL);
-	KASSERT(them->pi_ppid==curproc->p_pid);
 
-	them->pi_ppid = INVALID_PID;
+	drop = false;
 	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
+		drop = pi_release(us, them);
+	}
+	else {
+		/*
+		 * It'll reap itself when it exits. Take it off our
+		 * list so waiting for any child doesn't count it; its
+		 * reference to us stays until then.
+		 */
+		pi_unlink(us, them);
+		them->pi_disowned = true;
 	}
+	spinlock_release(&us->pi_lock);
 
-	lock_release(pidlock);
+	if (drop) {
+		pi_drop(them);
+	}
 }
 
 /*
  * pid_setexitstatus: Sets the exit status of this process. Must only
- * be called if the thread actually had a pid assigned. Wakes up any
- * waiters and disposes of the piddata if nobody else is still using it.
+ * be called if the thread actually had a pid assigned. Wakes up our
+ * parent if it might wait for us, and disposes of the pidinfo if
+ * nobody else is still using it.
+ *
+ * The work done here is proportional to the number of our children
+ * that have exited and not been waited for; the ones still running
+ * find out when they exit.
  *
  * As far as the process is concerned, this releases its pid for
  * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
@@ -343,42 +634,70 @@ pid_disown(pid_t theirpid)
 void
 pid_setexitstatus(int status)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidinfo *us, *parent, *kid, *dead;
+	bool dropus, dropparent;
 
-	lock_acquire(pidlock);
-	KASSERT(curproc->p_pid != INVALID_PID);
+	us = pi_self();
+	parent = us->pi_parent;
+	KASSERT(parent != NULL);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
+	/*
+	 * First, reap all our zombies, and make sure no more turn up.
+	 * The ones whose last reference goes away go on a list of
+	 * their own (they're off ours, so pi_next is free) to be
+	 * dropped once we let go.
+	 */
+	dead = NULL;
+	spinlock_acquire(&us->pi_lock);
+	us->pi_nowait = true;
+	while (us->pi_zombies != NULL) {
+		kid = us->pi_zombies;
+		if (pi_release(us, kid)) {
+			kid->pi_next = dead;
+			dead = kid;
 		}
 	}
+	spinlock_release(&us->pi_lock);
 
-	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
+	while (dead != NULL) {
+		kid = dead;
+		dead = kid->pi_next;
+		pi_drop(kid);
+	}
 
+	/* Now, tell our parent */
+	dropus = dropparent = false;
+	spinlock_acquire(&parent->pi_lock);
+	if (!us->pi_disowned) {
+		pi_unlink(parent, us);
+	}
 	us->pi_exitstatus = status;
 	us->pi_exited = true;
-
-	if (us->pi_ppid == INVALID_PID) {
-		/* no parent */
-		pi_drop(curproc->p_pid);
+	if (parent->pi_nowait || us->pi_disowned) {
+		/*
+		 * Nobody will wait; reap ourselves. If the parent has
+		 * exited and been waited for, we may be all that's
+		 * keeping it.
+		 */
+		KASSERT(parent->pi_refs > 0);
+		parent->pi_refs--;
+		dropparent = (parent->pi_refs == 0);
+		dropus = pi_decref(us);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		pi_addzombie(parent, us);
+		wchan_wakeall(parent->pi_wchan, &parent->pi_lock);
+	}
+	spinlock_release(&parent->pi_lock);
+
+	if (dropus) {
+		pi_drop(us);
+	}
+	if (dropparent) {
+		pi_drop(parent);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
 }
 
 /*
@@ -386,27 +705,31 @@ pid_setexitstatus(int status)
  * status and ret are a kernel pointers, but pid/flags may come from
  * userland and may thus be maliciously invalid.
  *
+ * A pid of -1 means any child; the first one to have exited is
+ * collected, and its pid returned in ret.
+ *
  * status may be null, in which case the status is thrown away. ret
- * may only be null if WNOHANG is not set.
+ * may only be null if WNOHANG is not set and pid isn't -1.
  */
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidinfo *us, *them;
+	bool notours, drop;
 
-	KASSERT(curproc->p_pid != INVALID_PID);
+	us = pi_self();
 
 	/* Don't let a process wait for itself. */
-	if (theirpid == curproc->p_pid) {
+	if (theirpid == us->pi_pid) {
 		return EINVAL;
 	}
 
 	/*
-	 * We don't support the Unix meanings of negative pids or 0
-	 * (0 is INVALID_PID) and other code may break on them, so
-	 * check now.
+	 * We don't support the Unix meanings of process groups (0,
+	 * which is INVALID_PID, and other negative pids) and other
+	 * code may break on them, so check now.
 	 */
-	if (theirpid == INVALID_PID || theirpid<0) {
+	if (theirpid == INVALID_PID || theirpid < -1) {
 		return ENOSYS;
 	}
 
@@ -415,51 +738,57 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
-	if (them==NULL) {
-		lock_release(pidlock);
-		return ESRCH;
-	}
-
-	KASSERT(them->pi_pid==theirpid);
-
-	/* Only allow waiting for own children. */
-	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
-	}
-
-	if (them->pi_exited == false) {
+	spinlock_acquire(&us->pi_lock);
+	while (1) {
+		if (theirpid == -1) {
+			them = us->pi_zombies;
+			if (them == NULL && us->pi_kids == NULL) {
+				spinlock_release(&us->pi_lock);
+				return ECHILD;
+			}
+		}
+		else {
+			/*
+			 * Look it up again each time around; another
+			 * of our threads may have collected it while
+			 * we slept.
+			 */
+			them = pi_getkid(us, theirpid, &notours);
+			if (them == NULL) {
+				spinlock_release(&us->pi_lock);
+				return notours ? EPERM : ESRCH;
+			}
+			if (!them->pi_exited) {
+				them = NULL;
+			}
+		}
+		if (them != NULL) {
+			break;
+		}
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			spinlock_release(&us->pi_lock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+		/* Any child exiting wakes us up. */
+		wchan_sleep(us->pi_wchan, &us->pi_lock);
 	}
 
+	KASSERT(them->pi_exited);
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
 	}
 	if (ret != NULL) {
-		/*
-		 * In Unix you can wait for any of several possible
-		 * processes by passing particular magic values of
-		 * pid. wait then returns the pid you actually
-		 * found. We don't support this, so always return the
-		 * pid we looked for.
-		 */
-		*ret = theirpid;
+		*ret = them->pi_pid;
 	}
+	KASSERT(them->pi_pid == theirpid || theirpid == -1);
 
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	drop = pi_release(us, them);
+	spinlock_release(&us->pi_lock);
 
-	lock_release(pidlock);
+	if (drop) {
+		pi_drop(them);
+	}
 	return 0;
 }
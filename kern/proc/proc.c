@@ -44,6 +44,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <spl.h>
 #include <synch.h>
 #include <proc.h>
@@ -52,6 +53,8 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <syscall.h>
+#include <vdso.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -87,15 +90,40 @@ proc_create(const char *name)
 
 	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
+	proc->p_ppid = INVALID_PID;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
+	proc->p_vforksem = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_uring = NULL;
+
+	/* User-level threads */
+	proc->p_utlock = lock_create("p_uthreads");
+	if (proc->p_utlock == NULL) {
+		goto fail;
+	}
+	proc->p_utcv = cv_create("p_uthreads");
+	if (proc->p_utcv == NULL) {
+		lock_destroy(proc->p_utlock);
+		goto fail;
+	}
+	proc->p_uthreads = NULL;
+	proc->p_nexttid = 1;
+	proc->p_exitstatus = _MKWAIT_EXIT(0);
 
 	return proc;
+
+fail:
+	spinlock_cleanup(&proc->p_lock);
+	threadarray_cleanup(&proc->p_threads);
+	lock_destroy(proc->p_threadslock);
+	kfree(proc->p_name);
+	kfree(proc);
+	return NULL;
 }
 
 /*
@@ -135,6 +163,18 @@ proc_destroy(struct proc *proc)
 	}
 
 	/* VM fields */
+	if (proc->p_vforksem != NULL) {
+		/* Borrowed from a parent in vfork: not ours to destroy. */
+		if (proc == curproc) {
+			proc_setas(NULL);
+			as_deactivate();
+		}
+		else {
+			proc->p_addrspace = NULL;
+		}
+		proc_vforkdone(proc);
+	}
+	KASSERT(proc->p_addrspace != NULL || proc->p_uring == NULL);
 	if (proc->p_addrspace) {
 		/*
 		 * If p is the current process, remove it safely from
@@ -179,8 +219,26 @@ proc_destroy(struct proc *proc)
 			as = proc->p_addrspace;
 			proc->p_addrspace = NULL;
 		}
-		as_destroy(as);
+
+		/*
+		 * If async I/O is still going on in the address
+		 * space, the rings take it and destroy it when that's
+		 * done; we don't wait, as it might never be. The file
+		 * table is gone by now, so any that's waiting on our
+		 * own pipes will see EOF or EPIPE and finish.
+		 */
+		if (!uring_release(proc, as)) {
+			as_destroy(as);
+		}
+	}
+
+	/* User-level threads */
+	if (proc->p_uthreads) {
+		kfree(proc->p_uthreads);
+		proc->p_uthreads = NULL;
 	}
+	cv_destroy(proc->p_utcv);
+	lock_destroy(proc->p_utlock);
 
 	KASSERT(proc->p_pid == INVALID_PID);
 	spinlock_cleanup(&proc->p_lock);
@@ -229,6 +287,7 @@ proc_create_runprogram(const char *name, struct proc **ret)
 		proc_destroy(newproc);
 		return result;
 	}
+	newproc->p_ppid = curproc->p_pid;
 
 	/* VM fields */
 
@@ -259,18 +318,20 @@ proc_create_runprogram(const char *name, struct proc **ret)
  * is not null. (If RET is null, what we're creating is a kernel-only
  * thread and it doesn't need an address space or file handles.)
  * However, the new thread always inherits its current working
- * directory from the caller. The new thread is given no address space
- * (the caller decides that).
+ * directory from the caller. The new thread is given a copy of the
+ * caller's address space if COPYAS is set, and otherwise none (the
+ * caller decides what to do about that). It is called NAME.
  */
+static
 int
-proc_fork(struct proc **ret)
+proc_clone(const char *name, bool copyas, struct proc **ret)
 {
 	struct proc *newproc;
 	struct addrspace *as;
 	struct filetable *tbl;
 	int result;
 
-	newproc = proc_create(curproc->p_name);
+	newproc = proc_create(name);
 	if (newproc == NULL) {
 		return ENOMEM;
 	}
@@ -280,6 +341,7 @@ proc_fork(struct proc **ret)
 		proc_destroy(newproc);
 		return result;
 	}
+	newproc->p_ppid = curproc->p_pid;
 
 #if 0 /* not yet */
 	/*
@@ -293,7 +355,7 @@ proc_fork(struct proc **ret)
 
 	/* VM fields */
 	as = proc_getas();
-	if (as != NULL) {
+	if (as != NULL && copyas) {
 		result = as_copy(as, &newproc->p_addrspace);
 		if (result) {
 			pid_unalloc(newproc->p_pid);
@@ -301,6 +363,8 @@ proc_fork(struct proc **ret)
 			proc_destroy(newproc);
 			return result;
 		}
+		/* the copy of the vdso page still has our ids */
+		vdso_setproc(newproc->p_addrspace, newproc);
 	}
 
 	/* VFS fields */
@@ -333,6 +397,45 @@ proc_fork(struct proc **ret)
 	return 0;
 }
 
+/*
+ * Clone the current process, including its address space; for fork.
+ */
+int
+proc_fork(struct proc **ret)
+{
+	return proc_clone(curproc->p_name, true, ret);
+}
+
+/*
+ * Clone the current process without its address space; for vfork,
+ * which lends the child the parent's, and for spawn, which loads a
+ * new one. Either way there's no point copying it. Spawn names the
+ * new process after its program; vfork passes the parent's name.
+ */
+int
+proc_fork_noas(const char *name, struct proc **ret)
+{
+	return proc_clone(name, false, ret);
+}
+
+/*
+ * A vfork child is done with its parent's address space, either
+ * because it has loaded its own or because it's exiting; wake up the
+ * parent. The caller must already have let go of the address space
+ * (without destroying it).
+ */
+void
+proc_vforkdone(struct proc *proc)
+{
+	struct semaphore *sem;
+
+	KASSERT(proc->p_vforksem != NULL);
+
+	sem = proc->p_vforksem;
+	proc->p_vforksem = NULL;
+	V(sem);
+}
+
 /*
  * Undo proc_fork if nothing's run in the new process yet.
  */
@@ -372,6 +475,66 @@ proc_exit(int status)
 	thread_exit();
 }
 
+/*
+ * Make the current thread of a user process exit.
+ *
+ * Deciding whether we're the last thread and leaving the process
+ * both happen under p_utlock, which thread creation also holds, so
+ * that exactly one thread sees itself as last and runs proc_exit.
+ */
+void
+proc_thread_exit(userptr_t result)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	unsigned i, num;
+	int status;
+
+	KASSERT(proc != kproc);
+
+	lock_acquire(proc->p_utlock);
+
+	lock_acquire(proc->p_threadslock);
+	num = threadarray_num(&proc->p_threads);
+	lock_release(proc->p_threadslock);
+
+	if (num == 1) {
+		/* Nobody else can change this now. */
+		status = proc->p_exitstatus;
+		lock_release(proc->p_utlock);
+		proc_exit(status);
+		thread_exit();
+	}
+
+	/* With more than one thread there must be a thread table. */
+	KASSERT(proc->p_uthreads != NULL);
+	ut = NULL;
+	for (i=0; i<PROC_UTHREADS_MAX; i++) {
+		if (proc->p_uthreads[i].ut_thread == curthread) {
+			ut = &proc->p_uthreads[i];
+			break;
+		}
+	}
+	KASSERT(ut != NULL);
+
+	ut->ut_thread = NULL;
+	ut->ut_exited = true;
+	if (ut->ut_detached) {
+		ut->ut_tid = 0;
+	}
+	else {
+		ut->ut_result = result;
+		cv_broadcast(proc->p_utcv, proc->p_utlock);
+	}
+
+	/* Leave before unlocking, so the count is right for the next one. */
+	proc_remthread(curthread);
+	lock_release(proc->p_utlock);
+
+	proc_addthread(kproc, curthread);
+	thread_exit();
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -34,18 +34,22 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/iovec.h>
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
 #include <lib.h>
+#include <stat.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
 #include <copyinout.h>
+#include <vm.h>
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
+#include <pipe.h>
 #include <filetable.h>
 #include <syscall.h>
 
@@ -105,19 +109,19 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for read, write, readv, and writev.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the user buffers
+ * in IOV, which add up to SIZE bytes.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_doio(int fd, struct iovec *iov, unsigned iovcnt, size_t size,
+	 enum uio_rw rw, int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
 	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
 	int result;
 
@@ -142,8 +146,8 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set up a uio with the buffers, their size, and the current offset */
+	uio_uinitv(iov, iovcnt, &useruio, size, pos, rw);
 
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
@@ -177,6 +181,21 @@ fail:
 	return result;
 }
 
+/*
+ * read() and write() use a single buffer.
+ */
+static
+int
+sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+	      int badaccmode, ssize_t *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_doio(fd, &iov, 1, size, rw, badaccmode, retval);
+}
+
 /*
  * read() - use sys_readwrite
  */
@@ -195,6 +214,148 @@ sys_write(int fd, userptr_t buf, size_t size, int *retval)
 	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
 }
 
+/*
+ * Common logic for readv and writev.
+ *
+ * Copy in the iovec array (onto the stack, if it's small) and do the
+ * whole thing as one uio, so the file system sees a single transfer.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	struct iovec smalliov[UIO_SMALLIOV];
+	struct iovec *iov;
+	size_t size;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= UIO_SMALLIOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto out;
+	}
+
+	/* The total has to fit in the (signed) return value. */
+	size = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > (size_t)-1 / 2 - size) {
+			result = EINVAL;
+			goto out;
+		}
+		size += iov[i].iov_len;
+	}
+
+	result = sys_doio(fd, iov, iovcnt, size, rw, badaccmode, retval);
+
+out:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Common logic for pread and pwrite.
+ *
+ * Like sys_readwrite, but the offset comes from the caller and the
+ * seek position is neither used nor changed, so there's no need to
+ * take of_offsetlock. Several threads (or processes) sharing one
+ * openfile can thus do I/O on it at the same time.
+ */
+static
+int
+sys_preadwrite(int fd, userptr_t buf, size_t size, off_t pos,
+	       enum uio_rw rw, int badaccmode, ssize_t *retval)
+{
+	struct openfile *file;
+	struct iovec iov;
+	struct uio useruio;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	if (file->of_accmode == badaccmode) {
+		result = EBADF;
+		goto out;
+	}
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		result = ESPIPE;
+		goto out;
+	}
+	if (pos < 0) {
+		result = EINVAL;
+		goto out;
+	}
+
+	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+
+	result = (rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, &useruio) :
+		VOP_WRITE(file->of_vnode, &useruio);
+	if (result) {
+		goto out;
+	}
+
+	*retval = size - useruio.uio_resid;
+
+out:
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
+/*
+ * pread() - use sys_preadwrite
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_preadwrite(fd, buf, size, pos, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_preadwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_preadwrite(fd, buf, size, pos, UIO_WRITE, O_RDONLY, retval);
+}
+
 /*
  * close() - remove from the file table.
  */
@@ -203,6 +364,7 @@ sys_close(int fd)
 {
 	struct filetable *ft;
 	struct openfile *file;
+	int result;
 
 	ft = curproc->p_filetable;
 
@@ -212,7 +374,10 @@ sys_close(int fd)
 	}
 
 	/* place null in the filetable and get the file previously there */
-	filetable_placeat(ft, NULL, fd, &file);
+	result = filetable_placeat(ft, NULL, fd, &file);
+	if (result) {
+		return result;
+	}
 
 	if (file == NULL) {
 		/* oops, it wasn't open, that's an error */
@@ -321,7 +486,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
@@ -333,6 +502,414 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * One side of a copy_file_range: the file, and where we are in it.
+ * The position is either the caller's (OFFP) or the openfile's; in
+ * the latter case we hold of_offsetlock while working.
+ */
+struct copyend {
+	int fd;
+	struct openfile *file;
+	userptr_t offp;
+	off_t pos;
+	bool locked;
+};
+
+/*
+ * Get one side of a copy_file_range ready, short of locking.
+ */
+static
+int
+copyend_get(struct copyend *ce, int fd, userptr_t offp, int badaccmode)
+{
+	int result;
+
+	ce->fd = fd;
+	ce->offp = offp;
+	ce->locked = false;
+
+	result = filetable_get(curproc->p_filetable, fd, &ce->file);
+	if (result) {
+		return result;
+	}
+	if (ce->file->of_accmode == badaccmode) {
+		result = EBADF;
+		goto fail;
+	}
+	if (offp != NULL) {
+		if (!VOP_ISSEEKABLE(ce->file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+		result = copyin(offp, &ce->pos, sizeof(ce->pos));
+		if (result) {
+			goto fail;
+		}
+		if (ce->pos < 0) {
+			result = EINVAL;
+			goto fail;
+		}
+	}
+	else {
+		ce->pos = 0;
+	}
+	return 0;
+
+fail:
+	filetable_put(curproc->p_filetable, fd, ce->file);
+	return result;
+}
+
+/*
+ * Check if a side of a copy_file_range uses the openfile's position.
+ */
+static
+bool
+copyend_shared(struct copyend *ce)
+{
+	return ce->offp == NULL && VOP_ISSEEKABLE(ce->file->of_vnode);
+}
+
+static
+void
+copyend_lock(struct copyend *ce)
+{
+	lock_acquire(ce->file->of_offsetlock);
+	ce->pos = ce->file->of_offset;
+	ce->locked = true;
+}
+
+/*
+ * Put a side of a copy_file_range back, storing the position where
+ * it came from.
+ */
+static
+int
+copyend_put(struct copyend *ce)
+{
+	int result = 0;
+
+	if (ce->locked) {
+		ce->file->of_offset = ce->pos;
+		lock_release(ce->file->of_offsetlock);
+	}
+	else if (ce->offp != NULL) {
+		result = copyout(&ce->pos, ce->offp, sizeof(ce->pos));
+	}
+	filetable_put(curproc->p_filetable, ce->fd, ce->file);
+	return result;
+}
+
+/*
+ * Check if a block is all zeros.
+ */
+static
+bool
+copy_iszero(const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (buf[i] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Write LEN bytes from BUF to OUT at position POS. *WROTE says how
+ * many were written, which can be fewer even without an error.
+ */
+static
+int
+copy_write(struct copyend *out, char *buf, size_t len, off_t pos,
+	   size_t *wrote)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	*wrote = 0;
+	if (len == 0) {
+		return 0;
+	}
+	uio_kinit(&iov, &ku, buf, len, pos, UIO_WRITE);
+	result = VOP_WRITE(out->file->of_vnode, &ku);
+	*wrote = len - ku.uio_resid;
+	return result;
+}
+
+/*
+ * Write LEN bytes from BUF to OUT at OUT->pos, and move OUT->pos past
+ * them, or only past what got written if a write comes up short or
+ * fails. If HOLESIZE isn't 0, whole blocks of zeros at or past
+ * HOLESTART (the end of the file's existing data) are skipped instead
+ * of written, so they stay holes in file systems (like SFS) that
+ * leave unwritten blocks unallocated and read them back as zeros.
+ * *SKIPPED says if what's been written so far ends in one.
+ */
+static
+int
+copy_writeout(struct copyend *out, char *buf, size_t len,
+	      size_t holesize, off_t holestart, bool *skipped)
+{
+	size_t off, runstart, n, wrote;
+	off_t pos;
+	int result;
+
+	/* Data from runstart to off hasn't been written yet. */
+	runstart = 0;
+	for (off = 0; off < len; off += n) {
+		pos = out->pos + off;
+		n = len - off;
+		if (holesize > 0 && n > holesize - pos % holesize) {
+			n = holesize - pos % holesize;
+		}
+		if (holesize > 0 && n == holesize && pos >= holestart &&
+		    copy_iszero(buf + off, n)) {
+			result = copy_write(out, buf + runstart,
+					    off - runstart,
+					    out->pos + runstart, &wrote);
+			if (result || wrote < off - runstart) {
+				goto done;
+			}
+			runstart = off + n;
+			*skipped = true;
+		}
+	}
+	result = copy_write(out, buf + runstart, len - runstart,
+			    out->pos + runstart, &wrote);
+ done:
+	if (wrote > 0) {
+		*skipped = false;
+	}
+	out->pos += runstart + wrote;
+	return result;
+}
+
+/*
+ * copy_file_range() - copy up to LEN bytes from one file to another
+ * inside the kernel, without a trip through user memory. Each file's
+ * position is taken from *INOFFP or *OUTOFFP and updated there, or,
+ * if that's NULL, from and to the file's seek position.
+ *
+ * Data goes through a page-sized kernel buffer, lined up with the
+ * destination's blocks, and blocks of zeros copied past the end of
+ * the destination become holes (see copy_writeout).
+ *
+ * Stops early at end of file, after a short read from something like
+ * a pipe or the console, or after a short or failed write, and returns
+ * the number of bytes copied; an error is only reported if nothing
+ * was. (Anything read from a pipe but not written is lost.) Copying
+ * between overlapping ranges of the same file is EINVAL.
+ */
+int
+sys_copy_file_range(int infd, userptr_t inoffp, int outfd, userptr_t outoffp,
+		    size_t len, unsigned flags, int *retval)
+{
+	struct copyend in, out;
+	struct stat st;
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	size_t done, chunk, got, holesize;
+	off_t holestart, start;
+	bool skipped;
+	mode_t type;
+	int result, result2;
+
+	if (flags != 0) {
+		return EINVAL;
+	}
+	/* What's copied has to fit in the (signed) return value. */
+	if (len > (size_t)-1 / 2) {
+		len = (size_t)-1 / 2;
+	}
+
+	buf = kmalloc(PAGE_SIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	result = copyend_get(&in, infd, inoffp, O_WRONLY);
+	if (result) {
+		kfree(buf);
+		return result;
+	}
+	result = copyend_get(&out, outfd, outoffp, O_RDONLY);
+	if (result) {
+		copyend_put(&in);
+		kfree(buf);
+		return result;
+	}
+
+	/*
+	 * Lock the seek positions we're using, in a fixed order so two
+	 * copies going opposite ways can't deadlock. Using the same
+	 * seek position for both sides makes no sense.
+	 */
+	if (copyend_shared(&in) && copyend_shared(&out)) {
+		if (in.file == out.file) {
+			result = EINVAL;
+			goto out;
+		}
+		if ((vaddr_t)in.file < (vaddr_t)out.file) {
+			copyend_lock(&in);
+			copyend_lock(&out);
+		}
+		else {
+			copyend_lock(&out);
+			copyend_lock(&in);
+		}
+	}
+	else if (copyend_shared(&in)) {
+		copyend_lock(&in);
+	}
+	else if (copyend_shared(&out)) {
+		copyend_lock(&out);
+	}
+
+	/*
+	 * Within one file, the ranges can't overlap: the copy goes
+	 * front to back a page at a time, so it would read back what
+	 * it had already written. (Linux says EINVAL too.)
+	 */
+	if (in.file->of_vnode == out.file->of_vnode &&
+	    VOP_ISSEEKABLE(in.file->of_vnode) &&
+	    in.pos < out.pos + (off_t)len && out.pos < in.pos + (off_t)len) {
+		result = EINVAL;
+		goto out;
+	}
+
+	/* Can we leave holes in the destination? */
+	holesize = 0;
+	holestart = 0;
+	if (VOP_ISSEEKABLE(out.file->of_vnode) &&
+	    VOP_GETTYPE(out.file->of_vnode, &type) == 0 && type == S_IFREG &&
+	    VOP_STAT(out.file->of_vnode, &st) == 0 &&
+	    st.st_blksize > 0 && PAGE_SIZE % st.st_blksize == 0) {
+		holesize = st.st_blksize;
+		holestart = st.st_size;
+	}
+
+	skipped = false;
+	done = 0;
+	while (done < len) {
+		/* line the chunks up with the destination's pages */
+		chunk = PAGE_SIZE - out.pos % PAGE_SIZE;
+		if (chunk > len - done) {
+			chunk = len - done;
+		}
+
+		uio_kinit(&iov, &ku, buf, chunk, in.pos, UIO_READ);
+		result = VOP_READ(in.file->of_vnode, &ku);
+		if (result) {
+			break;
+		}
+		got = chunk - ku.uio_resid;
+		if (got == 0) {
+			break;
+		}
+
+		start = out.pos;
+		result = copy_writeout(&out, buf, got, holesize, holestart,
+				       &skipped);
+		in.pos += out.pos - start;
+		done += out.pos - start;
+		if (result || out.pos - start < (off_t)got || got < chunk) {
+			break;
+		}
+	}
+
+	if (skipped) {
+		/* the file ends in a hole; make the size cover it */
+		result2 = VOP_TRUNCATE(out.file->of_vnode, out.pos);
+		if (result2 && result == 0) {
+			result = result2;
+		}
+	}
+
+	if (done > 0) {
+		/* report what we copied */
+		result = 0;
+		*retval = done;
+	}
+	else if (result == 0) {
+		*retval = 0;
+	}
+
+out:
+	result2 = copyend_put(&out);
+	if (result2 && result == 0) {
+		result = result2;
+	}
+	result2 = copyend_put(&in);
+	if (result2 && result == 0) {
+		result = result2;
+	}
+	kfree(buf);
+	return result;
+}
+
+/*
+ * pipe() - make a pipe, and put its read and write ends in the two
+ * lowest free file handles. FLAGS (from pipe2) may be O_NONBLOCK.
+ */
+int
+sys_pipe(userptr_t fdsptr, int flags)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	int fds[2];
+	int result;
+
+	if ((flags & ~O_NONBLOCK) != 0) {
+		return EINVAL;
+	}
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create((flags & O_NONBLOCK) != 0, &readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	/* these consume the vnode references */
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		sys_close(fds[0]);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		sys_close(fds[0]);
+		sys_close(fds[1]);
+		return result;
+	}
+	return 0;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
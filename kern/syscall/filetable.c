@@ -34,9 +34,261 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <vm.h>
 #include <openfile.h>
 #include <filetable.h>
 
+/*
+ * The descriptor array proper. It may be shared by several file
+ * tables after fork, in which case it must not be changed; see
+ * filetable_writable. fa_refcount is protected by fa_reflock, and
+ * the rest by the ft_lock of the one table using it (or by nobody,
+ * while it's shared, since then it's read-only).
+ *
+ * The array holds one reference to each open file in it, however
+ * many tables share it.
+ *
+ * The slots are kept in chunks of at most a page each, since that's
+ * the most kmalloc can reliably hand out. A small table is one short
+ * chunk; past FD_CHUNK slots, whole chunks are added.
+ */
+#define FD_CHUNK	(PAGE_SIZE / sizeof(struct openfile *))
+#define FD_MAXCHUNKS	((OPEN_MAX + FD_CHUNK - 1) / FD_CHUNK)
+
+struct fdarray {
+	struct spinlock fa_reflock;	/* lock for fa_refcount */
+	unsigned fa_refcount;		/* number of tables sharing this */
+	unsigned fa_size;		/* number of slots; multiple of 32 */
+	struct openfile **fa_chunks[FD_MAXCHUNKS];	/* the slots */
+	uint32_t fa_inuse[OPEN_MAX / 32];	/* bit set for each open fd */
+	uint32_t fa_full[(OPEN_MAX / 32 + 31) / 32];	/* full fa_inuse words */
+};
+
+/* Initial size; must be a multiple of 32. */
+#define FD_MINSIZE		32
+
+#define FD_NCHUNKS(size)	(((size) + FD_CHUNK - 1) / FD_CHUNK)
+#define FD_INUSEWORDS(size)	((size) / 32)
+#define FD_FULLWORDS(size)	((FD_INUSEWORDS(size) + 31) / 32)
+#define FD_SLOT(fa, fd)		((fa)->fa_chunks[(fd) / FD_CHUNK][(fd) % FD_CHUNK])
+
+/*
+ * Index of the lowest clear bit in a word that has one.
+ */
+static
+unsigned
+fd_firstzero(uint32_t word)
+{
+	unsigned bit = 0;
+
+	KASSERT(word != 0xffffffff);
+
+	if ((word & 0xffff) == 0xffff) {
+		bit += 16;
+		word >>= 16;
+	}
+	if ((word & 0xff) == 0xff) {
+		bit += 8;
+		word >>= 8;
+	}
+	if ((word & 0xf) == 0xf) {
+		bit += 4;
+		word >>= 4;
+	}
+	if ((word & 0x3) == 0x3) {
+		bit += 2;
+		word >>= 2;
+	}
+	if ((word & 0x1) == 0x1) {
+		bit += 1;
+	}
+	return bit;
+}
+
+/*
+ * Free a descriptor array, without touching the files in it.
+ */
+static
+void
+fdarray_destroy(struct fdarray *fa)
+{
+	unsigned i;
+
+	KASSERT(fa->fa_refcount == 0);
+	for (i=0; i<FD_MAXCHUNKS; i++) {
+		kfree(fa->fa_chunks[i]);
+	}
+	spinlock_cleanup(&fa->fa_reflock);
+	kfree(fa);
+}
+
+/*
+ * Make an empty descriptor array with SIZE slots.
+ */
+static
+struct fdarray *
+fdarray_create(unsigned size)
+{
+	struct fdarray *fa;
+	unsigned i, j, num;
+
+	KASSERT(size % 32 == 0);
+	KASSERT(size <= OPEN_MAX);
+
+	fa = kmalloc(sizeof(*fa));
+	if (fa == NULL) {
+		return NULL;
+	}
+	spinlock_init(&fa->fa_reflock);
+	fa->fa_refcount = 1;
+	fa->fa_size = size;
+	for (i=0; i<FD_MAXCHUNKS; i++) {
+		fa->fa_chunks[i] = NULL;
+	}
+	for (i=0; i<FD_NCHUNKS(size); i++) {
+		num = size - i * FD_CHUNK;
+		if (num > FD_CHUNK) {
+			num = FD_CHUNK;
+		}
+		fa->fa_chunks[i] = kmalloc(num * sizeof(struct openfile *));
+		if (fa->fa_chunks[i] == NULL) {
+			fa->fa_refcount = 0;
+			fdarray_destroy(fa);
+			return NULL;
+		}
+		for (j=0; j<num; j++) {
+			fa->fa_chunks[i][j] = NULL;
+		}
+	}
+	bzero(fa->fa_inuse, sizeof(fa->fa_inuse));
+	bzero(fa->fa_full, sizeof(fa->fa_full));
+	return fa;
+}
+
+/*
+ * Copy a descriptor array into a new one with NEWSIZE slots, which
+ * must be at least as many as it has. If INCREF is set the copy gets
+ * its own references to the files; otherwise it takes over the old
+ * one's, and the old one should just be thrown away.
+ *
+ * The work is proportional to the number of open files, plus the
+ * size of the bitmap.
+ */
+static
+struct fdarray *
+fdarray_copy(struct fdarray *src, unsigned newsize, bool incref)
+{
+	struct fdarray *fa;
+	unsigned i, j, fd;
+	uint32_t word;
+
+	KASSERT(newsize >= src->fa_size);
+
+	fa = fdarray_create(newsize);
+	if (fa == NULL) {
+		return NULL;
+	}
+	for (i=0; i<FD_INUSEWORDS(src->fa_size); i++) {
+		word = src->fa_inuse[i];
+		fa->fa_inuse[i] = word;
+		for (j=0; word != 0; j++, word >>= 1) {
+			if (word & 1) {
+				fd = i*32 + j;
+				FD_SLOT(fa, fd) = FD_SLOT(src, fd);
+				if (incref) {
+					openfile_incref(FD_SLOT(fa, fd));
+				}
+			}
+		}
+	}
+	for (i=0; i<FD_FULLWORDS(src->fa_size); i++) {
+		fa->fa_full[i] = src->fa_full[i];
+	}
+	return fa;
+}
+
+/*
+ * Drop a table's use of a descriptor array. The last one out closes
+ * the files.
+ */
+static
+void
+fdarray_release(struct fdarray *fa)
+{
+	unsigned i, j;
+	uint32_t word;
+	bool last;
+
+	spinlock_acquire(&fa->fa_reflock);
+	KASSERT(fa->fa_refcount > 0);
+	fa->fa_refcount--;
+	last = (fa->fa_refcount == 0);
+	spinlock_release(&fa->fa_reflock);
+
+	if (!last) {
+		return;
+	}
+	for (i=0; i<FD_INUSEWORDS(fa->fa_size); i++) {
+		word = fa->fa_inuse[i];
+		for (j=0; word != 0; j++, word >>= 1) {
+			if (word & 1) {
+				openfile_decref(FD_SLOT(fa, i*32 + j));
+			}
+		}
+	}
+	fdarray_destroy(fa);
+}
+
+/*
+ * Find the lowest free descriptor, or fa_size if there isn't one.
+ */
+static
+unsigned
+fdarray_lowestfree(struct fdarray *fa)
+{
+	unsigned i, w;
+
+	for (i=0; i<FD_FULLWORDS(fa->fa_size); i++) {
+		if (fa->fa_full[i] != 0xffffffff) {
+			w = i*32 + fd_firstzero(fa->fa_full[i]);
+			if (w >= FD_INUSEWORDS(fa->fa_size)) {
+				/* past the end of the last partial word */
+				break;
+			}
+			return w*32 + fd_firstzero(fa->fa_inuse[w]);
+		}
+	}
+	return fa->fa_size;
+}
+
+/*
+ * Keep the bitmaps up to date when slot FD changes.
+ */
+static
+void
+fdarray_mark(struct fdarray *fa, unsigned fd, bool inuse)
+{
+	unsigned w = fd / 32;
+	uint32_t bit = (uint32_t)1 << (fd % 32);
+	uint32_t wbit = (uint32_t)1 << (w % 32);
+
+	if (inuse) {
+		KASSERT((fa->fa_inuse[w] & bit) == 0);
+		fa->fa_inuse[w] |= bit;
+		if (fa->fa_inuse[w] == 0xffffffff) {
+			fa->fa_full[w / 32] |= wbit;
+		}
+	}
+	else {
+		KASSERT((fa->fa_inuse[w] & bit) != 0);
+		fa->fa_inuse[w] &= ~bit;
+		fa->fa_full[w / 32] &= ~wbit;
+	}
+}
+
+////////////////////////////////////////////////////////////
 
 /*
  * Construct a filetable.
@@ -45,16 +297,24 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
 
+	ft->ft_lock = lock_create("filetable");
+	if (ft->ft_lock == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	ft->ft_fds = fdarray_create(FD_MINSIZE);
+	if (ft->ft_fds == NULL) {
+		lock_destroy(ft->ft_lock);
+		kfree(ft);
+		return NULL;
 	}
 
 	return ft;
@@ -66,17 +326,12 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
-
 	KASSERT(ft != NULL);
 
-	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
-		}
-	}
+	/* Close any open files, unless someone else still has them. */
+	fdarray_release(ft->ft_fds);
+	ft->ft_fds = NULL;
+	lock_destroy(ft->ft_lock);
 	kfree(ft);
 }
 
@@ -94,13 +349,15 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The descriptor array isn't copied either, until one side changes
+ * it.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
-	struct openfile *file;
-	int fd;
+	struct fdarray *fa;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,31 +365,84 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = kmalloc(sizeof(struct filetable));
 	if (dest == NULL) {
 		return ENOMEM;
 	}
-
-	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
-		}
-		dest->ft_openfiles[fd] = file;
+	dest->ft_lock = lock_create("filetable");
+	if (dest->ft_lock == NULL) {
+		kfree(dest);
+		return ENOMEM;
 	}
 
+	/* share the array */
+	lock_acquire(src->ft_lock);
+	fa = src->ft_fds;
+	spinlock_acquire(&fa->fa_reflock);
+	fa->fa_refcount++;
+	spinlock_release(&fa->fa_reflock);
+	dest->ft_fds = fa;
+	lock_release(src->ft_lock);
+
 	*dest_ret = dest;
 	return 0;
 }
 
+/*
+ * Get ready to change a filetable: give it an array of its own, if
+ * it's sharing one, with at least MINSIZE slots. Call with ft_lock
+ * held.
+ */
+static
+int
+filetable_writable(struct filetable *ft, unsigned minsize)
+{
+	struct fdarray *fa, *newfa;
+	unsigned newsize;
+	bool shared;
+
+	KASSERT(lock_do_i_hold(ft->ft_lock));
+	KASSERT(minsize <= OPEN_MAX);
+
+	fa = ft->ft_fds;
+	spinlock_acquire(&fa->fa_reflock);
+	shared = fa->fa_refcount > 1;
+	spinlock_release(&fa->fa_reflock);
+
+	if (!shared && fa->fa_size >= minsize) {
+		return 0;
+	}
+
+	newsize = fa->fa_size;
+	while (newsize < minsize) {
+		newsize *= 2;
+	}
+	if (newsize > OPEN_MAX) {
+		newsize = OPEN_MAX;
+	}
+
+	newfa = fdarray_copy(fa, newsize, shared);
+	if (newfa == NULL) {
+		return ENOMEM;
+	}
+	if (shared) {
+		fdarray_release(fa);
+	}
+	else {
+		fa->fa_refcount = 0;
+		fdarray_destroy(fa);
+	}
+	ft->ft_fds = newfa;
+	return 0;
+}
+
 /*
  * Check if a file handle is in range.
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
+	/* The table grows to OPEN_MAX, so its current size doesn't matter */
 	(void)ft;
 
 	return (fd >= 0 && fd < OPEN_MAX);
@@ -145,46 +455,50 @@ filetable_okfd(struct filetable *ft, int fd)
  * This checks that the file handle is in range and fails rather than
  * returning a null openfile; it only yields files that are actually
  * open.
+ *
+ * The openfile comes with a reference of its own, which
+ * filetable_put drops, so another thread closing the file handle in
+ * the meantime doesn't pull it out from under us.
  */
 int
 filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
+	struct fdarray *fa;
 	struct openfile *file;
 
 	if (!filetable_okfd(ft, fd)) {
 		return EBADF;
 	}
 
-	file = ft->ft_openfiles[fd];
+	lock_acquire(ft->ft_lock);
+	fa = ft->ft_fds;
+	file = (unsigned)fd < fa->fa_size ? FD_SLOT(fa, fd) : NULL;
 	if (file == NULL) {
+		lock_release(ft->ft_lock);
 		return EBADF;
 	}
+	openfile_incref(file);
+	lock_release(ft->ft_lock);
 
 	*ret = file;
 	return 0;
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
- *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
+ * Put a file handle back when done with it, dropping the reference
+ * filetable_get took.
  *
  * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
- * your own reference to the openfile (with openfile_incref) and call
- * filetable_put before mucking about.
+ * want to keep it after this, get your own reference to the openfile
+ * (with openfile_incref) first.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	(void)ft;
+	(void)fd;
+
+	openfile_decref(file);
 }
 
 /*
@@ -200,17 +514,33 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	struct fdarray *fa;
+	unsigned fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
-		}
+	lock_acquire(ft->ft_lock);
+
+	fd = fdarray_lowestfree(ft->ft_fds);
+	if (fd >= OPEN_MAX) {
+		lock_release(ft->ft_lock);
+		return EMFILE;
+	}
+
+	result = filetable_writable(ft, fd + 1);
+	if (result) {
+		lock_release(ft->ft_lock);
+		return result;
 	}
+	fa = ft->ft_fds;
 
-	return EMFILE;
+	KASSERT(FD_SLOT(fa, fd) == NULL);
+	FD_SLOT(fa, fd) = file;
+	fdarray_mark(fa, fd, true);
+
+	lock_release(ft->ft_lock);
+
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -221,17 +551,52 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the table needs to grow or be unshared and there's
+ * no memory for it; then nothing changes and the caller still owns
+ * the reference to the new openfile.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
+	struct fdarray *fa;
+	struct openfile *oldfile;
+	int result;
+
 	KASSERT(filetable_okfd(ft, fd));
 
-	*oldfile_ret = ft->ft_openfiles[fd];
-	ft->ft_openfiles[fd] = newfile;
+	lock_acquire(ft->ft_lock);
+
+	fa = ft->ft_fds;
+	oldfile = (unsigned)fd < fa->fa_size ? FD_SLOT(fa, fd) : NULL;
+	if (oldfile == NULL && newfile == NULL) {
+		/* Nothing to change */
+		lock_release(ft->ft_lock);
+		*oldfile_ret = NULL;
+		return 0;
+	}
+
+	result = filetable_writable(ft, fd + 1);
+	if (result) {
+		lock_release(ft->ft_lock);
+		return result;
+	}
+	fa = ft->ft_fds;
+
+	KASSERT(FD_SLOT(fa, fd) == oldfile);
+	FD_SLOT(fa, fd) = newfile;
+	if (oldfile == NULL) {
+		fdarray_mark(fa, fd, true);
+	}
+	else if (newfile == NULL) {
+		fdarray_mark(fa, fd, false);
+	}
+
+	lock_release(ft->ft_lock);
+
+	*oldfile_ret = oldfile;
+	return 0;
 }
@@ -0,0 +1,186 @@
+/*
+ * Futexes: wait and wake on a word of user memory.
+ *
+ * The user-level code does the actual locking with ordinary memory
+ * operations, and only calls in here to sleep when it has to
+ * (futex_wait) or to wake sleepers up (futex_wake). A word is named
+ * by its address space and user address, and sleepers on it are
+ * found through a hash table of buckets keyed on those.
+ *
+ * A sleeper goes on its bucket's list before looking at the word, and
+ * a waker marks the sleepers it takes off the list. So if the word
+ * changes and futex_wake runs between the check and going to sleep,
+ * the sleeper finds itself marked and doesn't sleep. That way we
+ * never hold a spinlock while touching user memory.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <current.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* One of these on the stack of each sleeping thread. */
+struct futex_waiter {
+	struct addrspace *fw_as;
+	vaddr_t fw_uaddr;
+	struct thread *fw_thread;
+	bool fw_woken;
+	struct futex_waiter *fw_next;
+	struct futex_waiter **fw_prevp;
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_waiters;	/* Oldest first */
+	struct futex_waiter **fb_tailp;
+};
+
+#define FUTEX_BUCKETS	64
+
+static struct futex_bucket futex_table[FUTEX_BUCKETS];
+
+/*
+ * Set up the hash table.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+		futex_table[i].fb_tailp = &futex_table[i].fb_waiters;
+	}
+}
+
+static
+struct futex_bucket *
+futex_bucket(struct addrspace *as, vaddr_t uaddr)
+{
+	uint32_t h;
+
+	h = ((uint32_t)as >> 4) ^ (uaddr >> 2);
+	h ^= h >> 16;
+	return &futex_table[h % FUTEX_BUCKETS];
+}
+
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	*fw->fw_prevp = fw->fw_next;
+	if (fw->fw_next != NULL) {
+		fw->fw_next->fw_prevp = fw->fw_prevp;
+	}
+	else {
+		fb->fb_tailp = fw->fw_prevp;
+	}
+	fw->fw_next = NULL;
+	fw->fw_prevp = NULL;
+}
+
+/*
+ * sys_futex_wait
+ *
+ * If the word at UADDR still contains VAL, sleep until futex_wake is
+ * called on it. Returns EAGAIN if the word had already changed.
+ * Like all futex waits this may return with the word still equal to
+ * VAL, so callers must check again.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct futex_waiter fw;
+	struct futex_bucket *fb;
+	int cur, result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	fw.fw_as = proc_getas();
+	fw.fw_uaddr = (vaddr_t)uaddr;
+	fw.fw_thread = curthread;
+	fw.fw_woken = false;
+	fb = futex_bucket(fw.fw_as, fw.fw_uaddr);
+
+	spinlock_acquire(&fb->fb_lock);
+	fw.fw_next = NULL;
+	fw.fw_prevp = fb->fb_tailp;
+	*fb->fb_tailp = &fw;
+	fb->fb_tailp = &fw.fw_next;
+	spinlock_release(&fb->fb_lock);
+
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result == 0 && cur != val) {
+		result = EAGAIN;
+	}
+
+	spinlock_acquire(&fb->fb_lock);
+	if (result == 0) {
+		while (!fw.fw_woken) {
+			wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+		}
+	}
+	else if (fw.fw_woken) {
+		/* Someone counted us as woken; don't lose it. */
+		result = 0;
+	}
+	else {
+		futex_unlink(fb, &fw);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	return result;
+}
+
+/*
+ * sys_futex_wake
+ *
+ * Wake up to COUNT threads sleeping on the word at UADDR. Returns how
+ * many there were.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int count, int *retval)
+{
+	struct futex_waiter *fw, *next;
+	struct futex_bucket *fb;
+	struct addrspace *as;
+	int woken;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_bucket(as, (vaddr_t)uaddr);
+	woken = 0;
+
+	spinlock_acquire(&fb->fb_lock);
+	for (fw = fb->fb_waiters; fw != NULL && woken < count; fw = next) {
+		next = fw->fw_next;
+		if (fw->fw_as != as || fw->fw_uaddr != (vaddr_t)uaddr) {
+			continue;
+		}
+		futex_unlink(fb, fw);
+		fw->fw_woken = true;
+		/* It might not have gone to sleep yet; that's fine. */
+		wchan_wakethread(fb->fb_wchan, &fb->fb_lock, fw->fw_thread);
+		woken++;
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
@@ -37,6 +37,7 @@
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <kern/unistd.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -368,6 +369,100 @@ sys_fstat(int fd, userptr_t statptr)
 	return copyout(&kbuf, statptr, sizeof(struct stat));
 }
 
+/*
+ * Common code for stat and lstat: look the path up and VOP_STAT the
+ * vnode directly, without opening it.
+ */
+static
+int
+stat_path(userptr_t path, userptr_t statptr)
+{
+	struct stat kbuf;
+	struct vnode *vn;
+	char *pathbuf;
+	int err;
+
+	pathbuf = kmalloc(PATH_MAX);
+	if (pathbuf == NULL) {
+		return ENOMEM;
+	}
+
+	err = copyinstr(path, pathbuf, PATH_MAX, NULL);
+	if (err) {
+		kfree(pathbuf);
+		return err;
+	}
+
+	err = vfs_lookup(pathbuf, &vn);
+	kfree(pathbuf);
+	if (err) {
+		return err;
+	}
+
+	err = VOP_STAT(vn, &kbuf);
+	VOP_DECREF(vn);
+	if (err) {
+		return err;
+	}
+
+	return copyout(&kbuf, statptr, sizeof(struct stat));
+}
+
+/*
+ * stat - look up the path and call VOP_STAT
+ */
+int
+sys_stat(userptr_t path, userptr_t statptr)
+{
+	return stat_path(path, statptr);
+}
+
+/*
+ * lstat - same as stat, as vfs_lookup never follows symlinks (there
+ * aren't any yet).
+ */
+int
+sys_lstat(userptr_t path, userptr_t statptr)
+{
+	return stat_path(path, statptr);
+}
+
+/*
+ * access - check that the path exists. There are no users or
+ * permission bits, so any file that exists may be read, written, or
+ * executed.
+ */
+int
+sys_access(userptr_t path, int mode)
+{
+	struct vnode *vn;
+	char *pathbuf;
+	int err;
+
+	if ((mode & ~(R_OK | W_OK | X_OK)) != 0) {
+		return EINVAL;
+	}
+
+	pathbuf = kmalloc(PATH_MAX);
+	if (pathbuf == NULL) {
+		return ENOMEM;
+	}
+
+	err = copyinstr(path, pathbuf, PATH_MAX, NULL);
+	if (err) {
+		kfree(pathbuf);
+		return err;
+	}
+
+	err = vfs_lookup(pathbuf, &vn);
+	kfree(pathbuf);
+	if (err) {
+		return err;
+	}
+	VOP_DECREF(vn);
+	return 0;
+}
+
 /*
  * fsync - call VOP_FSYNC
  */
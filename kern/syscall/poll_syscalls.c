@@ -0,0 +1,399 @@
+/*
+ * poll and select.
+ *
+ * Both come down to pollset_wait, which works on an array of slots,
+ * one per file handle, kept in page-sized chunks so that polling
+ * every possible handle doesn't need a big kmalloc.
+ *
+ * Each pass over the slots asks every file what's ready with
+ * VOP_POLL. Until something is, it also has each file put the slot's
+ * pollentry on its wait queue; if the pass finds nothing, we sleep
+ * until one of those queues is woken (or the time runs out) and go
+ * around again. The open files are held from the start of a pass
+ * until the entries are off the queues again, so no queue can go
+ * away under us.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <kern/time.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <callout.h>
+#include <current.h>
+#include <proc.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+struct pollslot {
+	struct pollfd sl_pfd;		/* what to look for, and what's found */
+	struct openfile *sl_file;	/* held during a pass, or NULL */
+	struct pollentry sl_entry;	/* our place on the file's queue */
+};
+
+#define POLL_CHUNK	(PAGE_SIZE / sizeof(struct pollslot))
+#define POLL_MAXCHUNKS	((OPEN_MAX + POLL_CHUNK - 1) / POLL_CHUNK)
+
+/* How many pollfds to copy in or out at once. */
+#define POLL_COPYBATCH	32
+
+struct pollset {
+	unsigned pset_nfds;
+	struct pollslot *pset_chunks[POLL_MAXCHUNKS];
+	struct poller pset_poller;
+};
+
+static
+struct pollslot *
+pollset_slot(struct pollset *pset, unsigned i)
+{
+	return &pset->pset_chunks[i / POLL_CHUNK][i % POLL_CHUNK];
+}
+
+static
+void
+pollset_cleanup(struct pollset *pset)
+{
+	unsigned i;
+
+	for (i=0; i<POLL_MAXCHUNKS; i++) {
+		kfree(pset->pset_chunks[i]);
+	}
+	poller_cleanup(&pset->pset_poller);
+}
+
+/*
+ * Set up a pollset with NFDS slots, with no handles in them yet.
+ */
+static
+int
+pollset_init(struct pollset *pset, unsigned nfds)
+{
+	unsigned i, n;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	result = poller_init(&pset->pset_poller);
+	if (result) {
+		return result;
+	}
+
+	pset->pset_nfds = nfds;
+	for (i=0; i<POLL_MAXCHUNKS; i++) {
+		pset->pset_chunks[i] = NULL;
+	}
+	for (i=0; i * POLL_CHUNK < nfds; i++) {
+		n = nfds - i * POLL_CHUNK;
+		if (n > POLL_CHUNK) {
+			n = POLL_CHUNK;
+		}
+		pset->pset_chunks[i] = kmalloc(n * sizeof(struct pollslot));
+		if (pset->pset_chunks[i] == NULL) {
+			pollset_cleanup(pset);
+			return ENOMEM;
+		}
+	}
+
+	for (i=0; i<nfds; i++) {
+		pollset_slot(pset, i)->sl_file = NULL;
+		pollentry_init(&pollset_slot(pset, i)->sl_entry,
+			       &pset->pset_poller);
+	}
+	return 0;
+}
+
+/*
+ * Make a pass over the slots, filling in revents, and return how
+ * many have something to report. If WAIT is set, queue the slots'
+ * entries until something turns up ready.
+ */
+static
+unsigned
+pollset_scan(struct pollset *pset, bool wait)
+{
+	struct pollslot *sl;
+	struct pollfd *pfd;
+	unsigned i, nready;
+	int result;
+
+	nready = 0;
+	for (i=0; i<pset->pset_nfds; i++) {
+		sl = pollset_slot(pset, i);
+		pfd = &sl->sl_pfd;
+		pfd->revents = 0;
+		if (pfd->fd < 0) {
+			continue;
+		}
+
+		result = filetable_get(curproc->p_filetable, pfd->fd,
+				       &sl->sl_file);
+		if (result) {
+			sl->sl_file = NULL;
+			pfd->revents = POLLNVAL;
+			nready++;
+			continue;
+		}
+
+		pfd->revents = VOP_POLL(sl->sl_file->of_vnode, pfd->events,
+					(wait && nready == 0) ?
+					&sl->sl_entry : NULL);
+		pfd->revents &= pfd->events | POLLERR | POLLHUP;
+		if (pfd->revents != 0) {
+			nready++;
+		}
+	}
+	return nready;
+}
+
+/*
+ * End a pass: take the entries off the queues and let go of the files.
+ */
+static
+void
+pollset_endscan(struct pollset *pset)
+{
+	struct pollslot *sl;
+	unsigned i;
+
+	for (i=0; i<pset->pset_nfds; i++) {
+		sl = pollset_slot(pset, i);
+		pollentry_remove(&sl->sl_entry);
+		if (sl->sl_file != NULL) {
+			filetable_put(curproc->p_filetable, sl->sl_pfd.fd,
+				      sl->sl_file);
+			sl->sl_file = NULL;
+		}
+	}
+}
+
+/*
+ * Wait until something in PSET is ready or, if TIMED, TICKS hardclock
+ * ticks go by. Returns the number of slots with something to report.
+ */
+static
+unsigned
+pollset_wait(struct pollset *pset, bool timed, unsigned ticks)
+{
+	unsigned start, elapsed, nready;
+
+	start = callout_ticks();
+	while (1) {
+		poller_reset(&pset->pset_poller);
+		nready = pollset_scan(pset, !timed || ticks > 0);
+		if (nready > 0) {
+			break;
+		}
+		if (!timed) {
+			poller_wait(&pset->pset_poller, false, 0);
+		}
+		else {
+			elapsed = callout_ticks() - start;
+			if (elapsed >= ticks) {
+				break;
+			}
+			poller_wait(&pset->pset_poller, true, ticks - elapsed);
+		}
+		pollset_endscan(pset);
+	}
+	pollset_endscan(pset);
+	return nready;
+}
+
+/*
+ * sys_poll
+ *
+ * Wait for something in the NFDS pollfds at UFDS to be ready, for up
+ * to TIMEOUT milliseconds (forever if negative). Returns the number
+ * of entries with nonzero revents.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct pollset pset;
+	struct pollfd buf[POLL_COPYBATCH];
+	struct timespec ts;
+	unsigned i, j, n, nready, ticks;
+	int result;
+
+	result = pollset_init(&pset, nfds);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<nfds; i += n) {
+		n = nfds - i;
+		if (n > POLL_COPYBATCH) {
+			n = POLL_COPYBATCH;
+		}
+		result = copyin(ufds + i * sizeof(struct pollfd), buf,
+				n * sizeof(struct pollfd));
+		if (result) {
+			pollset_cleanup(&pset);
+			return result;
+		}
+		for (j=0; j<n; j++) {
+			pollset_slot(&pset, i + j)->sl_pfd = buf[j];
+		}
+	}
+
+	ticks = 0;
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		ticks = timespec_to_ticks(&ts);
+	}
+	nready = pollset_wait(&pset, timeout >= 0, ticks);
+
+	for (i=0; i<nfds; i += n) {
+		n = nfds - i;
+		if (n > POLL_COPYBATCH) {
+			n = POLL_COPYBATCH;
+		}
+		for (j=0; j<n; j++) {
+			buf[j] = pollset_slot(&pset, i + j)->sl_pfd;
+		}
+		result = copyout(buf, ufds + i * sizeof(struct pollfd),
+				 n * sizeof(struct pollfd));
+		if (result) {
+			pollset_cleanup(&pset);
+			return result;
+		}
+	}
+
+	pollset_cleanup(&pset);
+	*retval = nready;
+	return 0;
+}
+
+/*
+ * sys_select
+ *
+ * Wait for any of the handles below NFDS in the read, write, and
+ * exception sets (any of which may be NULL) to be ready, for up to
+ * the time in UTIMEOUT (forever if NULL). On return the sets hold
+ * just the handles that are ready, and the result is how many bits
+ * are set in all. "Exceptions" are POLLPRI, which never happens.
+ */
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, userptr_t utimeout, int *retval)
+{
+	userptr_t usets[3] = { ureadfds, uwritefds, uexceptfds };
+	static const int setevents[3] = { POLLIN, POLLOUT, POLLPRI };
+	fd_set sets[3];
+	struct pollset pset;
+	struct pollslot *sl;
+	struct timeval tv;
+	struct timespec ts;
+	size_t setsize;
+	unsigned i, s, npoll, ticks, nbits;
+	int fd, revents, result;
+
+	if (nfds < 0 || nfds > FD_SETSIZE) {
+		return EINVAL;
+	}
+	/* only copy the part of each set that's used */
+	setsize = DIVROUNDUP(nfds, __NFDBITS) * sizeof(sets[0].fds_bits[0]);
+
+	for (s=0; s<3; s++) {
+		FD_ZERO(&sets[s]);
+		if (usets[s] != NULL) {
+			result = copyin(usets[s], &sets[s], setsize);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	ticks = 0;
+	if (utimeout != NULL) {
+		result = copyin(utimeout, &tv, sizeof(tv));
+		if (result) {
+			return result;
+		}
+		if (tv.tv_sec < 0 || tv.tv_usec < 0 ||
+		    tv.tv_usec >= 1000000) {
+			return EINVAL;
+		}
+		ts.tv_sec = tv.tv_sec;
+		ts.tv_nsec = tv.tv_usec * 1000;
+		ticks = timespec_to_ticks(&ts);
+	}
+
+	/* Turn the sets into pollfds. */
+	npoll = 0;
+	for (fd=0; fd<nfds; fd++) {
+		if (FD_ISSET(fd, &sets[0]) || FD_ISSET(fd, &sets[1]) ||
+		    FD_ISSET(fd, &sets[2])) {
+			npoll++;
+		}
+	}
+	result = pollset_init(&pset, npoll);
+	if (result) {
+		return result;
+	}
+	i = 0;
+	for (fd=0; fd<nfds; fd++) {
+		if (!FD_ISSET(fd, &sets[0]) && !FD_ISSET(fd, &sets[1]) &&
+		    !FD_ISSET(fd, &sets[2])) {
+			continue;
+		}
+		sl = pollset_slot(&pset, i++);
+		sl->sl_pfd.fd = fd;
+		sl->sl_pfd.events = 0;
+		for (s=0; s<3; s++) {
+			if (FD_ISSET(fd, &sets[s])) {
+				sl->sl_pfd.events |= setevents[s];
+			}
+		}
+	}
+
+	pollset_wait(&pset, utimeout != NULL, ticks);
+
+	/* And the results back into the sets. */
+	for (s=0; s<3; s++) {
+		FD_ZERO(&sets[s]);
+	}
+	nbits = 0;
+	for (i=0; i<npoll; i++) {
+		sl = pollset_slot(&pset, i);
+		revents = sl->sl_pfd.revents;
+		if (revents & POLLNVAL) {
+			pollset_cleanup(&pset);
+			return EBADF;
+		}
+		/* errors and hangups count as ready for whatever was asked */
+		if (revents & (POLLERR | POLLHUP)) {
+			revents |= sl->sl_pfd.events & (POLLIN | POLLOUT);
+		}
+		for (s=0; s<3; s++) {
+			if (revents & setevents[s]) {
+				FD_SET(sl->sl_pfd.fd, &sets[s]);
+				nbits++;
+			}
+		}
+	}
+	pollset_cleanup(&pset);
+
+	for (s=0; s<3; s++) {
+		if (usets[s] != NULL) {
+			result = copyout(&sets[s], usets[s], setsize);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	*retval = nbits;
+	return 0;
+}
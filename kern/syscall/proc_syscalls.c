@@ -37,6 +37,7 @@
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
+#include <synch.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -58,19 +59,80 @@ sys_getpid(pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_getppid
+ *
+ * (libc normally gets this from the vdso page instead.)
+ */
+int
+sys_getppid(pid_t *retval)
+{
+	*retval = curproc->p_ppid;
+	return 0;
+}
+
+/*
+ * sys_sched_setaffinity, sys_sched_getaffinity
+ *
+ * The mask is an array of SIZE bytes, of which we use the first 32
+ * bits (one per cpu; there can't be more than 32). These apply to
+ * the calling thread only; PID must be 0 or the caller's own pid.
+ */
+int
+sys_sched_setaffinity(pid_t pid, size_t size, const_userptr_t umask)
+{
+	uint32_t mask;
+	int result;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+	if (size < sizeof(mask)) {
+		return EINVAL;
+	}
+	result = copyin(umask, &mask, sizeof(mask));
+	if (result) {
+		return result;
+	}
+	return thread_setaffinity(mask);
+}
+
+int
+sys_sched_getaffinity(pid_t pid, size_t size, userptr_t umask)
+{
+	uint32_t mask;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+	if (size < sizeof(mask)) {
+		return EINVAL;
+	}
+	mask = thread_getaffinity();
+	return copyout(&mask, umask, sizeof(mask));
+}
+
 /*
  * sys__exit()
  *
- * The process-level work (exit status, waking up waiters, etc.)
- * happens in proc_exit(). Then call thread_exit() to make our thread
- * go away too.
+ * Record the exit status, then leave via proc_thread_exit(). If other
+ * threads are still running the process carries on with them, and
+ * the status is reported when the last one exits; otherwise the
+ * process-level work (waking up waiters, etc.) happens right away in
+ * proc_exit(). A thread that died of a fatal fault (see
+ * kill_curthread) already set a signal status; that one sticks.
  */
 __DEAD
 void
 sys__exit(int status)
 {
-	proc_exit(_MKWAIT_EXIT(status));
-	thread_exit();
+	lock_acquire(curproc->p_utlock);
+	if (!WIFSIGNALED(curproc->p_exitstatus)) {
+		curproc->p_exitstatus = _MKWAIT_EXIT(status);
+	}
+	lock_release(curproc->p_utlock);
+
+	proc_thread_exit(NULL);
 }
 
 /*
@@ -137,6 +199,63 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_vfork
+ *
+ * Like fork, except that instead of getting a copy of our address
+ * space the child borrows it, and we sleep until the child gives it
+ * back by calling execv or _exit (see proc_vforkdone). Other threads
+ * in this process, if any, keep running. The vdso page is ours and
+ * keeps our ids; libc asks the kernel in the child (see <kern/vdso.h>).
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+	struct trapframe *ntf;
+	struct semaphore *sem;
+	struct proc *newproc;
+	int result;
+
+	ntf = kmalloc(sizeof(struct trapframe));
+	if (ntf==NULL) {
+		return ENOMEM;
+	}
+	*ntf = *tf;
+
+	sem = sem_create("vfork", 0);
+	if (sem == NULL) {
+		kfree(ntf);
+		return ENOMEM;
+	}
+
+	result = proc_fork_noas(curproc->p_name, &newproc);
+	if (result) {
+		sem_destroy(sem);
+		kfree(ntf);
+		return result;
+	}
+	newproc->p_addrspace = proc_getas();
+	newproc->p_vforksem = sem;
+	*retval = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     fork_newthread, ntf, 0);
+	if (result) {
+		newproc->p_addrspace = NULL;
+		newproc->p_vforksem = NULL;
+		proc_unfork(newproc);
+		sem_destroy(sem);
+		kfree(ntf);
+		return result;
+	}
+
+	/* The child can't touch the semaphore after it's V'd it. */
+	P(sem);
+	sem_destroy(sem);
+
+	return 0;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -152,7 +271,8 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 		return result;
 	}
 
-	if (retstatus != NULL) {
+	/* With WNOHANG and nobody ready, there's no status to give. */
+	if (retstatus != NULL && *retval != 0) {
 		result = copyout(&status, retstatus, sizeof(int));
 	}
 	return result;
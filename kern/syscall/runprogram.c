@@ -28,18 +28,22 @@
  */
 
 /*
- * Code for running a user program from the menu, and code for execv,
- * which have a lot in common.
+ * Code for running a user program from the menu, and code for execv
+ * and spawn, which have a lot in common.
  */
 
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/spawn.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
 #include <proc.h>
 #include <current.h>
+#include <spinlock.h>
+#include <wchan.h>
 #include <synch.h>
 #include <copyinout.h>
 #include <addrspace.h>
@@ -47,41 +51,150 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pid.h>
 #include <syscall.h>
+#include <vdso.h>
 #include <test.h>
 
+/*
+ * Pool of pages for argv buffers.
+ *
+ * Argument strings are copied straight from the old image into pages
+ * from this pool, and from there straight onto the new stack. The
+ * pool has a budget of ARGPOOL_PAGES pages for all execs together,
+ * so any number of execs can be in progress at once as long as their
+ * arguments fit. A few freed pages are kept around for the next exec
+ * instead of going back to the VM system.
+ *
+ * An exec waits for its first page if it has to, but never waits for
+ * more while holding some: that could deadlock against other execs
+ * doing the same. Instead it lets go of everything, waits until the
+ * pool has as many pages as it found it needed, and starts over.
+ */
+#define ARGPOOL_PAGES	32	/* Budget for all execs at once */
+#define ARGPOOL_CACHE	8	/* Free pages to keep */
+
+static struct spinlock argpool_lock = SPINLOCK_INITIALIZER;
+static struct wchan *argpool_wchan;
+static unsigned argpool_avail;	/* Pages left in the budget */
+static void *argpool_cache;	/* Free pages, linked through word 0 */
+static unsigned argpool_ncached;
+
+/*
+ * Take a page from the pool. If WAIT is false, fails with EAGAIN
+ * instead of waiting for one.
+ */
+static
+int
+argpool_get(bool wait, void **ret)
+{
+	void *page;
+
+	spinlock_acquire(&argpool_lock);
+	while (argpool_avail == 0) {
+		if (!wait) {
+			spinlock_release(&argpool_lock);
+			return EAGAIN;
+		}
+		wchan_sleep(argpool_wchan, &argpool_lock);
+	}
+	argpool_avail--;
+	page = argpool_cache;
+	if (page != NULL) {
+		argpool_cache = *(void **)page;
+		argpool_ncached--;
+	}
+	spinlock_release(&argpool_lock);
+
+	if (page == NULL) {
+		page = (void *)alloc_kpages(1);
+		if (page == NULL) {
+			spinlock_acquire(&argpool_lock);
+			argpool_avail++;
+			wchan_wakeall(argpool_wchan, &argpool_lock);
+			spinlock_release(&argpool_lock);
+			return ENOMEM;
+		}
+	}
+	*ret = page;
+	return 0;
+}
+
+/*
+ * Give a page back to the pool.
+ */
+static
+void
+argpool_put(void *page)
+{
+	spinlock_acquire(&argpool_lock);
+	argpool_avail++;
+	if (argpool_ncached < ARGPOOL_CACHE) {
+		*(void **)page = argpool_cache;
+		argpool_cache = page;
+		argpool_ncached++;
+		page = NULL;
+	}
+	wchan_wakeall(argpool_wchan, &argpool_lock);
+	spinlock_release(&argpool_lock);
+
+	if (page != NULL) {
+		free_kpages((vaddr_t)page);
+	}
+}
+
+/*
+ * Wait until there are at least NPAGES pages left in the budget.
+ */
+static
+void
+argpool_wait(unsigned npages)
+{
+	KASSERT(npages <= ARGPOOL_PAGES);
+
+	spinlock_acquire(&argpool_lock);
+	while (argpool_avail < npages) {
+		wchan_sleep(argpool_wchan, &argpool_lock);
+	}
+	spinlock_release(&argpool_lock);
+}
+
 /*
  * argv buffer.
  *
  * This is an abstraction that holds an argv while it's being shuffled
- * through the kernel during exec.
+ * through the kernel during exec. The strings go back to back in a
+ * series of pages, exactly as they'll appear on the new stack. A
+ * second series of pages holds the offset of each string, which turn
+ * into the argv pointers when they're copied out. Together the two
+ * are limited to ARG_MAX, counting the ending NULL pointer.
  */
+#define ARGBUF_MAXPAGES	(ARG_MAX / PAGE_SIZE + 1)
+#define ARGBUF_PTRSPERPAGE	(PAGE_SIZE / sizeof(userptr_t))
+
 struct argbuf {
-	char *data;
-	size_t len;
-	size_t max;
+	char *strpages[ARGBUF_MAXPAGES];	/* String data */
+	userptr_t *ptrpages[ARGBUF_MAXPAGES];	/* Offsets of strings */
+	unsigned nstrpages;
+	unsigned nptrpages;
+	size_t len;				/* Bytes of string data */
 	int nargs;
-	bool tooksem;
 };
 
-/*
- * Throttle to limit the number of processes in exec at once. Or,
- * rather, the number trying to use large exec buffers at once. See
- * design notes for the rationale.
- */
-#define EXEC_BIGBUF_THROTTLE	1
-static struct semaphore *execthrottle;
-
 /*
  * Set things up.
  */
 void
 exec_bootstrap(void)
 {
-	execthrottle = sem_create("exec", EXEC_BIGBUF_THROTTLE);
-	if (execthrottle == NULL) {
-		panic("Cannot create exec throttle semaphore\n");
+	/* One exec as big as possible has to fit, or it'd wait forever. */
+	KASSERT(ARGPOOL_PAGES >= 2 * ARGBUF_MAXPAGES);
+
+	argpool_wchan = wchan_create("argpool");
+	if (argpool_wchan == NULL) {
+		panic("Cannot create exec argument pool\n");
 	}
+	argpool_avail = ARGPOOL_PAGES;
 }
 
 /*
@@ -91,11 +204,10 @@ static
 void
 argbuf_init(struct argbuf *buf)
 {
-	buf->data = NULL;
+	buf->nstrpages = 0;
+	buf->nptrpages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
-	buf->tooksem = false;
 }
 
 /*
@@ -105,31 +217,94 @@ static
 void
 argbuf_cleanup(struct argbuf *buf)
 {
-	if (buf->data != NULL) {
-		kfree(buf->data);
-		buf->data = NULL;
+	unsigned i;
+
+	for (i=0; i<buf->nstrpages; i++) {
+		argpool_put(buf->strpages[i]);
 	}
-	buf->len = 0;
-	buf->max = 0;
-	buf->nargs = 0;
-	if (buf->tooksem) {
-		V(execthrottle);
-		buf->tooksem = false;
+	for (i=0; i<buf->nptrpages; i++) {
+		argpool_put(buf->ptrpages[i]);
 	}
+	argbuf_init(buf);
 }
 
 /*
- * Allocate the memory for an argv buffer.
+ * Get another page for an argv buffer. Only the first page may wait.
  */
 static
 int
-argbuf_allocate(struct argbuf *buf, size_t size)
+argbuf_getpage(struct argbuf *buf, void **ret)
 {
-	buf->data = kmalloc(size);
-	if (buf->data == NULL) {
-		return ENOMEM;
+	bool first;
+
+	first = (buf->nstrpages == 0 && buf->nptrpages == 0);
+	return argpool_get(first, ret);
+}
+
+/*
+ * Bytes left for string data, once room is kept for the pointers
+ * (including the new one and the ending NULL).
+ */
+static
+size_t
+argbuf_room(struct argbuf *buf)
+{
+	size_t used;
+
+	used = buf->len + (buf->nargs + 2) * sizeof(userptr_t);
+	return used >= ARG_MAX ? 0 : ARG_MAX - used;
+}
+
+/*
+ * Start a new argument at the current end of the string data. After
+ * this the string is added to buf->len, and then buf->nargs is
+ * incremented.
+ */
+static
+int
+argbuf_newarg(struct argbuf *buf)
+{
+	unsigned slot;
+	void *page;
+	int result;
+
+	if (argbuf_room(buf) == 0) {
+		return E2BIG;
 	}
-	buf->max = size;
+	slot = buf->nargs % ARGBUF_PTRSPERPAGE;
+	if (slot == 0) {
+		KASSERT(buf->nptrpages < ARGBUF_MAXPAGES);
+		result = argbuf_getpage(buf, &page);
+		if (result) {
+			return result;
+		}
+		buf->ptrpages[buf->nptrpages++] = page;
+	}
+	buf->ptrpages[buf->nptrpages - 1][slot] = (userptr_t)buf->len;
+	return 0;
+}
+
+/*
+ * Make sure there's a page to put the next byte of string data in,
+ * and return how much room is left in it.
+ */
+static
+int
+argbuf_strspace(struct argbuf *buf, char **ptr, size_t *space)
+{
+	void *page;
+	int result;
+
+	if (buf->len == buf->nstrpages * PAGE_SIZE) {
+		KASSERT(buf->nstrpages < ARGBUF_MAXPAGES);
+		result = argbuf_getpage(buf, &page);
+		if (result) {
+			return result;
+		}
+		buf->strpages[buf->nstrpages++] = page;
+	}
+	*ptr = buf->strpages[buf->len / PAGE_SIZE] + buf->len % PAGE_SIZE;
+	*space = PAGE_SIZE - buf->len % PAGE_SIZE;
 	return 0;
 }
 
@@ -143,22 +318,72 @@ static
 int
 argbuf_fromkernel(struct argbuf *buf, const char *progname)
 {
-	size_t len;
+	char *ptr;
+	size_t len, space;
 	int result;
 
 	len = strlen(progname) + 1;
+	if (len > argbuf_room(buf)) {
+		return E2BIG;
+	}
 
-	result = argbuf_allocate(buf, len);
+	result = argbuf_newarg(buf);
 	if (result) {
 		return result;
 	}
-	strcpy(buf->data, progname);
-	buf->len = len;
-	buf->nargs = 1;
+	result = argbuf_strspace(buf, &ptr, &space);
+	if (result) {
+		return result;
+	}
+	/* It's the first string, and PATH_MAX is less than a page. */
+	KASSERT(len <= space);
+	strcpy(ptr, progname);
+	buf->len += len;
+	buf->nargs++;
 
 	return 0;
 }
 
+/*
+ * Copy one argument string in from user space, continuing onto new
+ * pages as needed.
+ */
+static
+int
+argbuf_copyinstr(struct argbuf *buf, userptr_t thisarg)
+{
+	char *ptr;
+	size_t space, room, thisarglen;
+	int result;
+
+	while (1) {
+		result = argbuf_strspace(buf, &ptr, &space);
+		if (result) {
+			return result;
+		}
+		room = argbuf_room(buf);
+		if (room == 0) {
+			return E2BIG;
+		}
+		if (space > room) {
+			space = room;
+		}
+
+		result = copyinstr(thisarg, ptr, space, &thisarglen);
+		if (result == 0) {
+			/* Note: thisarglen includes the \0. */
+			buf->len += thisarglen;
+			return 0;
+		}
+		if (result != ENAMETOOLONG) {
+			return result;
+		}
+		/* Filled the space; keep going. */
+		buf->len += space;
+		thisarg += space;
+	}
+}
+
 /*
  * Copy an argv array into kernel space, using an argvdata buffer.
  */
@@ -167,11 +392,10 @@ int
 argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 {
 	userptr_t thisarg;
-	size_t thisarglen;
 	int result;
 
 	/* loop through the argv, grabbing each arg string */
-	buf->nargs = 0;
+	KASSERT(buf->nargs == 0);
 	while (1) {
 		/*
 		 * First, grab the pointer at argv.
@@ -188,17 +412,16 @@ argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 		}
 
 		/* Use the pointer to fetch the argument string. */
-		result = copyinstr(thisarg, buf->data + buf->len,
-				   buf->max - buf->len, &thisarglen);
-		if (result == ENAMETOOLONG) {
-			return E2BIG;
+		result = argbuf_newarg(buf);
+		if (result) {
+			return result;
 		}
-		else if (result) {
+		result = argbuf_copyinstr(buf, thisarg);
+		if (result) {
 			return result;
 		}
 
-		/* Move ahead. Note: thisarglen includes the \0. */
-		buf->len += thisarglen;
+		/* Move ahead. */
 		uargv += sizeof(userptr_t);
 		buf->nargs++;
 	}
@@ -213,42 +436,29 @@ static
 int
 argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
 {
+	unsigned needed;
 	int result;
 
-	/* try with a small buffer */
-	result = argbuf_allocate(buf, PAGE_SIZE);
-	if (result) {
-		return result;
-	}
+	while (1) {
+		result = argbuf_copyin(buf, uargv);
+		if (result != EAGAIN) {
+			return result;
+		}
 
-	/* do the copyin */
-	result = argbuf_copyin(buf, uargv);
-	if (result == E2BIG) {
 		/*
-		 * Try again with the full-size buffer. Just start
-		 * over instead of trying to keep the page we already
-		 * did; this is a bit inefficient but it's not that
-		 * important.
+		 * The pool ran dry. Let go of what we have and wait
+		 * until there's at least that much plus the page we
+		 * were after, then start over.
 		 */
+		needed = buf->nstrpages + buf->nptrpages + 1;
 		argbuf_cleanup(buf);
-		argbuf_init(buf);
-
-		/* Wait on the semaphore, to throttle this allocation */
-		P(execthrottle);
-		buf->tooksem = true;
-
-		result = argbuf_allocate(buf, ARG_MAX);
-		if (result) {
-			return result;
-		}
-
-		result = argbuf_copyin(buf, uargv);
+		argpool_wait(needed);
 	}
-	return result;
 }
 
 /*
- * Copy an argv out of kernel space to user space.
+ * Copy an argv out of kernel space to user space. This turns the
+ * string offsets into pointers, so it can only be done once.
  *
  * Note: ustackp is an in/out argument.
  */
@@ -260,8 +470,8 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	vaddr_t ustack;
 	userptr_t ustringbase, uargvbase, uargv_i;
 	userptr_t thisarg;
-	size_t thisarglen;
-	size_t pos;
+	size_t pos, chunk;
+	unsigned i, j, num;
 	int result;
 
 	/* Begin the stack at the passed in top. */
@@ -270,7 +480,7 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	/*
 	 * Allocate space.
 	 *
-	 * buf->pos is the amount of space used by the strings; put that
+	 * buf->len is the amount of space used by the strings; put that
 	 * first, then align the stack, then make space for the argv
 	 * pointers. Allow an extra slot for the ending NULL.
 	 */
@@ -282,32 +492,37 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
 	uargvbase = (userptr_t)ustack;
 
-	/* Now copy the data out. */
-	pos = 0;
-	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
-		thisarg = ustringbase + pos;
-
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
+	/* Now copy the strings out, a page at a time. */
+	for (i=0, pos=0; pos < buf->len; i++, pos += chunk) {
+		chunk = buf->len - pos;
+		if (chunk > PAGE_SIZE) {
+			chunk = PAGE_SIZE;
+		}
+		result = copyout(buf->strpages[i], ustringbase + pos, chunk);
 		if (result) {
 			return result;
 		}
+	}
 
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
+	/* Then the pointers, likewise. */
+	uargv_i = uargvbase;
+	for (i=0; i < buf->nptrpages; i++) {
+		num = buf->nargs - i * ARGBUF_PTRSPERPAGE;
+		if (num > ARGBUF_PTRSPERPAGE) {
+			num = ARGBUF_PTRSPERPAGE;
+		}
+		for (j=0; j<num; j++) {
+			/* The user address of the string */
+			buf->ptrpages[i][j] =
+				ustringbase + (vaddr_t)buf->ptrpages[i][j];
+		}
+		result = copyout(buf->ptrpages[i], uargv_i,
+				 num * sizeof(userptr_t));
 		if (result) {
 			return result;
 		}
-
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
+		uargv_i += num * sizeof(userptr_t);
 	}
-	/* Should have come out even... */
-	KASSERT(pos == buf->len);
 
 	/* Add the NULL. */
 	thisarg = NULL;
@@ -385,13 +600,32 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		return result;
         }
 
+	/* And the vdso pages */
+	result = vdso_define(newvm, curproc);
+	if (result) {
+		proc_setas(oldvm);
+		as_activate();
+		as_destroy(newvm);
+		kfree(newname);
+		return result;
+	}
+
 	/*
-	 * Wipe out old address space.
+	 * Wipe out old address space, or if it was lent to us by vfork,
+	 * give it back.
 	 *
 	 * Note: once this is done, execv() must not fail, because there's
 	 * nothing left for it to return an error to.
+	 *
+	 * Any async I/O rings are in the old address space and go with
+	 * it; if they still have I/O outstanding they keep it until
+	 * that's done. (A vfork child can't have any.)
 	 */
-	if (oldvm) {
+	if (curproc->p_vforksem != NULL) {
+		KASSERT(curproc->p_uring == NULL);
+		proc_vforkdone(curproc);
+	}
+	else if (oldvm && !uring_release(curproc, oldvm)) {
 		as_destroy(oldvm);
 	}
 
@@ -431,7 +665,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -558,8 +796,21 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	struct argbuf kargv;
 	vaddr_t entrypoint, stackptr;
 	int argc;
+	unsigned nthreads;
 	int result;
 
+	/*
+	 * We have no way to stop the other threads of a multithreaded
+	 * process, so refuse. While we're the only thread, no more can
+	 * appear, since only threads in this process can create them.
+	 */
+	lock_acquire(curproc->p_threadslock);
+	nthreads = threadarray_num(&curproc->p_threads);
+	lock_release(curproc->p_threadslock);
+	if (nthreads > 1) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -594,6 +845,14 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	/* don't need this any more */
 	kfree(path);
 
+	/* The old thread table went with the old address space. */
+	lock_acquire(curproc->p_utlock);
+	if (curproc->p_uthreads != NULL) {
+		kfree(curproc->p_uthreads);
+		curproc->p_uthreads = NULL;
+	}
+	lock_release(curproc->p_utlock);
+
 	/* Send the argv strings to the process. */
 	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
 	if (result) {
@@ -611,3 +870,275 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	panic("enter_new_process returned\n");
 	return EINVAL;
 }
+
+/*
+ * Everything spawn needs, copied in from the caller, and a place for
+ * the new process to leave the result of loading the program.
+ */
+struct spawninfo {
+	char *si_path;
+	struct argbuf si_argv;
+	struct spawn_fdaction *si_acts;
+	char **si_actpaths;
+	int si_nacts;
+	struct semaphore *si_done;
+	int si_result;
+};
+
+static
+void
+spawninfo_cleanup(struct spawninfo *si)
+{
+	int i;
+
+	if (si->si_actpaths != NULL) {
+		for (i=0; i<si->si_nacts; i++) {
+			if (si->si_actpaths[i] != NULL) {
+				kfree(si->si_actpaths[i]);
+			}
+		}
+		kfree(si->si_actpaths);
+	}
+	if (si->si_acts != NULL) {
+		kfree(si->si_acts);
+	}
+	argbuf_cleanup(&si->si_argv);
+	if (si->si_path != NULL) {
+		kfree(si->si_path);
+	}
+	if (si->si_done != NULL) {
+		sem_destroy(si->si_done);
+	}
+}
+
+/*
+ * Copy in the file actions for spawn, and the paths to open.
+ */
+static
+int
+spawninfo_copyinacts(struct spawninfo *si, userptr_t uacts)
+{
+	struct spawn_fdaction *sfa;
+	int i, result;
+
+	si->si_acts = kmalloc(si->si_nacts * sizeof(*si->si_acts));
+	si->si_actpaths = kmalloc(si->si_nacts * sizeof(char *));
+	if (si->si_acts == NULL || si->si_actpaths == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<si->si_nacts; i++) {
+		si->si_actpaths[i] = NULL;
+	}
+
+	result = copyin(uacts, si->si_acts,
+			si->si_nacts * sizeof(*si->si_acts));
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<si->si_nacts; i++) {
+		sfa = &si->si_acts[i];
+		switch (sfa->sfa_op) {
+		    case SPAWN_FDA_CLOSE:
+		    case SPAWN_FDA_DUP2:
+			break;
+		    case SPAWN_FDA_OPEN:
+			si->si_actpaths[i] = kmalloc(PATH_MAX);
+			if (si->si_actpaths[i] == NULL) {
+				return ENOMEM;
+			}
+			result = copyinstr(sfa->sfa_path, si->si_actpaths[i],
+					   PATH_MAX, NULL);
+			if (result) {
+				return result;
+			}
+			break;
+		    default:
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Carry out the file actions, in the new process.
+ */
+static
+int
+spawn_fdactions(struct spawninfo *si)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct spawn_fdaction *sfa;
+	struct openfile *file, *oldfile;
+	int i, junk, result;
+
+	for (i=0; i<si->si_nacts; i++) {
+		sfa = &si->si_acts[i];
+		switch (sfa->sfa_op) {
+		    case SPAWN_FDA_CLOSE:
+			result = sys_close(sfa->sfa_fd);
+			break;
+		    case SPAWN_FDA_DUP2:
+			result = sys_dup2(sfa->sfa_oldfd, sfa->sfa_fd, &junk);
+			break;
+		    case SPAWN_FDA_OPEN:
+			if (!filetable_okfd(ft, sfa->sfa_fd)) {
+				return EBADF;
+			}
+			result = openfile_open(si->si_actpaths[i],
+					       sfa->sfa_flags, sfa->sfa_mode,
+					       &file);
+			if (result) {
+				break;
+			}
+			result = filetable_placeat(ft, file, sfa->sfa_fd,
+						   &oldfile);
+			if (result) {
+				openfile_decref(file);
+			}
+			else if (oldfile != NULL) {
+				openfile_decref(oldfile);
+			}
+			break;
+		    default:
+			/* spawninfo_copyinacts checked */
+			panic("spawn: bad file action %d\n", sfa->sfa_op);
+		}
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The new process starts here. Once it has told the parent how it
+ * went, the spawninfo (which is on the parent's stack) is gone.
+ */
+static
+void
+spawn_newthread(void *vsi, unsigned long junk)
+{
+	struct spawninfo *si = vsi;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int argc;
+	int result;
+
+	(void)junk;
+
+	result = spawn_fdactions(si);
+	if (result == 0) {
+		result = loadexec(si->si_path, &entrypoint, &stackptr);
+	}
+	if (result == 0) {
+		result = argbuf_copyout(&si->si_argv, &stackptr,
+					&argc, &uargv);
+		if (result) {
+			/* If copyout fails, *we* messed up, so panic */
+			panic("spawn: copyout_args failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	si->si_result = result;
+	V(si->si_done);
+
+	if (result) {
+		/* The parent collects us. */
+		proc_exit(_MKWAIT_EXIT(255));
+		panic("proc_exit returned\n");
+	}
+
+	/* Warp to user mode. */
+	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+}
+
+/*
+ * spawn.
+ *
+ * Start a new process running PROG with argument vector UARGV, after
+ * applying NACTS file actions from UACTS to its copy of our file
+ * table. This is fork and execv in one, without ever copying our
+ * address space. The program is loaded in the new process, but we
+ * wait until that's done, so if it fails we get the error; in that
+ * case we also collect the new process, so the caller never sees it.
+ */
+int
+sys___spawn(userptr_t prog, userptr_t uargv, userptr_t uacts, int nacts,
+	    pid_t *retval)
+{
+	struct spawninfo si;
+	struct proc *newproc;
+	pid_t pid;
+	int result;
+
+	if (nacts < 0 || nacts > SPAWN_MAXACTIONS) {
+		return EINVAL;
+	}
+
+	si.si_path = NULL;
+	argbuf_init(&si.si_argv);
+	si.si_acts = NULL;
+	si.si_actpaths = NULL;
+	si.si_nacts = nacts;
+	si.si_done = NULL;
+	si.si_result = 0;
+
+	si.si_path = kmalloc(PATH_MAX);
+	if (si.si_path == NULL) {
+		result = ENOMEM;
+		goto done;
+	}
+	result = copyinstr(prog, si.si_path, PATH_MAX, NULL);
+	if (result) {
+		goto done;
+	}
+
+	result = argbuf_fromuser(&si.si_argv, uargv);
+	if (result) {
+		goto done;
+	}
+
+	if (nacts > 0) {
+		result = spawninfo_copyinacts(&si, uacts);
+		if (result) {
+			goto done;
+		}
+	}
+
+	si.si_done = sem_create("spawn", 0);
+	if (si.si_done == NULL) {
+		result = ENOMEM;
+		goto done;
+	}
+
+	result = proc_fork_noas(si.si_path, &newproc);
+	if (result) {
+		goto done;
+	}
+	pid = newproc->p_pid;
+
+	result = thread_fork(si.si_path, newproc, spawn_newthread, &si, 0);
+	if (result) {
+		proc_unfork(newproc);
+		goto done;
+	}
+
+	P(si.si_done);
+	result = si.si_result;
+	if (result) {
+		/* It exits right away; don't leave it for the caller. */
+		pid_wait(pid, NULL, 0, NULL);
+	}
+	else {
+		*retval = pid;
+	}
+
+ done:
+	spawninfo_cleanup(&si);
+	return result;
+}
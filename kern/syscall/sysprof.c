@@ -0,0 +1,261 @@
+/*
+ * System call profiler. See sysprof.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/sysprof.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <sysprof.h>
+
+/* The cpu affinity masks are 32 bits wide, so there can't be more. */
+#define SYSPROF_MAXCPUS	32
+
+/* Each cpu's counters, indexed by call number. */
+static struct sysprof_stat *sysprof_cpus[SYSPROF_MAXCPUS];
+static unsigned sysprof_ncpus;
+
+/*
+ * Called from cpu_create, while large allocations still work.
+ */
+void
+sysprof_cpu_init(unsigned cpunum)
+{
+	struct sysprof_stat *stats;
+
+	KASSERT(cpunum < SYSPROF_MAXCPUS);
+	stats = kmalloc(SYSPROF_NCALLS * sizeof(*stats));
+	if (stats == NULL) {
+		panic("sysprof_cpu_init: Out of memory\n");
+	}
+	bzero(stats, SYSPROF_NCALLS * sizeof(*stats));
+	sysprof_cpus[cpunum] = stats;
+	if (cpunum >= sysprof_ncpus) {
+		sysprof_ncpus = cpunum + 1;
+	}
+}
+
+void
+sysprof_start(struct sysprof_timer *t, int callno)
+{
+	t->t_callno = callno;
+	t->t_start = cpu_getcycles();
+}
+
+/*
+ * Histogram bucket for a call that took CYCLES: the log base 2.
+ */
+static
+unsigned
+sysprof_bucket(uint32_t cycles)
+{
+	unsigned b = 0;
+
+	while (cycles > 1) {
+		cycles >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void
+sysprof_end(struct sysprof_timer *t, int err)
+{
+	struct sysprof_stat *st;
+	uint32_t cycles;
+	int spl;
+
+	cycles = cpu_getcycles() - t->t_start;
+	if (t->t_callno < 0 || t->t_callno >= SYSPROF_NCALLS) {
+		return;
+	}
+
+	/* With interrupts off we stay on this cpu and nobody else runs. */
+	spl = splhigh();
+	st = &sysprof_cpus[curcpu->c_number][t->t_callno];
+	st->sps_calls++;
+	if (err) {
+		st->sps_errors++;
+	}
+	st->sps_cycles += cycles;
+	st->sps_hist[sysprof_bucket(cycles)]++;
+	splx(spl);
+}
+
+/*
+ * Add up all the cpus' counters for CALLNO. The counters are read
+ * while other cpus may be updating them, so this is a snapshot that
+ * may be slightly torn on a busy system.
+ */
+static
+void
+sysprof_sum(int callno, struct sysprof_stat *ret)
+{
+	const struct sysprof_stat *st;
+	unsigned i, b;
+
+	bzero(ret, sizeof(*ret));
+	for (i=0; i<sysprof_ncpus; i++) {
+		if (sysprof_cpus[i] == NULL) {
+			continue;
+		}
+		st = &sysprof_cpus[i][callno];
+		ret->sps_calls += st->sps_calls;
+		ret->sps_errors += st->sps_errors;
+		ret->sps_cycles += st->sps_cycles;
+		for (b=0; b<SYSPROF_NBUCKETS; b++) {
+			ret->sps_hist[b] += st->sps_hist[b];
+		}
+	}
+}
+
+/*
+ * Zero all the counters. This races with updates on other cpus too,
+ * which is fine for statistics.
+ */
+void
+sysprof_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<sysprof_ncpus; i++) {
+		if (sysprof_cpus[i] != NULL) {
+			bzero(sysprof_cpus[i],
+			      SYSPROF_NCALLS * sizeof(struct sysprof_stat));
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Reporting
+
+/*
+ * One line of the report. There's one per call number; they're
+ * static because the table is too big for the stack or, after boot,
+ * for kmalloc. Only the menu thread prints.
+ */
+struct sysprof_report {
+	int r_callno;
+	unsigned r_calls;
+	unsigned r_errors;
+	uint64_t r_cycles;
+	unsigned r_p50;		/* bucket holding the median */
+	unsigned r_p99;		/* bucket holding the 99th percentile */
+};
+
+static struct sysprof_report sysprof_reports[SYSPROF_NCALLS];
+
+/*
+ * The histogram bucket that the PCTth percentile call falls in.
+ */
+static
+unsigned
+sysprof_percentile(const struct sysprof_stat *st, unsigned pct)
+{
+	uint64_t want, seen;
+	unsigned b;
+
+	want = DIVROUNDUP((uint64_t)st->sps_calls * pct, 100);
+	seen = 0;
+	for (b=0; b<SYSPROF_NBUCKETS - 1; b++) {
+		seen += st->sps_hist[b];
+		if (seen >= want) {
+			break;
+		}
+	}
+	return b;
+}
+
+/*
+ * Print the MAX calls that took the most time in all, worst first.
+ * Percentiles are given as the top of their histogram bucket, so
+ * they're only good to within a factor of 2.
+ */
+void
+sysprof_print(unsigned max)
+{
+	struct sysprof_stat st;
+	struct sysprof_report *r, tmp;
+	unsigned num, i, j;
+	int callno;
+
+	num = 0;
+	for (callno=0; callno<SYSPROF_NCALLS; callno++) {
+		sysprof_sum(callno, &st);
+		if (st.sps_calls == 0) {
+			continue;
+		}
+		r = &sysprof_reports[num++];
+		r->r_callno = callno;
+		r->r_calls = st.sps_calls;
+		r->r_errors = st.sps_errors;
+		r->r_cycles = st.sps_cycles;
+		r->r_p50 = sysprof_percentile(&st, 50);
+		r->r_p99 = sysprof_percentile(&st, 99);
+	}
+
+	/* Sort by total time; it's not a long list. */
+	for (i=1; i<num; i++) {
+		for (j=i; j>0 && sysprof_reports[j].r_cycles >
+			     sysprof_reports[j-1].r_cycles; j--) {
+			tmp = sysprof_reports[j];
+			sysprof_reports[j] = sysprof_reports[j-1];
+			sysprof_reports[j-1] = tmp;
+		}
+	}
+
+	kprintf("%7s %10s %10s %14s %10s %10s %10s\n", "syscall", "calls",
+		"errors", "total", "avg", "p50 <", "p99 <");
+	for (i=0; i<num && i<max; i++) {
+		r = &sysprof_reports[i];
+		kprintf("%7d %10u %10u %14llu %10llu %10llu %10llu\n",
+			r->r_callno, r->r_calls, r->r_errors,
+			(unsigned long long)r->r_cycles,
+			(unsigned long long)(r->r_cycles / r->r_calls),
+			2ULL << r->r_p50, 2ULL << r->r_p99);
+	}
+	kprintf("(times are in cycles; see <kern/syscall.h> for the "
+		"call numbers)\n");
+}
+
+////////////////////////////////////////////////////////////
+// System call
+
+/*
+ * sysprof
+ *
+ * Copy out the counters for the first NSTATS call numbers (or all of
+ * them, if there are fewer) to STATS, and then zero them if FLAGS
+ * says so. Returns the number of call numbers profiled, so it can be
+ * called with NSTATS 0 to find out how big an array to use.
+ */
+int
+sys_sysprof(userptr_t stats, unsigned nstats, int flags, int *retval)
+{
+	struct sysprof_stat st;
+	unsigned callno;
+	int result;
+
+	if ((flags & ~SYSPROF_RESET) != 0) {
+		return EINVAL;
+	}
+
+	for (callno=0; callno<nstats && callno<SYSPROF_NCALLS; callno++) {
+		sysprof_sum(callno, &st);
+		result = copyout(&st, stats + callno * sizeof(st), sizeof(st));
+		if (result) {
+			return result;
+		}
+	}
+	if (flags & SYSPROF_RESET) {
+		sysprof_reset();
+	}
+
+	*retval = SYSPROF_NCALLS;
+	return 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * User-level thread syscalls.
+ *
+ * Each user thread is a kernel thread in the same process, so it
+ * shares the address space, file table, and everything else; all it
+ * gets of its own is a user stack. The bookkeeping is the process's
+ * uthread table (see proc.h), protected by p_utlock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* What a new thread needs to get to user mode. */
+struct uthread_start {
+	struct uthread *us_ut;
+	vaddr_t us_entry;
+	userptr_t us_arg0;
+	userptr_t us_arg1;
+	vaddr_t us_stack;
+	vaddr_t us_gp;
+};
+
+/*
+ * Set up the thread table for the current process, which so far has
+ * just the one thread. That thread's entry is the one that goes with
+ * the stack it's on: usually the main stack, but not if the process
+ * was forked from another thread. Nothing can join it, as nobody
+ * knows its thread id.
+ */
+static
+int
+uthread_inittable(struct proc *proc, vaddr_t sp)
+{
+	struct uthread *table;
+	unsigned i, slot;
+
+	KASSERT(lock_do_i_hold(proc->p_utlock));
+
+	table = kmalloc(PROC_UTHREADS_MAX * sizeof(*table));
+	if (table == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<PROC_UTHREADS_MAX; i++) {
+		table[i].ut_tid = 0;
+		table[i].ut_thread = NULL;
+		table[i].ut_exited = false;
+		table[i].ut_detached = false;
+		table[i].ut_joining = false;
+		table[i].ut_result = NULL;
+	}
+
+	slot = 0;
+	if (sp <= USERSTACK) {
+		slot = (USERSTACK - sp) / THREADSTACK_STRIDE;
+		if (slot >= PROC_UTHREADS_MAX) {
+			/* Some stack of its own; call it the main one. */
+			slot = 0;
+		}
+	}
+	table[slot].ut_tid = proc->p_nexttid++;
+	table[slot].ut_thread = curthread;
+	table[slot].ut_detached = true;
+
+	proc->p_uthreads = table;
+	return 0;
+}
+
+/*
+ * Pick a thread id that isn't in use.
+ */
+static
+int
+uthread_newtid(struct proc *proc)
+{
+	unsigned i;
+	int tid;
+
+ again:
+	tid = proc->p_nexttid++;
+	if (proc->p_nexttid <= 0) {
+		proc->p_nexttid = 1;
+	}
+	for (i=0; i<PROC_UTHREADS_MAX; i++) {
+		if (proc->p_uthreads[i].ut_tid == tid) {
+			goto again;
+		}
+	}
+	return tid;
+}
+
+/*
+ * The new thread starts here.
+ */
+static
+void
+uthread_newthread(void *vus, unsigned long junk)
+{
+	struct uthread_start us;
+	struct proc *proc = curproc;
+
+	(void)junk;
+
+	us = *(struct uthread_start *)vus;
+	kfree(vus);
+
+	lock_acquire(proc->p_utlock);
+	us.us_ut->ut_thread = curthread;
+	lock_release(proc->p_utlock);
+
+	enter_new_thread(us.us_arg0, us.us_arg1, us.us_stack, us.us_gp,
+			 us.us_entry);
+}
+
+/*
+ * sys___thread_create
+ *
+ * Start a new thread in the current process that calls START(ARG0,
+ * ARG1) on a stack of its own. (Normally START is a libc routine that
+ * calls the real function and passes what it returns to thread_exit.)
+ * Returns the new thread's id. CALLERSP is the caller's user stack
+ * pointer; CALLERGP is its global pointer, which the new thread
+ * shares.
+ */
+int
+sys___thread_create(userptr_t start, userptr_t arg0, userptr_t arg1,
+		    int flags, vaddr_t callersp, vaddr_t callergp,
+		    int *retval)
+{
+	struct proc *proc = curproc;
+	struct uthread_start *us;
+	struct uthread *ut;
+	unsigned slot;
+	int result;
+
+	if (flags & ~THREAD_CREATE_DETACHED) {
+		return EINVAL;
+	}
+
+	us = kmalloc(sizeof(*us));
+	if (us == NULL) {
+		return ENOMEM;
+	}
+	us->us_entry = (vaddr_t)start;
+	us->us_arg0 = arg0;
+	us->us_arg1 = arg1;
+	us->us_gp = callergp;
+
+	lock_acquire(proc->p_utlock);
+
+	if (proc->p_uthreads == NULL) {
+		result = uthread_inittable(proc, callersp);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	for (slot=0; slot<PROC_UTHREADS_MAX; slot++) {
+		if (proc->p_uthreads[slot].ut_tid == 0) {
+			break;
+		}
+	}
+	if (slot == PROC_UTHREADS_MAX) {
+		result = EAGAIN;
+		goto fail;
+	}
+
+	if (slot == 0) {
+		/* The main stack always exists. */
+		us->us_stack = USERSTACK;
+	}
+	else {
+		result = as_define_threadstack(proc_getas(), slot,
+					       &us->us_stack);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	ut = &proc->p_uthreads[slot];
+	ut->ut_tid = uthread_newtid(proc);
+	ut->ut_thread = NULL;
+	ut->ut_exited = false;
+	ut->ut_detached = (flags & THREAD_CREATE_DETACHED) != 0;
+	ut->ut_joining = false;
+	ut->ut_result = NULL;
+
+	us->us_ut = ut;
+
+	/* Hold p_utlock until it's in p_threads; see proc_thread_exit. */
+	result = thread_fork(curthread->t_name, proc,
+			     uthread_newthread, us, 0);
+	if (result) {
+		ut->ut_tid = 0;
+		goto fail;
+	}
+
+	*retval = ut->ut_tid;
+	lock_release(proc->p_utlock);
+	return 0;
+
+ fail:
+	lock_release(proc->p_utlock);
+	kfree(us);
+	return result;
+}
+
+/*
+ * sys_thread_exit
+ *
+ * Make the current thread go away, leaving RESULT for thread_join.
+ */
+void
+sys_thread_exit(userptr_t result)
+{
+	proc_thread_exit(result);
+}
+
+/*
+ * sys_thread_join
+ *
+ * Wait for thread TID to exit, and collect the value it passed to
+ * thread_exit. Like waitpid, each thread can be joined only once,
+ * and only by one thread at a time.
+ */
+int
+sys_thread_join(int tid, userptr_t resultp)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	userptr_t value;
+	unsigned i;
+
+	lock_acquire(proc->p_utlock);
+
+	ut = NULL;
+	if (tid > 0 && proc->p_uthreads != NULL) {
+		for (i=0; i<PROC_UTHREADS_MAX; i++) {
+			if (proc->p_uthreads[i].ut_tid == tid) {
+				ut = &proc->p_uthreads[i];
+				break;
+			}
+		}
+	}
+	if (ut == NULL) {
+		lock_release(proc->p_utlock);
+		return ESRCH;
+	}
+	if (ut->ut_thread == curthread || ut->ut_detached || ut->ut_joining) {
+		lock_release(proc->p_utlock);
+		return EINVAL;
+	}
+
+	ut->ut_joining = true;
+	while (!ut->ut_exited) {
+		cv_wait(proc->p_utcv, proc->p_utlock);
+	}
+	value = ut->ut_result;
+	ut->ut_tid = 0;
+	ut->ut_joining = false;
+
+	lock_release(proc->p_utlock);
+
+	if (resultp != NULL) {
+		return copyout(&value, resultp, sizeof(value));
+	}
+	return 0;
+}
@@ -0,0 +1,660 @@
+/*
+ * Asynchronous I/O rings; see <kern/uring.h> for the layout the
+ * process sees.
+ *
+ * The ring pages are looked up by kernel address once, at setup, and
+ * each read or write has its buffer pages looked up when it's
+ * submitted. As with pipe page lending, those addresses stay good
+ * until the address space is destroyed. So the worker threads, which
+ * belong to the kernel and not to the process, can do the I/O without
+ * being in the process's address space.
+ *
+ * When the process exits or execs with operations still outstanding,
+ * it doesn't wait for them, as some (reading the console, say) may
+ * never finish. Instead the rings take over the old address space
+ * and destroy it when the last operation completes.
+ *
+ * Submitted operations go on one queue for the whole system. An
+ * operation that blocks indefinitely (reading an empty pipe, say)
+ * ties up its worker until it's done, so the pool of workers grows
+ * whenever there's more queued than idle workers to take it, up to
+ * URING_MAXWORKERS per CPU, and shrinks back to URING_NWORKERS as the
+ * extra ones run out of work. Past the maximum, operations wait on
+ * the queue for a worker to come free, so enough operations that
+ * never finish can hold up everyone's.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/uring.h>
+#include <lib.h>
+#include <membar.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <uio.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <syscall.h>
+
+/* Number of worker threads kept around when there's nothing to do. */
+#define URING_NWORKERS	4
+
+/* Most worker threads there can be, per CPU. */
+#define URING_MAXWORKERS	16
+
+/* Most pages a ring, and one operation's buffer, can span. */
+#define URING_NPAGES	(URING_SIZE(URING_MAXENTRIES) / URING_PAGESIZE)
+#define URING_IOPAGES	(URING_MAXIO / PAGE_SIZE + 1)
+
+/*
+ * A process's rings. The process can scribble on the shared header,
+ * so we keep our own copies of the indexes only we advance.
+ */
+struct uring {
+	struct lock *ur_lock;		/* lock for the rest */
+	struct cv *ur_cv;		/* broadcast on each completion */
+	unsigned ur_entries;		/* size of each queue */
+	vaddr_t ur_pages[URING_NPAGES];	/* kernel addresses of the memory */
+	unsigned ur_sqhead;		/* our sq_head */
+	unsigned ur_cqtail;		/* our cq_tail */
+	unsigned ur_inflight;		/* submitted and not completed */
+	struct addrspace *ur_as;	/* the process is gone; destroy this */
+};
+
+/* A submitted operation, ready for a worker. */
+struct uring_op {
+	struct uring_op *uo_next;	/* on the work queue */
+	struct uring *uo_ring;		/* where the completion goes */
+	struct openfile *uo_file;	/* our own reference */
+	int uo_op;			/* URING_OP_* */
+	off_t uo_pos;			/* position, or -1 */
+	uint32_t uo_data;		/* for the completion */
+	size_t uo_len;			/* size of the buffer */
+	vaddr_t uo_offset;		/* where it starts in the first page */
+	unsigned uo_npages;		/* how many pages it spans */
+	vaddr_t uo_pages[URING_IOPAGES]; /* kernel addresses of the pages */
+};
+
+static struct lock *uring_qlock;
+static struct cv *uring_qcv;
+static struct uring_op *uring_qhead;
+static struct uring_op **uring_qtailp;
+static unsigned uring_nqueued;		/* operations on the queue */
+static unsigned uring_nworkers;		/* worker threads */
+static unsigned uring_nidle;		/* workers waiting for work */
+
+/*
+ * Kernel address of OFFSET bytes into the shared memory. Nothing we
+ * look at through this crosses a page boundary.
+ */
+static
+void *
+uring_addr(struct uring *ur, size_t offset)
+{
+	return (void *)(ur->ur_pages[offset / PAGE_SIZE] + offset % PAGE_SIZE);
+}
+
+/*
+ * Number of completions the process hasn't consumed yet.
+ */
+static
+unsigned
+uring_cqpending(struct uring *ur)
+{
+	struct uring_hdr *hdr = uring_addr(ur, 0);
+	unsigned pending;
+
+	pending = ur->ur_cqtail - hdr->cq_head;
+	if (pending > ur->ur_entries) {
+		/* cq_head is nonsense; treat the queue as full */
+		pending = ur->ur_entries;
+	}
+	return pending;
+}
+
+/*
+ * Put a completion on the completion queue.
+ */
+static
+void
+uring_post(struct uring *ur, uint32_t data, int res)
+{
+	struct uring_hdr *hdr = uring_addr(ur, 0);
+	struct uring_cqe *cqe;
+
+	KASSERT(lock_do_i_hold(ur->ur_lock));
+
+	cqe = uring_addr(ur, URING_CQOFFSET(ur->ur_entries) +
+			 (ur->ur_cqtail % ur->ur_entries) * sizeof(*cqe));
+	cqe->cqe_data = data;
+	cqe->cqe_res = res;
+
+	/* The entry must be there before the process can see it. */
+	membar_store_store();
+	ur->ur_cqtail++;
+	hdr->cq_tail = ur->ur_cqtail;
+
+	cv_broadcast(ur->ur_cv, ur->ur_lock);
+}
+
+/*
+ * Check a submission and turn it into an operation for a worker.
+ * Returns NULL in *RET if there's nothing for a worker to do.
+ */
+static
+int
+uring_prepare(struct uring *ur, const struct uring_sqe *sqe,
+	      struct uring_op **ret)
+{
+	struct uring_op *op;
+	vaddr_t base;
+	unsigned i;
+	int result;
+
+	if (sqe->sqe_flags != 0) {
+		return EINVAL;
+	}
+	switch (sqe->sqe_op) {
+	    case URING_OP_NOP:
+		*ret = NULL;
+		return 0;
+	    case URING_OP_READ:
+	    case URING_OP_WRITE:
+	    case URING_OP_FSYNC:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	op = kmalloc(sizeof(*op));
+	if (op == NULL) {
+		return ENOMEM;
+	}
+	op->uo_next = NULL;
+	op->uo_ring = ur;
+	op->uo_op = sqe->sqe_op;
+	op->uo_pos = sqe->sqe_pos;
+	op->uo_data = sqe->sqe_data;
+	op->uo_len = 0;
+	op->uo_offset = 0;
+	op->uo_npages = 0;
+
+	result = filetable_get(curproc->p_filetable, sqe->sqe_fd,
+			       &op->uo_file);
+	if (result) {
+		kfree(op);
+		return result;
+	}
+
+	if (op->uo_op == URING_OP_FSYNC) {
+		*ret = op;
+		return 0;
+	}
+
+	if (op->uo_file->of_accmode ==
+	    (op->uo_op == URING_OP_READ ? O_WRONLY : O_RDONLY)) {
+		result = EBADF;
+		goto fail;
+	}
+	if (op->uo_pos < -1) {
+		result = EINVAL;
+		goto fail;
+	}
+	if (op->uo_pos >= 0 && !VOP_ISSEEKABLE(op->uo_file->of_vnode)) {
+		result = ESPIPE;
+		goto fail;
+	}
+
+	op->uo_len = sqe->sqe_len;
+	if (op->uo_len > URING_MAXIO) {
+		op->uo_len = URING_MAXIO;
+	}
+	base = (vaddr_t)sqe->sqe_buf;
+	op->uo_offset = base % PAGE_SIZE;
+	op->uo_npages = (op->uo_offset + op->uo_len + PAGE_SIZE - 1) / PAGE_SIZE;
+	for (i=0; i<op->uo_npages; i++) {
+		/* reading from the file means writing to the buffer */
+		result = vm_getkpage((base & PAGE_FRAME) + i * PAGE_SIZE,
+				     op->uo_op == URING_OP_READ,
+				     &op->uo_pages[i]);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	*ret = op;
+	return 0;
+
+ fail:
+	filetable_put(curproc->p_filetable, sqe->sqe_fd, op->uo_file);
+	kfree(op);
+	return result;
+}
+
+/*
+ * Do a read or write, and put the amount transferred in *DONE.
+ */
+static
+int
+uring_doio(struct uring_op *op, size_t *done)
+{
+	struct iovec iov[URING_IOPAGES];
+	struct uio ku;
+	struct vnode *vn = op->uo_file->of_vnode;
+	size_t len;
+	unsigned i;
+	bool locked;
+	int result;
+
+	len = op->uo_len;
+	for (i=0; i<op->uo_npages; i++) {
+		iov[i].iov_kbase = (void *)op->uo_pages[i];
+		iov[i].iov_len = PAGE_SIZE;
+		if (i == 0) {
+			iov[i].iov_kbase = (char *)iov[i].iov_kbase +
+				op->uo_offset;
+			iov[i].iov_len -= op->uo_offset;
+		}
+		if (iov[i].iov_len > len) {
+			iov[i].iov_len = len;
+		}
+		len -= iov[i].iov_len;
+	}
+	if (op->uo_npages == 0) {
+		/* zero-length; still give the file an iovec to look at */
+		iov[0].iov_kbase = NULL;
+		iov[0].iov_len = 0;
+	}
+
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = op->uo_npages > 0 ? op->uo_npages : 1;
+	ku.uio_resid = op->uo_len;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = op->uo_op == URING_OP_READ ? UIO_READ : UIO_WRITE;
+	ku.uio_space = NULL;
+
+	/* As in read and write, only lock the seek position if it's used. */
+	locked = op->uo_pos < 0 && VOP_ISSEEKABLE(vn);
+	if (locked) {
+		lock_acquire(op->uo_file->of_offsetlock);
+		ku.uio_offset = op->uo_file->of_offset;
+	}
+	else {
+		ku.uio_offset = op->uo_pos < 0 ? 0 : op->uo_pos;
+	}
+
+	result = (ku.uio_rw == UIO_READ) ?
+		VOP_READ(vn, &ku) :
+		VOP_WRITE(vn, &ku);
+
+	if (locked) {
+		if (result == 0) {
+			op->uo_file->of_offset = ku.uio_offset;
+		}
+		lock_release(op->uo_file->of_offsetlock);
+	}
+
+	*done = op->uo_len - ku.uio_resid;
+	return result;
+}
+
+/*
+ * Free a ring, and the address space it was left with, if any.
+ */
+static
+void
+uring_destroy(struct uring *ur)
+{
+	KASSERT(ur->ur_inflight == 0);
+
+	if (ur->ur_as != NULL) {
+		as_destroy(ur->ur_as);
+	}
+	cv_destroy(ur->ur_cv);
+	lock_destroy(ur->ur_lock);
+	kfree(ur);
+}
+
+/*
+ * Worker thread: take operations off the queue until there are none
+ * and there are more workers than we keep idle.
+ */
+static
+void
+uring_worker(void *junk1, unsigned long junk2)
+{
+	struct uring_op *op;
+	struct uring *ur;
+	size_t done;
+	bool orphaned;
+	int result;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+		lock_acquire(uring_qlock);
+		while (uring_qhead == NULL) {
+			if (uring_nworkers > URING_NWORKERS) {
+				uring_nworkers--;
+				lock_release(uring_qlock);
+				return;
+			}
+			uring_nidle++;
+			cv_wait(uring_qcv, uring_qlock);
+			uring_nidle--;
+		}
+		op = uring_qhead;
+		uring_qhead = op->uo_next;
+		if (uring_qhead == NULL) {
+			uring_qtailp = &uring_qhead;
+		}
+		uring_nqueued--;
+		lock_release(uring_qlock);
+
+		done = 0;
+		if (op->uo_op == URING_OP_FSYNC) {
+			result = VOP_FSYNC(op->uo_file->of_vnode);
+		}
+		else {
+			result = uring_doio(op, &done);
+		}
+		openfile_decref(op->uo_file);
+
+		/*
+		 * If the process is gone, nobody will see the
+		 * completion, and the last one out cleans up.
+		 */
+		ur = op->uo_ring;
+		lock_acquire(ur->ur_lock);
+		uring_post(ur, op->uo_data, result ? -result : (int)done);
+		KASSERT(ur->ur_inflight > 0);
+		ur->ur_inflight--;
+		orphaned = ur->ur_as != NULL && ur->ur_inflight == 0;
+		lock_release(ur->ur_lock);
+
+		if (orphaned) {
+			uring_destroy(ur);
+		}
+		kfree(op);
+	}
+}
+
+/*
+ * Start another worker, unless there are as many as we allow.
+ */
+static
+int
+uring_addworker(void)
+{
+	int result;
+
+	/* Count it first, as it might go looking for work right away. */
+	lock_acquire(uring_qlock);
+	if (uring_nworkers >= URING_MAXWORKERS * thread_numcpus()) {
+		lock_release(uring_qlock);
+		return EAGAIN;
+	}
+	uring_nworkers++;
+	lock_release(uring_qlock);
+
+	result = thread_fork("uring", NULL, uring_worker, NULL, 0);
+	if (result) {
+		lock_acquire(uring_qlock);
+		uring_nworkers--;
+		lock_release(uring_qlock);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Hand an operation to the workers, starting a new one if they're
+ * all busy. If that fails, or there are already as many workers as
+ * we allow, it waits for one of the others.
+ */
+static
+void
+uring_queue(struct uring_op *op)
+{
+	bool more;
+
+	lock_acquire(uring_qlock);
+	*uring_qtailp = op;
+	uring_qtailp = &op->uo_next;
+	uring_nqueued++;
+	more = uring_nqueued > uring_nidle;
+	cv_signal(uring_qcv, uring_qlock);
+	lock_release(uring_qlock);
+
+	if (more) {
+		(void)uring_addworker();
+	}
+}
+
+/*
+ * Set up the work queue and start the workers.
+ */
+void
+uring_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	COMPILE_ASSERT(URING_PAGESIZE == PAGE_SIZE);
+
+	uring_qlock = lock_create("uring");
+	uring_qcv = cv_create("uring");
+	if (uring_qlock == NULL || uring_qcv == NULL) {
+		panic("uring_bootstrap: out of memory\n");
+	}
+	uring_qhead = NULL;
+	uring_qtailp = &uring_qhead;
+	uring_nqueued = 0;
+	uring_nworkers = 0;
+	uring_nidle = 0;
+
+	for (i=0; i<URING_NWORKERS; i++) {
+		result = uring_addworker();
+		if (result) {
+			panic("uring_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+/*
+ * Get rid of PROC's rings, which are in AS, the address space it's
+ * giving up (it must no longer be current). If nothing's outstanding
+ * that's all; otherwise the rings take AS, and destroy it once the
+ * rest is done. Returns true in that case, and then the caller must
+ * not destroy AS itself.
+ */
+bool
+uring_release(struct proc *proc, struct addrspace *as)
+{
+	struct uring *ur;
+	bool keep;
+
+	spinlock_acquire(&proc->p_lock);
+	ur = proc->p_uring;
+	proc->p_uring = NULL;
+	spinlock_release(&proc->p_lock);
+
+	if (ur == NULL) {
+		return false;
+	}
+	KASSERT(as != NULL);
+
+	lock_acquire(ur->ur_lock);
+	keep = ur->ur_inflight > 0;
+	if (keep) {
+		ur->ur_as = as;
+	}
+	lock_release(ur->ur_lock);
+
+	if (!keep) {
+		uring_destroy(ur);
+	}
+	return keep;
+}
+
+/*
+ * sys_uring_setup
+ *
+ * Set up rings of ENTRIES entries in the URING_SIZE(ENTRIES) bytes at
+ * MEM. A process can have only one set of rings, which lasts until it
+ * exits or execs. A vfork child can't have any, as its memory is its
+ * parent's and the rings might outlive its use of it.
+ */
+int
+sys_uring_setup(userptr_t mem, unsigned entries)
+{
+	struct proc *proc = curproc;
+	struct uring *ur;
+	struct uring_hdr *hdr;
+	unsigned i, npages;
+	int result;
+
+	if (entries == 0 || entries > URING_MAXENTRIES ||
+	    (entries & (entries - 1)) != 0) {
+		return EINVAL;
+	}
+	if ((vaddr_t)mem % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	if (proc->p_vforksem != NULL) {
+		return EINVAL;
+	}
+
+	ur = kmalloc(sizeof(*ur));
+	if (ur == NULL) {
+		return ENOMEM;
+	}
+	ur->ur_lock = lock_create("uring");
+	if (ur->ur_lock == NULL) {
+		kfree(ur);
+		return ENOMEM;
+	}
+	ur->ur_cv = cv_create("uring");
+	if (ur->ur_cv == NULL) {
+		lock_destroy(ur->ur_lock);
+		kfree(ur);
+		return ENOMEM;
+	}
+	ur->ur_entries = entries;
+	ur->ur_sqhead = 0;
+	ur->ur_cqtail = 0;
+	ur->ur_inflight = 0;
+	ur->ur_as = NULL;
+
+	npages = URING_SIZE(entries) / PAGE_SIZE;
+	for (i=0; i<npages; i++) {
+		result = vm_getkpage((vaddr_t)mem + i * PAGE_SIZE, true,
+				     &ur->ur_pages[i]);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	hdr = uring_addr(ur, 0);
+	hdr->sq_head = 0;
+	hdr->sq_tail = 0;
+	hdr->cq_head = 0;
+	hdr->cq_tail = 0;
+
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_uring != NULL) {
+		spinlock_release(&proc->p_lock);
+		result = EBUSY;
+		goto fail;
+	}
+	proc->p_uring = ur;
+	spinlock_release(&proc->p_lock);
+
+	return 0;
+
+ fail:
+	cv_destroy(ur->ur_cv);
+	lock_destroy(ur->ur_lock);
+	kfree(ur);
+	return result;
+}
+
+/*
+ * sys_uring_enter
+ *
+ * Submit up to TOSUBMIT entries from the submission queue, then wait
+ * until at least MINCOMPLETE completions are waiting to be consumed,
+ * or nothing more is outstanding. Returns the number submitted; that
+ * comes up short if the submission queue runs dry or the completion
+ * queue wouldn't have room.
+ *
+ * A submission that can't even be started (bad fd, bad buffer, etc.)
+ * still counts, and completes right away with the error.
+ */
+int
+sys_uring_enter(unsigned tosubmit, unsigned mincomplete, int *retval)
+{
+	struct proc *proc = curproc;
+	struct uring *ur;
+	struct uring_hdr *hdr;
+	struct uring_sqe sqe;
+	struct uring_op *op;
+	unsigned n;
+	int result;
+
+	spinlock_acquire(&proc->p_lock);
+	ur = proc->p_uring;
+	spinlock_release(&proc->p_lock);
+	if (ur == NULL) {
+		return EINVAL;
+	}
+	hdr = uring_addr(ur, 0);
+
+	lock_acquire(ur->ur_lock);
+
+	for (n=0; n<tosubmit; n++) {
+		if (ur->ur_sqhead == hdr->sq_tail) {
+			break;
+		}
+		if (ur->ur_inflight + uring_cqpending(ur) >= ur->ur_entries) {
+			break;
+		}
+
+		/* Read the entry only after seeing the tail move. */
+		membar_load_load();
+		/* Copy it, so the process can't change it as we check it. */
+		memcpy(&sqe, uring_addr(ur, URING_SQOFFSET(ur->ur_entries) +
+			(ur->ur_sqhead % ur->ur_entries) * sizeof(sqe)),
+		       sizeof(sqe));
+		ur->ur_sqhead++;
+		hdr->sq_head = ur->ur_sqhead;
+
+		result = uring_prepare(ur, &sqe, &op);
+		if (result) {
+			uring_post(ur, sqe.sqe_data, -result);
+		}
+		else if (op == NULL) {
+			uring_post(ur, sqe.sqe_data, 0);
+		}
+		else {
+			ur->ur_inflight++;
+			uring_queue(op);
+		}
+	}
+	*retval = n;
+
+	while (uring_cqpending(ur) < mincomplete && ur->ur_inflight > 0) {
+		cv_wait(ur->ur_cv, ur->ur_lock);
+	}
+
+	lock_release(ur->ur_lock);
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * CPU affinity test.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define NAFFTHREADS	8
+#define NAFFLOOPS	200
+
+static struct semaphore *affdonesem;
+static struct semaphore *affpingsem;
+
+/*
+ * Return the cpu we're on; with interrupts off so we can't be moved
+ * while looking.
+ */
+static
+unsigned
+affinity_whereami(void)
+{
+	unsigned num;
+	int spl;
+
+	spl = splhigh();
+	num = curcpu->c_number;
+	splx(spl);
+	return num;
+}
+
+/*
+ * Pin ourselves to one cpu and check we stay there while doing
+ * things that switch and sleep.
+ */
+static
+void
+affinity_thread(void *junk, unsigned long cpunum)
+{
+	unsigned i, where;
+	int result;
+
+	(void)junk;
+
+	result = thread_setaffinity((uint32_t)1 << cpunum);
+	if (result) {
+		panic("affinitytest: thread_setaffinity: %s\n",
+		      strerror(result));
+	}
+	for (i=0; i<NAFFLOOPS; i++) {
+		where = affinity_whereami();
+		if (where != cpunum) {
+			panic("affinitytest: thread pinned to cpu %lu "
+			      "found on cpu %u\n", cpunum, where);
+		}
+		if (i % 2) {
+			thread_yield();
+		}
+		else {
+			/* Maybe sleep and get woken from another cpu. */
+			V(affpingsem);
+			P(affpingsem);
+		}
+	}
+	V(affdonesem);
+}
+
+int
+affinitytest(int nargs, char **args)
+{
+	unsigned i, ncpus, where;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting affinity test...\n");
+
+	/* Visit each cpu in turn; the first that isn't there ends it. */
+	for (ncpus=0; ncpus<32; ncpus++) {
+		result = thread_setaffinity((uint32_t)1 << ncpus);
+		if (result == EINVAL) {
+			break;
+		}
+		if (result) {
+			panic("affinitytest: thread_setaffinity: %s\n",
+			      strerror(result));
+		}
+		where = affinity_whereami();
+		if (where != ncpus) {
+			panic("affinitytest: moved to cpu %u, expected %u\n",
+			      where, ncpus);
+		}
+	}
+	KASSERT(ncpus > 0);
+	kprintf("affinitytest: visited %u cpus\n", ncpus);
+
+	result = thread_setaffinity(THREAD_AFFINITY_ALL);
+	KASSERT(result == 0);
+	KASSERT(thread_getaffinity() == ((uint32_t)1 << ncpus) - 1 ||
+		ncpus == 32);
+
+	affdonesem = sem_create("affinitytest done", 0);
+	affpingsem = sem_create("affinitytest ping", 0);
+	if (affdonesem == NULL || affpingsem == NULL) {
+		panic("affinitytest: sem_create failed\n");
+	}
+	for (i=0; i<NAFFTHREADS; i++) {
+		result = thread_fork("affinitytest", NULL, affinity_thread,
+				     NULL, i % ncpus);
+		if (result) {
+			panic("affinitytest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NAFFTHREADS; i++) {
+		P(affdonesem);
+	}
+	sem_destroy(affdonesem);
+	sem_destroy(affpingsem);
+	affdonesem = affpingsem = NULL;
+
+	kprintf("Affinity test done.\n");
+	return 0;
+}
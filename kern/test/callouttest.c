@@ -0,0 +1,187 @@
+/*
+ * Callout and timed-sleep tests.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <callout.h>
+#include <test.h>
+
+#define NCALLOUTS 8
+
+static struct spinlock co_lock = SPINLOCK_INITIALIZER;
+static struct callout callouts[NCALLOUTS];
+static unsigned co_delay[NCALLOUTS];
+static unsigned co_firedat[NCALLOUTS];
+static unsigned co_order[NCALLOUTS];
+static unsigned co_nfired;
+static struct semaphore *co_sem;
+
+static
+void
+callouttest_fire(void *data)
+{
+	unsigned num = (uintptr_t)data;
+
+	spinlock_acquire(&co_lock);
+	co_firedat[num] = callout_ticks();
+	co_order[co_nfired++] = num;
+	spinlock_release(&co_lock);
+	V(co_sem);
+}
+
+/*
+ * Schedule callouts in reverse order of expiry and check that they
+ * fire in order and none of them early. The delays are spread so
+ * some of them need cascading down from the upper wheel levels.
+ */
+static
+void
+callouttest_order(void)
+{
+	unsigned i, start;
+
+	co_nfired = 0;
+	start = callout_ticks();
+	for (i=0; i<NCALLOUTS; i++) {
+		co_delay[i] = 1 + i * 37;
+		callout_init(&callouts[i], callouttest_fire, (void *)(uintptr_t)i);
+	}
+	for (i=NCALLOUTS; i-- > 0; ) {
+		callout_schedule(&callouts[i], co_delay[i]);
+	}
+	for (i=0; i<NCALLOUTS; i++) {
+		P(co_sem);
+	}
+	for (i=0; i<NCALLOUTS; i++) {
+		if (co_order[i] != i) {
+			panic("callouttest: callout %u fired in slot %u\n",
+			      co_order[i], i);
+		}
+		if (co_firedat[i] - start < co_delay[i]) {
+			panic("callouttest: callout %u fired early "
+			      "(%u ticks, wanted %u)\n", i,
+			      co_firedat[i] - start, co_delay[i]);
+		}
+		KASSERT(!callout_pending(&callouts[i]));
+		callout_cleanup(&callouts[i]);
+	}
+	kprintf("callouttest: ordering ok\n");
+}
+
+/*
+ * Cancel one callout and move another much earlier; only the moved
+ * one should fire.
+ */
+static
+void
+callouttest_cancel(void)
+{
+	co_nfired = 0;
+	callout_init(&callouts[0], callouttest_fire, (void *)0);
+	callout_init(&callouts[1], callouttest_fire, (void *)1);
+
+	callout_schedule(&callouts[0], 10);
+	callout_schedule(&callouts[1], 100000);
+	KASSERT(callout_stop(&callouts[0]) == true);
+	KASSERT(callout_stop(&callouts[0]) == false);
+	callout_schedule(&callouts[1], 5);
+
+	P(co_sem);
+	ticksleep(20);
+	KASSERT(co_nfired == 1);
+	KASSERT(co_order[0] == 1);
+
+	callout_cleanup(&callouts[0]);
+	callout_cleanup(&callouts[1]);
+	kprintf("callouttest: cancel/reschedule ok\n");
+}
+
+static
+void
+callouttest_holder(void *lk, unsigned long junk)
+{
+	(void)junk;
+
+	lock_acquire(lk);
+	V(co_sem);
+	ticksleep(50);
+	lock_release(lk);
+	V(co_sem);
+}
+
+/*
+ * Timed waits on locks and CVs.
+ */
+static
+void
+callouttest_timed(void)
+{
+	struct lock *lk;
+	struct cv *cv;
+	unsigned start;
+	int result;
+
+	lk = lock_create("callouttest");
+	cv = cv_create("callouttest");
+	if (lk == NULL || cv == NULL) {
+		panic("callouttest: out of memory\n");
+	}
+
+	/* Nobody signals; should time out, not early. */
+	lock_acquire(lk);
+	start = callout_ticks();
+	result = cv_timedwait(cv, lk, 10);
+	KASSERT(result == ETIMEDOUT);
+	KASSERT(callout_ticks() - start >= 10);
+	KASSERT(lock_do_i_hold(lk));
+	lock_release(lk);
+
+	/* Lock held for a while by someone else. */
+	result = thread_fork("callouttest", NULL, callouttest_holder, lk, 0);
+	if (result) {
+		panic("callouttest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	P(co_sem);
+	result = lock_timedacquire(lk, 5);
+	KASSERT(result == ETIMEDOUT);
+	KASSERT(!lock_do_i_hold(lk));
+	result = lock_timedacquire(lk, 1000);
+	KASSERT(result == 0);
+	KASSERT(lock_do_i_hold(lk));
+	lock_release(lk);
+	P(co_sem);
+
+	cv_destroy(cv);
+	lock_destroy(lk);
+	kprintf("callouttest: timed waits ok\n");
+}
+
+int
+callouttest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting callout test...\n");
+
+	co_sem = sem_create("callouttest", 0);
+	if (co_sem == NULL) {
+		panic("callouttest: sem_create failed\n");
+	}
+
+	callouttest_order();
+	callouttest_cancel();
+	callouttest_timed();
+
+	sem_destroy(co_sem);
+	co_sem = NULL;
+
+	kprintf("Callout test done.\n");
+	return 0;
+}
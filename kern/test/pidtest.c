@@ -0,0 +1,197 @@
+/*
+ * Process table test: more processes at once than the table used to
+ * hold, with some waited for and some disowned. Every other round
+ * collects them with waitpid(-1) instead of by pid. Then a process
+ * whose child outlives it, after it has been waited for.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <lib.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <synch.h>
+#include <clock.h>
+#include <pid.h>
+#include <test.h>
+
+#define NPIDKIDS	200
+#define NPIDROUNDS	2
+
+static struct semaphore *pidgatesem;
+
+static
+void
+pidkid(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	P(pidgatesem);
+	proc_exit(_MKWAIT_EXIT(num % 256));
+	thread_exit();
+}
+
+/*
+ * The middle process for pidtest_orphan: fork a child that waits at
+ * the gate, and exit without waiting for it.
+ */
+static
+void
+pidmiddle(void *junk, unsigned long num)
+{
+	struct proc *proc;
+	int result;
+
+	(void)junk;
+
+	result = proc_fork(&proc);
+	if (result) {
+		panic("pidtest: proc_fork in child failed: %s\n",
+		      strerror(result));
+	}
+	result = thread_fork("pidtest grandkid", proc, pidkid, NULL, num + 1);
+	if (result) {
+		panic("pidtest: thread_fork failed: %s\n", strerror(result));
+	}
+	proc_exit(_MKWAIT_EXIT(num));
+	thread_exit();
+}
+
+/*
+ * Wait for a child whose own child is still running, and make sure
+ * the child can't be waited for again; then let the grandchild exit,
+ * which leaves it the last user of its parent's pidinfo.
+ */
+static
+void
+pidtest_orphan(void)
+{
+	struct proc *proc;
+	pid_t pid, ret;
+	int result, status;
+
+	result = proc_fork(&proc);
+	if (result) {
+		panic("pidtest: proc_fork failed: %s\n", strerror(result));
+	}
+	pid = proc->p_pid;
+	result = thread_fork("pidtest middle", proc, pidmiddle, NULL, 7);
+	if (result) {
+		panic("pidtest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	result = pid_wait(pid, &status, 0, &ret);
+	if (result || ret != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 7) {
+		panic("pidtest: wait for %d returned %d, pid %d, "
+		      "status %d\n", pid, result, ret, status);
+	}
+	result = pid_wait(pid, &status, 0, &ret);
+	if (result != ESRCH) {
+		panic("pidtest: second wait for %d returned %d\n",
+		      pid, result);
+	}
+
+	/* Let the grandchild go, and give it a moment to finish. */
+	V(pidgatesem);
+	clocksleep(1);
+
+	if (pid_wait(-1, &status, WNOHANG, &ret) != ECHILD) {
+		panic("pidtest: children left over\n");
+	}
+	kprintf("pidtest: orphan %d reaped\n", pid);
+}
+
+int
+pidtest(int nargs, char **args)
+{
+	static pid_t kids[NPIDKIDS];
+	struct proc *proc;
+	unsigned long i, j;
+	unsigned round;
+	int result, status;
+	pid_t ret;
+
+	(void)nargs;
+	(void)args;
+
+	pidgatesem = sem_create("pidtest gate", 0);
+	if (pidgatesem == NULL) {
+		panic("pidtest: out of memory\n");
+	}
+
+	kprintf("Starting pid test...\n");
+
+	for (round=0; round<NPIDROUNDS; round++) {
+		for (i=0; i<NPIDKIDS; i++) {
+			result = proc_fork(&proc);
+			if (result) {
+				panic("pidtest: proc_fork %lu failed: %s\n",
+				      i, strerror(result));
+			}
+			kids[i] = proc->p_pid;
+			result = thread_fork("pidtest kid", proc,
+					     pidkid, NULL, i);
+			if (result) {
+				panic("pidtest: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+			for (j=0; j<i; j++) {
+				if (kids[j] == kids[i]) {
+					panic("pidtest: pid %d handed out "
+					      "twice\n", kids[i]);
+				}
+			}
+		}
+
+		/* Still running, so WNOHANG should find nothing. */
+		result = pid_wait(kids[0], &status, WNOHANG, &ret);
+		if (result || ret != 0) {
+			panic("pidtest: WNOHANG wait returned %d/%d\n",
+			      result, ret);
+		}
+
+		/* Let go of the odd ones; wait for the even ones. */
+		for (i=1; i<NPIDKIDS; i+=2) {
+			pid_disown(kids[i]);
+		}
+		for (i=0; i<NPIDKIDS; i++) {
+			V(pidgatesem);
+		}
+		for (i=0; i<NPIDKIDS; i+=2) {
+			if (round % 2 == 0) {
+				result = pid_wait(kids[i], &status, 0, &ret);
+			}
+			else {
+				result = pid_wait(-1, &status, 0, &ret);
+			}
+			if (result) {
+				panic("pidtest: wait for %d failed: %s\n",
+				      kids[i], strerror(result));
+			}
+			for (j=0; j<NPIDKIDS && kids[j] != ret; j++) {
+				/* nothing */
+			}
+			if (j == NPIDKIDS || j % 2 != 0 || !WIFEXITED(status) ||
+			    WEXITSTATUS(status) != (int)(j % 256)) {
+				panic("pidtest: got pid %d, status %d\n",
+				      ret, status);
+			}
+			kids[j] = INVALID_PID;
+		}
+		if (pid_wait(-1, &status, WNOHANG, &ret) != ECHILD) {
+			panic("pidtest: children left over\n");
+		}
+		kprintf("pidtest: round %u: %d processes, pids %d to %d\n",
+			round, NPIDKIDS, kids[1], kids[NPIDKIDS-1]);
+	}
+
+	pidtest_orphan();
+
+	sem_destroy(pidgatesem);
+	pidgatesem = NULL;
+
+	kprintf("pid test done.\n");
+	return 0;
+}
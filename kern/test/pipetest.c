@@ -0,0 +1,160 @@
+/*
+ * Pipe test: a writer thread pushes a known byte pattern through a
+ * pipe in odd-sized pieces while we read it back in different odd
+ * sizes, then closes its end so we should see EOF. Then check EPIPE
+ * and the nonblocking behavior.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <thread.h>
+#include <synch.h>
+#include <vnode.h>
+#include <pipe.h>
+#include <test.h>
+
+#define PIPETEST_BYTES	(100 * 1024)
+
+static struct semaphore *pipedonesem;
+
+static
+unsigned char
+pipetest_byte(unsigned pos)
+{
+	return (pos * 7 + pos / 251) & 0xff;
+}
+
+static
+void
+pipewriter(void *data, unsigned long junk)
+{
+	static unsigned char buf[1000];
+	struct vnode *vn = data;
+	struct iovec iov;
+	struct uio ku;
+	unsigned pos, len, i;
+	int result;
+
+	(void)junk;
+
+	for (pos = 0; pos < PIPETEST_BYTES; pos += len) {
+		len = 1 + (pos * 13) % sizeof(buf);
+		if (len > PIPETEST_BYTES - pos) {
+			len = PIPETEST_BYTES - pos;
+		}
+		for (i=0; i<len; i++) {
+			buf[i] = pipetest_byte(pos + i);
+		}
+		uio_kinit(&iov, &ku, buf, len, 0, UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+		if (result) {
+			panic("pipetest: write: %s\n", strerror(result));
+		}
+		if (ku.uio_resid != 0) {
+			panic("pipetest: short write\n");
+		}
+	}
+	VOP_DECREF(vn);
+	V(pipedonesem);
+}
+
+int
+pipetest(int nargs, char **args)
+{
+	static unsigned char buf[1500];
+	struct vnode *readvn, *writevn;
+	struct iovec iov;
+	struct uio ku;
+	unsigned pos, len, got, i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting pipe test...\n");
+
+	pipedonesem = sem_create("pipetest", 0);
+	if (pipedonesem == NULL) {
+		panic("pipetest: out of memory\n");
+	}
+
+	/* pattern through a blocking pipe */
+	result = pipe_create(false, &readvn, &writevn);
+	if (result) {
+		panic("pipetest: pipe_create: %s\n", strerror(result));
+	}
+	result = thread_fork("pipewriter", NULL, pipewriter, writevn, 0);
+	if (result) {
+		panic("pipetest: thread_fork: %s\n", strerror(result));
+	}
+	pos = 0;
+	while (1) {
+		len = 1 + (pos * 17) % sizeof(buf);
+		uio_kinit(&iov, &ku, buf, len, 0, UIO_READ);
+		result = VOP_READ(readvn, &ku);
+		if (result) {
+			panic("pipetest: read: %s\n", strerror(result));
+		}
+		got = len - ku.uio_resid;
+		if (got == 0) {
+			break;
+		}
+		for (i=0; i<got; i++) {
+			if (buf[i] != pipetest_byte(pos + i)) {
+				panic("pipetest: wrong byte at %u\n", pos + i);
+			}
+		}
+		pos += got;
+	}
+	if (pos != PIPETEST_BYTES) {
+		panic("pipetest: EOF after %u bytes of %u\n",
+		      pos, PIPETEST_BYTES);
+	}
+	P(pipedonesem);
+	VOP_DECREF(readvn);
+	kprintf("pipetest: %u bytes passed through\n", pos);
+
+	/* writing with the read end gone */
+	result = pipe_create(false, &readvn, &writevn);
+	if (result) {
+		panic("pipetest: pipe_create: %s\n", strerror(result));
+	}
+	VOP_DECREF(readvn);
+	uio_kinit(&iov, &ku, buf, 10, 0, UIO_WRITE);
+	result = VOP_WRITE(writevn, &ku);
+	if (result != EPIPE) {
+		panic("pipetest: write to widowed pipe got %d\n", result);
+	}
+	VOP_DECREF(writevn);
+
+	/* nonblocking: empty read, and fill until full */
+	result = pipe_create(true, &readvn, &writevn);
+	if (result) {
+		panic("pipetest: pipe_create: %s\n", strerror(result));
+	}
+	uio_kinit(&iov, &ku, buf, sizeof(buf), 0, UIO_READ);
+	result = VOP_READ(readvn, &ku);
+	if (result != EAGAIN) {
+		panic("pipetest: nonblocking read of empty pipe got %d\n",
+		      result);
+	}
+	pos = 0;
+	do {
+		uio_kinit(&iov, &ku, buf, sizeof(buf), 0, UIO_WRITE);
+		result = VOP_WRITE(writevn, &ku);
+		pos += sizeof(buf) - ku.uio_resid;
+	} while (result == 0 && pos < 10 * PIPETEST_BYTES);
+	if (result != EAGAIN) {
+		panic("pipetest: filling nonblocking pipe got %d\n", result);
+	}
+	VOP_DECREF(writevn);
+	VOP_DECREF(readvn);
+	kprintf("pipetest: nonblocking pipe holds %u bytes\n", pos);
+
+	sem_destroy(pipedonesem);
+	pipedonesem = NULL;
+
+	kprintf("pipe test done.\n");
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Poll test: check what VOP_POLL reports for the ends of a pipe as
+ * it fills, drains, and loses an end, and that a poller sleeping on
+ * an empty pipe is woken when another thread writes to it.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <uio.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <vnode.h>
+#include <pipe.h>
+#include <poll.h>
+#include <test.h>
+
+static struct semaphore *polldonesem;
+
+static
+void
+polltest_expect(struct vnode *vn, int events, int want, const char *what)
+{
+	int got;
+
+	got = VOP_POLL(vn, events, NULL);
+	if (got != want) {
+		panic("polltest: %s: got 0x%x, expected 0x%x\n",
+		      what, got, want);
+	}
+}
+
+static
+void
+polltest_write(struct vnode *vn, size_t len)
+{
+	static char buf[64];
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(len <= sizeof(buf));
+	uio_kinit(&iov, &ku, buf, len, 0, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+	if (result) {
+		panic("polltest: write: %s\n", strerror(result));
+	}
+}
+
+static
+void
+pollwriter(void *data, unsigned long junk)
+{
+	struct vnode *vn = data;
+
+	(void)junk;
+
+	/* give the main thread time to go to sleep */
+	clocksleep(1);
+	polltest_write(vn, 1);
+	V(polldonesem);
+}
+
+int
+polltest(int nargs, char **args)
+{
+	struct vnode *readvn, *writevn;
+	struct poller pl;
+	struct pollentry pe;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting poll test...\n");
+
+	polldonesem = sem_create("polltest", 0);
+	if (polldonesem == NULL) {
+		panic("polltest: out of memory\n");
+	}
+	result = poller_init(&pl);
+	if (result) {
+		panic("polltest: poller_init: %s\n", strerror(result));
+	}
+
+	result = pipe_create(true, &readvn, &writevn);
+	if (result) {
+		panic("polltest: pipe_create: %s\n", strerror(result));
+	}
+	polltest_expect(readvn, POLLIN, 0, "empty pipe, read end");
+	polltest_expect(writevn, POLLOUT, POLLOUT, "empty pipe, write end");
+	polltest_write(writevn, 10);
+	polltest_expect(readvn, POLLIN, POLLIN, "pipe with data");
+	polltest_expect(readvn, 0, 0, "pipe with data, no events");
+
+	/* a poller on the empty side gets woken by a write */
+	VOP_DECREF(writevn);
+	VOP_DECREF(readvn);
+	result = pipe_create(false, &readvn, &writevn);
+	if (result) {
+		panic("polltest: pipe_create: %s\n", strerror(result));
+	}
+	pollentry_init(&pe, &pl);
+	poller_reset(&pl);
+	polltest_expect(readvn, POLLIN, 0, "second pipe, read end");
+	if (VOP_POLL(readvn, POLLIN, &pe) != 0) {
+		panic("polltest: second pipe ready too soon\n");
+	}
+	result = thread_fork("pollwriter", NULL, pollwriter, writevn, 0);
+	if (result) {
+		panic("polltest: thread_fork: %s\n", strerror(result));
+	}
+	result = poller_wait(&pl, true, 10 * HZ);
+	if (result) {
+		panic("polltest: poller_wait: %s\n", strerror(result));
+	}
+	pollentry_remove(&pe);
+	P(polldonesem);
+	polltest_expect(readvn, POLLIN, POLLIN, "second pipe after wakeup");
+	kprintf("polltest: wakeup seen\n");
+
+	/* a timed wait with nothing coming times out */
+	poller_reset(&pl);
+	result = poller_wait(&pl, true, 2);
+	if (result != ETIMEDOUT) {
+		panic("polltest: idle poller_wait got %d\n", result);
+	}
+
+	/* hangups */
+	VOP_DECREF(writevn);
+	polltest_expect(readvn, POLLIN, POLLIN | POLLHUP,
+			"read end with writer gone");
+	VOP_DECREF(readvn);
+	result = pipe_create(false, &readvn, &writevn);
+	if (result) {
+		panic("polltest: pipe_create: %s\n", strerror(result));
+	}
+	VOP_DECREF(readvn);
+	polltest_expect(writevn, POLLOUT, POLLOUT | POLLERR,
+			"write end with reader gone");
+	VOP_DECREF(writevn);
+
+	poller_cleanup(&pl);
+	sem_destroy(polldonesem);
+	polldonesem = NULL;
+
+	kprintf("poll test done.\n");
+	return 0;
+}
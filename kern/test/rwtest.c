@@ -0,0 +1,143 @@
+/*
+ * Reader-writer lock stress test.
+ */
+#include <types.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NRWREADERS	24
+#define NRWWRITERS	8
+#define NRWLOOPS	200
+#define NRWDATA		16
+
+static struct rwlock *testrw;
+static struct semaphore *rwdonesem;
+static struct spinlock rwstatlock = SPINLOCK_INITIALIZER;
+
+/* Writers keep all of these equal; readers check that they are. */
+static volatile unsigned rwdata[NRWDATA];
+
+static volatile unsigned rwreaders, rwwriters, rwmaxreaders;
+
+static
+void
+rwreader(void *junk, unsigned long num)
+{
+	unsigned i, j, first, nreaders;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		rwlock_acquire_read(testrw);
+
+		spinlock_acquire(&rwstatlock);
+		KASSERT(rwwriters == 0);
+		nreaders = ++rwreaders;
+		if (nreaders > rwmaxreaders) {
+			rwmaxreaders = nreaders;
+		}
+		spinlock_release(&rwstatlock);
+
+		first = rwdata[0];
+		for (j=1; j<NRWDATA; j++) {
+			if (rwdata[j] != first) {
+				panic("rwtest: reader saw a half-done write "
+				      "(%u vs %u)\n", rwdata[j], first);
+			}
+			thread_yield();
+		}
+
+		spinlock_acquire(&rwstatlock);
+		rwreaders--;
+		spinlock_release(&rwstatlock);
+
+		rwlock_release_read(testrw);
+	}
+	V(rwdonesem);
+}
+
+static
+void
+rwwriter(void *junk, unsigned long num)
+{
+	unsigned i, j;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		rwlock_acquire_write(testrw);
+		KASSERT(rwlock_do_i_hold_write(testrw));
+
+		spinlock_acquire(&rwstatlock);
+		KASSERT(rwreaders == 0);
+		KASSERT(rwwriters == 0);
+		rwwriters++;
+		spinlock_release(&rwstatlock);
+
+		for (j=0; j<NRWDATA; j++) {
+			rwdata[j] = num * NRWLOOPS + i;
+			thread_yield();
+		}
+
+		spinlock_acquire(&rwstatlock);
+		rwwriters--;
+		spinlock_release(&rwstatlock);
+
+		rwlock_release_write(testrw);
+		KASSERT(!rwlock_do_i_hold_write(testrw));
+	}
+	V(rwdonesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	unsigned long i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	testrw = rwlock_create("rwtest");
+	rwdonesem = sem_create("rwtest done", 0);
+	if (testrw == NULL || rwdonesem == NULL) {
+		panic("rwtest: out of memory\n");
+	}
+	for (i=0; i<NRWDATA; i++) {
+		rwdata[i] = 0;
+	}
+	rwreaders = rwwriters = rwmaxreaders = 0;
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NRWREADERS + NRWWRITERS; i++) {
+		if (i % 4 == 3) {
+			result = thread_fork("rwtest writer", NULL,
+					     rwwriter, NULL, i);
+		}
+		else {
+			result = thread_fork("rwtest reader", NULL,
+					     rwreader, NULL, i);
+		}
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NRWREADERS + NRWWRITERS; i++) {
+		P(rwdonesem);
+	}
+
+	kprintf("rwtest: at most %u readers at once\n", rwmaxreaders);
+
+	sem_destroy(rwdonesem);
+	rwlock_destroy(testrw);
+	rwdonesem = NULL;
+	testrw = NULL;
+
+	kprintf("rwlock test done.\n");
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Spinlock contention benchmark.
+ *
+ * Runs the same contended critical section under the ticket
+ * spinlocks in spinlock.c and under a plain test-test-and-set lock
+ * like the one they replaced, and reports how long each took and how
+ * evenly the lock was shared out among the contending threads.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <test.h>
+
+#define NSPLKTHREADS	32	/* at most one per cpu */
+#define NSPLKLOOPS	10000
+
+static struct spinlock ticketlock = SPINLOCK_INITIALIZER;
+static volatile spinlock_data_t taslock = SPINLOCK_DATA_INITIALIZER;
+
+static volatile unsigned long splkcounter;
+static volatile bool splkstop;
+static unsigned splknthreads;
+static struct spinlock splkreadylock = SPINLOCK_INITIALIZER;
+static volatile unsigned splkready;
+static unsigned long splkcounts[NSPLKTHREADS];
+static struct semaphore *splkstartsem;
+static struct semaphore *splkdonesem;
+
+static
+void
+tas_acquire(void)
+{
+	while (1) {
+		if (spinlock_data_get(&taslock) != 0) {
+			continue;
+		}
+		if (spinlock_data_testandset(&taslock) != 0) {
+			continue;
+		}
+		break;
+	}
+}
+
+static
+void
+tas_release(void)
+{
+	spinlock_data_set(&taslock, 0);
+}
+
+/*
+ * Count the cpus by trying to move to each in turn.
+ */
+static
+unsigned
+splkncpus(void)
+{
+	unsigned n;
+	int result;
+
+	for (n=0; n<NSPLKTHREADS; n++) {
+		result = thread_setaffinity((uint32_t)1 << n);
+		if (result == EINVAL) {
+			break;
+		}
+		if (result) {
+			panic("spinlocktest: thread_setaffinity: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_setaffinity(THREAD_AFFINITY_ALL);
+	KASSERT(result == 0);
+	KASSERT(n > 0);
+	return n;
+}
+
+/*
+ * Each thread is pinned to its own cpu, and spins at splhigh so
+ * nothing else runs there. Once they're all spinning, each grabs the
+ * lock over and over until one of them has done NSPLKLOOPS
+ * iterations; then they all stop. With a fair lock the others should
+ * have done about as many.
+ */
+static
+void
+splkthread(void *usetas, unsigned long num)
+{
+	unsigned long mine = 0;
+	int spl, result;
+
+	result = thread_setaffinity((uint32_t)1 << num);
+	if (result) {
+		panic("spinlocktest: thread_setaffinity: %s\n",
+		      strerror(result));
+	}
+
+	P(splkstartsem);
+
+	spl = splhigh();
+
+	/* Wait for everyone, so nobody gets a head start. */
+	spinlock_acquire(&splkreadylock);
+	splkready++;
+	spinlock_release(&splkreadylock);
+	while (splkready < splknthreads) {
+		/* spin */
+	}
+
+	while (!splkstop) {
+		if (usetas != NULL) {
+			tas_acquire();
+		}
+		else {
+			spinlock_acquire(&ticketlock);
+		}
+		splkcounter++;
+		mine++;
+		if (mine == NSPLKLOOPS) {
+			splkstop = true;
+		}
+		if (usetas != NULL) {
+			tas_release();
+		}
+		else {
+			spinlock_release(&ticketlock);
+		}
+	}
+	splx(spl);
+
+	splkcounts[num] = mine;
+	V(splkdonesem);
+}
+
+static
+void
+splkrun(const char *name, bool usetas)
+{
+	struct timespec before, after, duration;
+	unsigned long i, min, max, total;
+	uint64_t ns;
+	int result;
+
+	splkcounter = 0;
+	splkstop = false;
+	splkready = 0;
+
+	for (i=0; i<splknthreads; i++) {
+		result = thread_fork("spinlocktest", NULL, splkthread,
+				     usetas ? (void *)&taslock : NULL, i);
+		if (result) {
+			panic("spinlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&before);
+	for (i=0; i<splknthreads; i++) {
+		V(splkstartsem);
+	}
+	for (i=0; i<splknthreads; i++) {
+		P(splkdonesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	min = max = splkcounts[0];
+	total = 0;
+	for (i=0; i<splknthreads; i++) {
+		if (splkcounts[i] < min) {
+			min = splkcounts[i];
+		}
+		if (splkcounts[i] > max) {
+			max = splkcounts[i];
+		}
+		total += splkcounts[i];
+	}
+	if (total != splkcounter) {
+		panic("spinlocktest: %s: lost updates (%lu counted, "
+		      "%lu done)\n", name, splkcounter, total);
+	}
+
+	ns = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%s: %lu acquires in %llu.%09lu s, %llu ns each; "
+		"per-thread min %lu max %lu\n", name, total,
+		(unsigned long long)duration.tv_sec,
+		(unsigned long)duration.tv_nsec,
+		(unsigned long long)(ns / total), min, max);
+}
+
+int
+spinlocktest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	splkstartsem = sem_create("spinlocktest start", 0);
+	splkdonesem = sem_create("spinlocktest done", 0);
+	if (splkstartsem == NULL || splkdonesem == NULL) {
+		panic("spinlocktest: sem_create failed\n");
+	}
+
+	splknthreads = splkncpus();
+	if (splknthreads == 1) {
+		kprintf("spinlocktest: only one cpu; nothing will contend\n");
+	}
+
+	kprintf("Starting spinlock contention test on %u cpus...\n",
+		splknthreads);
+	splkrun("test-and-set", true);
+	splkrun("ticket", false);
+
+	sem_destroy(splkstartsem);
+	sem_destroy(splkdonesem);
+	splkstartsem = splkdonesem = NULL;
+
+	kprintf("Spinlock test done.\n");
+	return 0;
+}
@@ -400,3 +400,106 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// handoff test
+
+#define NHANDOFF 8
+
+static struct lock *handofflock;
+static struct semaphore *handoffsem;
+static volatile unsigned handoffnext;
+
+static
+void
+handoffthread(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	if (num < NHANDOFF) {
+		lock_acquire(handofflock);
+		if (handoffnext != num) {
+			panic("handofftest: thread %lu got the lock "
+			      "in turn %u\n", num, handoffnext);
+		}
+		handoffnext++;
+		lock_release(handofflock);
+	}
+	else {
+		P(handoffsem);
+		if (handoffnext != num) {
+			panic("handofftest: thread %lu got the semaphore "
+			      "in turn %u\n", num, handoffnext);
+		}
+		handoffnext++;
+	}
+	V(donesem);
+}
+
+static
+void
+handofffork(unsigned long num)
+{
+	int result;
+
+	result = thread_fork("handofftest", NULL, handoffthread, NULL, num);
+	if (result) {
+		panic("handofftest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	/* Give it time to get in line. */
+	ticksleep(2);
+}
+
+/*
+ * Queue threads up on a handoff lock and then a handoff semaphore,
+ * one at a time so the queue order is known, and check that they
+ * come out in the same order.
+ */
+int
+handofftest(int nargs, char **args)
+{
+	unsigned long i;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	handofflock = lock_create("handofflock");
+	handoffsem = sem_create("handoffsem", 0);
+	if (handofflock == NULL || handoffsem == NULL) {
+		panic("handofftest: out of memory\n");
+	}
+	lock_sethandoff(handofflock, true);
+	sem_sethandoff(handoffsem, true);
+	handoffnext = 0;
+
+	kprintf("Starting handoff test...\n");
+
+	lock_acquire(handofflock);
+	for (i=0; i<NHANDOFF; i++) {
+		handofffork(i);
+	}
+	lock_release(handofflock);
+	for (i=0; i<NHANDOFF; i++) {
+		P(donesem);
+	}
+
+	for (i=NHANDOFF; i<2*NHANDOFF; i++) {
+		handofffork(i);
+	}
+	for (i=0; i<NHANDOFF; i++) {
+		V(handoffsem);
+	}
+	for (i=0; i<NHANDOFF; i++) {
+		P(donesem);
+	}
+
+	lock_destroy(handofflock);
+	sem_destroy(handoffsem);
+	handofflock = NULL;
+	handoffsem = NULL;
+
+	kprintf("Handoff test done.\n");
+	return 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * Callouts, kept in a hierarchical timer wheel.
+ *
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SIZE slots each. Level
+ * 0 has one slot per tick; each slot of level N covers WHEEL_SIZE
+ * times as many ticks as a slot of level N-1. A callout is filed
+ * under the lowest level whose range covers its expiry time, so
+ * inserting and removing are constant-time. Every WHEEL_SIZE ticks
+ * the next slot of level 1 is "cascaded": its callouts are refiled
+ * into level 0 (and likewise for the higher levels, less often).
+ *
+ * Only level 0 slot entries are ever run, and only CPU 0 advances
+ * the wheel, so there is never more than one callout function
+ * running at a time.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <clock.h>
+#include <callout.h>
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1U << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+
+/* Largest delay the wheel can hold; longer ones are clamped. */
+#define WHEEL_MAXDELAY	((1U << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+static struct spinlock wheel_lock = SPINLOCK_INITIALIZER;
+static struct callout *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Tick most recently processed by callout_hardclock. */
+static volatile unsigned wheel_ticks;
+
+/* Callout whose function is currently being called, if any. */
+static struct callout *volatile wheel_running;
+
+////////////////////////////////////////////////////////////
+// wheel internals (call with wheel_lock held)
+
+static
+void
+wheel_unlink(struct callout *co)
+{
+	KASSERT(co->co_pending);
+	*co->co_prevp = co->co_next;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = co->co_prevp;
+	}
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+	co->co_pending = false;
+}
+
+/*
+ * File CO in the slot for its expiry time, relative to the current
+ * wheel time.
+ */
+static
+void
+wheel_insert(struct callout *co)
+{
+	struct callout **slot;
+	unsigned delta, level;
+
+	KASSERT(!co->co_pending);
+
+	delta = co->co_expire - wheel_ticks;
+	if ((int)delta < 0) {
+		/* Already overdue; fire at the next tick. */
+		co->co_expire = wheel_ticks + 1;
+		delta = 1;
+	}
+	else if (delta > WHEEL_MAXDELAY) {
+		co->co_expire = wheel_ticks + WHEEL_MAXDELAY;
+		delta = WHEEL_MAXDELAY;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1U << (WHEEL_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slot = &wheel[level][(co->co_expire >> (WHEEL_BITS * level))
+			     & WHEEL_MASK];
+
+	co->co_next = *slot;
+	co->co_prevp = slot;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = &co->co_next;
+	}
+	*slot = co;
+	co->co_pending = true;
+}
+
+/*
+ * Refile everything in slot INDEX of level LEVEL into lower levels.
+ * Returns INDEX, so the caller can tell whether the next level up
+ * needs cascading too.
+ */
+static
+unsigned
+wheel_cascade(unsigned level, unsigned index)
+{
+	struct callout *co, *list;
+
+	list = wheel[level][index];
+	wheel[level][index] = NULL;
+	if (list != NULL) {
+		list->co_prevp = &list;
+	}
+
+	while ((co = list) != NULL) {
+		wheel_unlink(co);
+		wheel_insert(co);
+	}
+	return index;
+}
+
+////////////////////////////////////////////////////////////
+// public interface
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *data)
+{
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+	co->co_expire = 0;
+	co->co_func = func;
+	co->co_data = data;
+	co->co_pending = false;
+}
+
+void
+callout_cleanup(struct callout *co)
+{
+	KASSERT(!co->co_pending);
+	KASSERT(wheel_running != co);
+	co->co_func = NULL;
+	co->co_data = NULL;
+}
+
+void
+callout_schedule(struct callout *co, unsigned ticks)
+{
+	KASSERT(co->co_func != NULL);
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	spinlock_acquire(&wheel_lock);
+	if (co->co_pending) {
+		wheel_unlink(co);
+	}
+	co->co_expire = wheel_ticks + ticks;
+	wheel_insert(co);
+	spinlock_release(&wheel_lock);
+}
+
+bool
+callout_stop(struct callout *co)
+{
+	bool ret;
+
+	spinlock_acquire(&wheel_lock);
+	ret = co->co_pending;
+	if (ret) {
+		wheel_unlink(co);
+	}
+
+	/*
+	 * If the function is running on another cpu, wait for it to
+	 * finish. (If it's running on this cpu, we were called from
+	 * the function itself, and must not wait for ourselves.)
+	 */
+	if (!curthread->t_in_interrupt || curcpu->c_number != 0) {
+		while (wheel_running == co) {
+			spinlock_release(&wheel_lock);
+			spinlock_acquire(&wheel_lock);
+		}
+	}
+	spinlock_release(&wheel_lock);
+
+	return ret;
+}
+
+bool
+callout_pending(struct callout *co)
+{
+	bool ret;
+
+	spinlock_acquire(&wheel_lock);
+	ret = co->co_pending;
+	spinlock_release(&wheel_lock);
+
+	return ret;
+}
+
+unsigned
+callout_ticks(void)
+{
+	return wheel_ticks;
+}
+
+void
+callout_bootstrap(void)
+{
+	unsigned i, j;
+
+	for (i=0; i<WHEEL_LEVELS; i++) {
+		for (j=0; j<WHEEL_SIZE; j++) {
+			wheel[i][j] = NULL;
+		}
+	}
+	wheel_ticks = 0;
+	wheel_running = NULL;
+}
+
+/*
+ * Advance the wheel by one tick and call whatever has expired.
+ * Called from hardclock() on cpu 0 only.
+ */
+void
+callout_hardclock(void)
+{
+	struct callout *co;
+	unsigned now, index, level;
+	void (*func)(void *);
+	void *data;
+
+	KASSERT(curcpu->c_number == 0);
+
+	spinlock_acquire(&wheel_lock);
+
+	now = ++wheel_ticks;
+	index = now & WHEEL_MASK;
+
+	/*
+	 * When level 0 wraps, pull down the next slot of level 1; when
+	 * that wraps too, pull down the next slot of level 2; etc.
+	 */
+	if (index == 0) {
+		for (level = 1; level < WHEEL_LEVELS; level++) {
+			if (wheel_cascade(level, (now >> (WHEEL_BITS * level))
+					  & WHEEL_MASK) != 0) {
+				break;
+			}
+		}
+	}
+
+	/*
+	 * Run the current slot. Unlock around each call so the
+	 * function can take other locks and reschedule itself; anything
+	 * it reschedules lands at least one tick later, so the loop
+	 * terminates.
+	 */
+	while ((co = wheel[0][index]) != NULL) {
+		wheel_unlink(co);
+		func = co->co_func;
+		data = co->co_data;
+		wheel_running = co;
+		spinlock_release(&wheel_lock);
+
+		func(data);
+
+		spinlock_acquire(&wheel_lock);
+		wheel_running = NULL;
+	}
+
+	spinlock_release(&wheel_lock);
+}
@@ -30,17 +30,19 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
+#include <callout.h>
 #include <thread.h>
 #include <current.h>
+#include <vdso.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Timed events are handled by callouts (see callout.c), which have a
+ * resolution of one hardclock tick.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -54,10 +56,13 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Threads in clocksleep() wait here. Nobody ever wakes this channel;
+ * each sleeper is woken individually by its own timeout, so there's
+ * no once-a-second stampede of threads checking whether it's time
+ * to get up yet.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+static struct wchan *sleep_wchan;
+static struct spinlock sleep_lock;
 
 /*
  * Setup.
@@ -65,24 +70,22 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	callout_bootstrap();
+
+	spinlock_init(&sleep_lock);
+	sleep_wchan = wchan_create("clocksleep");
+	if (sleep_wchan == NULL) {
+		panic("Couldn't create clocksleep wchan\n");
 	}
 }
 
 /*
  * This is called once per second, on one processor, by the timer
- * code.
+ * code. Nothing needs it any more; timed things use callouts.
  */
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
 }
 
 /*
@@ -97,6 +100,10 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0) {
+		callout_hardclock();
+		vdso_hardclock();
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -106,16 +113,49 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * Convert a time interval to hardclock ticks, rounding up so we never
+ * sleep for less than the requested time.
+ */
+unsigned
+timespec_to_ticks(const struct timespec *ts)
+{
+	uint64_t ticks;
+
+	ticks = (uint64_t)ts->tv_sec * HZ;
+	ticks += DIVROUNDUP((uint64_t)ts->tv_nsec, 1000000000 / HZ);
+	if (ticks > (unsigned)-1) {
+		ticks = (unsigned)-1;
+	}
+	return ticks;
+}
+
+/*
+ * Suspend execution for the given number of hardclock ticks.
+ */
+void
+ticksleep(unsigned ticks)
+{
+	unsigned start, elapsed;
+
+	start = callout_ticks();
+	elapsed = 0;
+
+	spinlock_acquire(&sleep_lock);
+	while (elapsed < ticks) {
+		wchan_timedsleep(sleep_wchan, &sleep_lock, ticks - elapsed);
+		elapsed = callout_ticks() - start;
+	}
+	spinlock_release(&sleep_lock);
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		ticksleep((unsigned)num_secs * HZ);
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -0,0 +1,331 @@
+/*
+ * Lock contention profiler. See lockprof.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <lockprof.h>
+
+/*
+ * The list of everything that has been acquired since it was
+ * initialized. This can't be protected by a struct spinlock, because
+ * spinlocks add themselves to the list while being acquired; so it
+ * gets a bare lock word instead. It is only ever held with interrupts
+ * off and for short stretches, and nothing else is acquired under it.
+ */
+static volatile spinlock_data_t lockprof_listlock = SPINLOCK_DATA_INITIALIZER;
+static struct lockprof *lockprof_list;
+static unsigned lockprof_count;
+
+static
+int
+lockprof_lock(void)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_testandset(&lockprof_listlock) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return spl;
+}
+
+static
+void
+lockprof_unlock(int spl)
+{
+	membar_any_store();
+	spinlock_data_set(&lockprof_listlock, 0);
+	splx(spl);
+}
+
+static
+void
+lockprof_zero(struct lockprof *lp)
+{
+	lp->lp_acquires = 0;
+	lp->lp_contended = 0;
+	lp->lp_waitcycles = 0;
+	lp->lp_maxwait = 0;
+	lp->lp_maxhold = 0;
+}
+
+void
+lockprof_init(struct lockprof *lp, const char *name)
+{
+	lp->lp_name = name;
+	lp->lp_site = NULL;
+	lp->lp_next = NULL;
+	lp->lp_prevp = NULL;
+	lockprof_zero(lp);
+	lp->lp_holdstart = 0;
+}
+
+void
+lockprof_cleanup(struct lockprof *lp)
+{
+	int spl;
+
+	if (lp->lp_prevp == NULL) {
+		return;
+	}
+	spl = lockprof_lock();
+	KASSERT(*lp->lp_prevp == lp);
+	*lp->lp_prevp = lp->lp_next;
+	if (lp->lp_next != NULL) {
+		lp->lp_next->lp_prevp = lp->lp_prevp;
+	}
+	lp->lp_next = NULL;
+	lp->lp_prevp = NULL;
+	lockprof_count--;
+	lockprof_unlock(spl);
+}
+
+void
+lockprof_wait(struct lockprof_wait *w)
+{
+	w->w_waited = true;
+	w->w_start = cpu_getcycles();
+}
+
+/*
+ * Called with the profiled object held.
+ */
+void
+lockprof_acquired(struct lockprof *lp, struct lockprof_wait *w,
+		  const void *site)
+{
+	uint32_t now, waited;
+	int spl;
+
+	now = cpu_getcycles();
+
+	if (lp->lp_prevp == NULL) {
+		/* First time; put it on the list. */
+		lp->lp_site = site;
+		spl = lockprof_lock();
+		lp->lp_next = lockprof_list;
+		if (lockprof_list != NULL) {
+			lockprof_list->lp_prevp = &lp->lp_next;
+		}
+		lockprof_list = lp;
+		lp->lp_prevp = &lockprof_list;
+		lockprof_count++;
+		lockprof_unlock(spl);
+	}
+
+	lp->lp_acquires++;
+	if (w->w_waited) {
+		waited = now - w->w_start;
+		lp->lp_contended++;
+		lp->lp_waitcycles += waited;
+		if (waited > lp->lp_maxwait) {
+			lp->lp_maxwait = waited;
+		}
+	}
+	lp->lp_holdstart = now;
+}
+
+/*
+ * Also called with the profiled object held, just before letting go.
+ */
+void
+lockprof_released(struct lockprof *lp)
+{
+	uint32_t held;
+
+	held = cpu_getcycles() - lp->lp_holdstart;
+	if (held > lp->lp_maxhold) {
+		lp->lp_maxhold = held;
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Reporting
+
+#define LOCKPROF_NAMELEN	24
+
+/*
+ * One line of the report: the totals for all the sleep locks and
+ * semaphores with one name, or all the spinlocks first taken from
+ * one place. Each starts out as a copy of a single entry.
+ */
+struct lockprof_report {
+	char r_name[LOCKPROF_NAMELEN];
+	const void *r_site;
+	unsigned r_count;
+	unsigned r_acquires;
+	unsigned r_contended;
+	uint64_t r_waitcycles;
+	uint32_t r_maxwait;
+	uint32_t r_maxhold;
+};
+
+/*
+ * Copy LP into R, as a report of one.
+ */
+static
+void
+lockprof_snap(struct lockprof_report *r, const struct lockprof *lp)
+{
+	/* Names longer than we print are cut short before comparing. */
+	r->r_name[0] = 0;
+	if (lp->lp_name != NULL) {
+		snprintf(r->r_name, sizeof(r->r_name), "%s", lp->lp_name);
+	}
+	r->r_site = lp->lp_site;
+	r->r_count = 1;
+	r->r_acquires = lp->lp_acquires;
+	r->r_contended = lp->lp_contended;
+	r->r_waitcycles = lp->lp_waitcycles;
+	r->r_maxwait = lp->lp_maxwait;
+	r->r_maxhold = lp->lp_maxhold;
+}
+
+static
+bool
+lockprof_matches(const struct lockprof_report *a,
+		 const struct lockprof_report *b)
+{
+	if (a->r_name[0] == 0 || b->r_name[0] == 0) {
+		return a->r_name[0] == b->r_name[0] && a->r_site == b->r_site;
+	}
+	return strcmp(a->r_name, b->r_name) == 0;
+}
+
+/*
+ * Add B into A.
+ */
+static
+void
+lockprof_add(struct lockprof_report *a, const struct lockprof_report *b)
+{
+	a->r_count += b->r_count;
+	a->r_acquires += b->r_acquires;
+	a->r_contended += b->r_contended;
+	a->r_waitcycles += b->r_waitcycles;
+	if (b->r_maxwait > a->r_maxwait) {
+		a->r_maxwait = b->r_maxwait;
+	}
+	if (b->r_maxhold > a->r_maxhold) {
+		a->r_maxhold = b->r_maxhold;
+	}
+}
+
+/*
+ * Print the MAX most contended entries, worst first. The counters
+ * are read without holding the locks they belong to, so the numbers
+ * are a snapshot that may be slightly torn on a busy system.
+ */
+void
+lockprof_print(unsigned max)
+{
+	struct lockprof_report *reports, tmp;
+	struct lockprof *lp;
+	unsigned size, nsnap, num, i, j;
+	bool overflow;
+	int spl;
+
+	/* Can't kmalloc under the list lock, so guess and leave slack. */
+	size = lockprof_count + 32;
+	reports = kmalloc(size * sizeof(*reports));
+	if (reports == NULL) {
+		kprintf("lockprof: out of memory\n");
+		return;
+	}
+
+	/*
+	 * Only copy the entries while holding the list lock, as that
+	 * has interrupts off; add them up once it's let go.
+	 */
+	nsnap = 0;
+	overflow = false;
+	spl = lockprof_lock();
+	for (lp = lockprof_list; lp != NULL; lp = lp->lp_next) {
+		if (*lp->lp_prevp != lp) {
+			panic("lockprof: list damaged at %p (spinlock freed "
+			      "without spinlock_cleanup?)\n", lp);
+		}
+		if (lp->lp_acquires == 0) {
+			continue;
+		}
+		if (nsnap == size) {
+			overflow = true;
+			break;
+		}
+		lockprof_snap(&reports[nsnap++], lp);
+	}
+	lockprof_unlock(spl);
+
+	/* Fold together the ones with the same name (or site). */
+	num = 0;
+	for (i=0; i<nsnap; i++) {
+		for (j=0; j<num; j++) {
+			if (lockprof_matches(&reports[j], &reports[i])) {
+				break;
+			}
+		}
+		if (j < num) {
+			lockprof_add(&reports[j], &reports[i]);
+		}
+		else {
+			reports[num++] = reports[i];
+		}
+	}
+
+	/* Sort by contended acquires; it's not a long list. */
+	for (i=1; i<num; i++) {
+		for (j=i; j>0 &&
+			     reports[j].r_contended > reports[j-1].r_contended;
+		     j--) {
+			tmp = reports[j];
+			reports[j] = reports[j-1];
+			reports[j-1] = tmp;
+		}
+	}
+
+	kprintf("%-24s %5s %10s %10s %12s %10s %10s\n", "name", "count",
+		"acquires", "contended", "avg wait", "max wait", "max hold");
+	for (i=0; i<num && i<max; i++) {
+		if (reports[i].r_name[0] == 0) {
+			snprintf(reports[i].r_name, LOCKPROF_NAMELEN,
+				 "spinlock %p", reports[i].r_site);
+		}
+		kprintf("%-24s %5u %10u %10u %12llu %10lu %10lu\n",
+			reports[i].r_name, reports[i].r_count,
+			reports[i].r_acquires, reports[i].r_contended,
+			reports[i].r_contended == 0 ? 0ULL :
+			(unsigned long long)(reports[i].r_waitcycles /
+					     reports[i].r_contended),
+			(unsigned long)reports[i].r_maxwait,
+			(unsigned long)reports[i].r_maxhold);
+	}
+	if (overflow) {
+		kprintf("lockprof: too many locks; some were left out\n");
+	}
+	kprintf("(times are in cycles)\n");
+
+	kfree(reports);
+}
+
+/*
+ * Zero all the counters. As with printing, this races with updates
+ * from lock holders, which is fine for statistics.
+ */
+void
+lockprof_reset(void)
+{
+	struct lockprof *lp;
+	int spl;
+
+	spl = lockprof_lock();
+	for (lp = lockprof_list; lp != NULL; lp = lp->lp_next) {
+		lockprof_zero(lp);
+	}
+	lockprof_unlock(spl);
+}
@@ -41,7 +41,25 @@
 
 /*
  * Spinlocks.
+ *
+ * These are ticket locks. The lock word holds two 16-bit counters:
+ * the next ticket to hand out (upper half) and the ticket now being
+ * served (lower half). To acquire, atomically take a ticket and wait
+ * for it to come up; to release, advance the now-serving counter.
+ * Waiters are thus served in FIFO order, and while waiting they only
+ * read the lock word, so a contended lock costs one atomic operation
+ * per acquire instead of a storm of failed test-and-sets. The lock is
+ * free when the two halves are equal.
+ *
+ * 16 bits of ticket is plenty as long as there are fewer than 65536
+ * cpus.
  */
+#define SPLK_TICKET_SHIFT	16
+#define SPLK_TICKET_ONE		((spinlock_data_t)1 << SPLK_TICKET_SHIFT)
+#define SPLK_SERVING_MASK	(SPLK_TICKET_ONE - 1)
+
+#define SPLK_TICKET(v)		((v) >> SPLK_TICKET_SHIFT)
+#define SPLK_SERVING(v)		((v) & SPLK_SERVING_MASK)
 
 
 /*
@@ -53,6 +71,7 @@ spinlock_init(struct spinlock *splk)
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	LOCKPROF_INIT(&splk->splk_prof, NULL);
 }
 
 /*
@@ -61,8 +80,12 @@ spinlock_init(struct spinlock *splk)
 void
 spinlock_cleanup(struct spinlock *splk)
 {
+	spinlock_data_t val;
+
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	val = spinlock_data_get(&splk->splk_lock);
+	KASSERT(SPLK_TICKET(val) == SPLK_SERVING(val));
+	LOCKPROF_CLEANUP(&splk->splk_prof);
 }
 
 /*
@@ -70,12 +93,14 @@ spinlock_cleanup(struct spinlock *splk)
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
  * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * atomic operation to take a ticket, and wait for it to be served.
  */
 void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+	LOCKPROF_WAITER(wait);
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -93,34 +118,47 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
-		}
-		break;
+	/*
+	 * Take a ticket. Fetch-and-add is the only atomic operation
+	 * needed; after that we just read the lock word until the
+	 * holder's release moves the now-serving counter to us.
+	 */
+	ticket = SPLK_TICKET(spinlock_data_fetchadd(&splk->splk_lock,
+						    SPLK_TICKET_ONE));
+	while (SPLK_SERVING(spinlock_data_get(&splk->splk_lock))
+	       != (ticket & SPLK_SERVING_MASK)) {
+		LOCKPROF_WAIT(wait);
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+	LOCKPROF_ACQUIRED(&splk->splk_prof, wait,
+			  __builtin_return_address(0));
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
 }
 
+/*
+ * Advance the now-serving counter. Other cpus may be taking tickets
+ * (changing the upper half) at the same time, so this has to be
+ * atomic too; and it mustn't carry into the upper half when it
+ * wraps, so it's a compare-and-swap rather than an add.
+ */
+static
+void
+spinlock_release_data(volatile spinlock_data_t *sd)
+{
+	spinlock_data_t oldval, newval;
+
+	do {
+		oldval = spinlock_data_get(sd);
+		newval = (oldval & ~SPLK_SERVING_MASK) |
+			((oldval + 1) & SPLK_SERVING_MASK);
+	} while (spinlock_data_compareandswap(sd, oldval, newval) != oldval);
+}
+
 /*
  * Release the lock.
  */
@@ -135,9 +173,10 @@ spinlock_release(struct spinlock *splk)
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
 
+	LOCKPROF_RELEASED(&splk->splk_prof);
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_release_data(&splk->splk_lock);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -33,9 +33,11 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <callout.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
@@ -69,6 +71,8 @@ sem_create(const char *name, unsigned initial_count)
 
 	spinlock_init(&sem->sem_lock);
 	sem->sem_count = initial_count;
+	sem->sem_handoff = false;
+	LOCKPROF_INIT(&sem->sem_prof, sem->sem_name);
 
 	return sem;
 }
@@ -79,6 +83,7 @@ sem_destroy(struct semaphore *sem)
 	KASSERT(sem != NULL);
 
 	/* wchan_cleanup will assert if anyone's waiting on it */
+	LOCKPROF_CLEANUP(&sem->sem_prof);
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
 	kfree(sem->sem_name);
@@ -88,6 +93,8 @@ sem_destroy(struct semaphore *sem)
 void
 P(struct semaphore *sem)
 {
+	LOCKPROF_WAITER(wait);
+
 	KASSERT(sem != NULL);
 
 	/*
@@ -100,6 +107,21 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_handoff) {
+		/*
+		 * In handoff mode V never raises the count while
+		 * anyone is asleep, so a nonzero count means there's
+		 * no queue to jump. Otherwise wait our turn; when we
+		 * are woken, V has passed its unit straight to us.
+		 */
+		if (sem->sem_count == 0) {
+			LOCKPROF_WAIT(wait);
+			wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+			LOCKPROF_ACQUIRED(&sem->sem_prof, wait, NULL);
+			spinlock_release(&sem->sem_lock);
+			return;
+		}
+	}
 	while (sem->sem_count == 0) {
 		/*
 		 *
@@ -110,13 +132,14 @@ P(struct semaphore *sem)
 		 * textbooks semaphores must for some reason have
 		 * strict ordering. Too bad. :-)
 		 *
-		 * Exercise: how would you implement strict FIFO
-		 * ordering?
+		 * (Unless sem_handoff is set; see above.)
 		 */
+		LOCKPROF_WAIT(wait);
 		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
 	}
 	KASSERT(sem->sem_count > 0);
 	sem->sem_count--;
+	LOCKPROF_ACQUIRED(&sem->sem_prof, wait, NULL);
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -127,10 +150,29 @@ V(struct semaphore *sem)
 
 	spinlock_acquire(&sem->sem_lock);
 
-	sem->sem_count++;
-	KASSERT(sem->sem_count > 0);
-	wchan_wakeone(sem->sem_wchan, &sem->sem_lock);
+	if (sem->sem_handoff) {
+		/* Give it to the first sleeper, if there is one. */
+		if (!wchan_wakeone(sem->sem_wchan, &sem->sem_lock)) {
+			sem->sem_count++;
+			KASSERT(sem->sem_count > 0);
+		}
+	}
+	else {
+		sem->sem_count++;
+		KASSERT(sem->sem_count > 0);
+		wchan_wakeone(sem->sem_wchan, &sem->sem_lock);
+	}
+
+	spinlock_release(&sem->sem_lock);
+}
+
+void
+sem_sethandoff(struct semaphore *sem, bool handoff)
+{
+	KASSERT(sem != NULL);
 
+	spinlock_acquire(&sem->sem_lock);
+	sem->sem_handoff = handoff;
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -138,6 +180,15 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Adaptive spinning: a waiter spins in chunks of LOCK_SPINCHUNK
+ * polls of lk_holder, rechecking under lk_lock between chunks that
+ * the holder is still running, for at most LOCK_SPINMAX chunks
+ * before giving up and sleeping.
+ */
+#define LOCK_SPINCHUNK	100
+#define LOCK_SPINMAX	50
+
 struct lock *
 lock_create(const char *name)
 {
@@ -164,6 +215,9 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_handoff = false;
+	lock->lk_granted = false;
+	LOCKPROF_INIT(&lock->lk_prof, lock->lk_name);
 
 	return lock;
 }
@@ -174,6 +228,8 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	KASSERT(!lock->lk_granted);
+	LOCKPROF_CLEANUP(&lock->lk_prof);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -181,28 +237,135 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * Spin for a while, with the spinlock released, to see if HOLDER
+ * lets go of the lock.
+ */
+static
 void
-lock_acquire(struct lock *lock)
+lock_spin(struct lock *lock, struct thread *holder)
+{
+	unsigned i;
+
+	spinlock_release(&lock->lk_lock);
+	for (i=0; i<LOCK_SPINCHUNK; i++) {
+		if (lock->lk_holder != holder) {
+			break;
+		}
+	}
+	spinlock_acquire(&lock->lk_lock);
+}
+
+/*
+ * Common code for lock_acquire and lock_timedacquire. If TIMED is
+ * false, TICKS is ignored and we never time out.
+ */
+static
+int
+lock_get(struct lock *lock, bool timed, unsigned ticks)
 {
+	struct thread *holder;
+	unsigned start, elapsed, spins;
+	int result;
+	LOCKPROF_WAITER(wait);
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
+	start = callout_ticks();
+	spins = 0;
+
 	spinlock_acquire(&lock->lk_lock);
 
 	/* Call this (atomically) before waiting for a lock */
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
-	while (lock->lk_holder != NULL) {
-		/* As in the semaphore. */
-		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+
+	if (lock->lk_handoff) {
+		/*
+		 * If the lock is held, or in transit to a thread
+		 * lock_release just woke, get in line. Being woken
+		 * (rather than timing out) means we've been given it.
+		 */
+		if (lock->lk_holder != NULL || lock->lk_granted) {
+			LOCKPROF_WAIT(wait);
+			if (timed) {
+				result = wchan_timedsleep(lock->lk_wchan,
+							  &lock->lk_lock,
+							  ticks);
+			}
+			else {
+				wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+				result = 0;
+			}
+			if (result) {
+				goto giveup;
+			}
+			KASSERT(lock->lk_holder == NULL);
+			KASSERT(lock->lk_granted);
+			lock->lk_granted = false;
+		}
+	}
+	else {
+		while ((holder = lock->lk_holder) != NULL) {
+			LOCKPROF_WAIT(wait);
+
+			/*
+			 * If the holder is running (necessarily on
+			 * another cpu) it will probably let go soon;
+			 * spin rather than pay for two context
+			 * switches. Holding lk_lock means the holder
+			 * can't release and go away while we look at
+			 * it.
+			 */
+			if (holder->t_state == S_RUN &&
+			    spins < LOCK_SPINMAX) {
+				spins++;
+				lock_spin(lock, holder);
+				continue;
+			}
+			if (timed) {
+				elapsed = callout_ticks() - start;
+				if (elapsed >= ticks) {
+					goto giveup;
+				}
+				wchan_timedsleep(lock->lk_wchan,
+						 &lock->lk_lock,
+						 ticks - elapsed);
+			}
+			else {
+				/* As in the semaphore. */
+				wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+			}
+		}
 	}
 	lock->lk_holder = curthread;
+	LOCKPROF_ACQUIRED(&lock->lk_prof, wait, NULL);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
 
 	spinlock_release(&lock->lk_lock);
+	return 0;
+
+ giveup:
+	/* Not waiting any more; tell hangman so. */
+	HANGMAN_GIVEUP(&curthread->t_hangman, &lock->lk_hangman);
+	spinlock_release(&lock->lk_lock);
+	return ETIMEDOUT;
+}
+
+void
+lock_acquire(struct lock *lock)
+{
+	lock_get(lock, false, 0);
+}
+
+int
+lock_timedacquire(struct lock *lock, unsigned ticks)
+{
+	return lock_get(lock, true, ticks);
 }
 
 void
@@ -213,8 +376,13 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
+	LOCKPROF_RELEASED(&lock->lk_prof);
 	lock->lk_holder = NULL;
-	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	if (wchan_wakeone(lock->lk_wchan, &lock->lk_lock) &&
+	    lock->lk_handoff) {
+		/* The thread we woke owns it now. */
+		lock->lk_granted = true;
+	}
 
 	/* Call this (atomically) when the lock is released */
 	HANGMAN_RELEASE(&curthread->t_hangman, &lock->lk_hangman);
@@ -222,6 +390,17 @@ lock_release(struct lock *lock)
 	spinlock_release(&lock->lk_lock);
 }
 
+void
+lock_sethandoff(struct lock *lock, bool handoff)
+{
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(!lock->lk_granted);
+	lock->lk_handoff = handoff;
+	spinlock_release(&lock->lk_lock);
+}
+
 bool
 lock_do_i_hold(struct lock *lock)
 {
@@ -283,6 +462,8 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+	KASSERT(lock_do_i_hold(lock));
+
 	spinlock_acquire(&cv->cv_wchanlock);
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
@@ -298,6 +479,22 @@ cv_wait(struct cv *cv, struct lock *lock)
 	lock_acquire(lock);
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	int result;
+
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	result = wchan_timedsleep(cv->cv_wchan, &cv->cv_wchanlock, ticks);
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+
+	return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -315,3 +512,166 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	HANGMAN_LOCKABLEINIT(&rw->rwlock_hangman, rw->rwlock_name);
+
+	rw->rwlock_rwchan = wchan_create(rw->rwlock_name);
+	if (rw->rwlock_rwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+	rw->rwlock_wwchan = wchan_create(rw->rwlock_name);
+	if (rw->rwlock_wwchan == NULL) {
+		wchan_destroy(rw->rwlock_rwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rwlock_lock);
+	rw->rwlock_readers = 0;
+	rw->rwlock_wwaiting = 0;
+	rw->rwlock_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rwlock_readers == 0);
+	KASSERT(rw->rwlock_wwaiting == 0);
+	KASSERT(rw->rwlock_writer == NULL);
+	spinlock_cleanup(&rw->rwlock_lock);
+	wchan_destroy(rw->rwlock_wwchan);
+	wchan_destroy(rw->rwlock_rwchan);
+
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rwlock_lock);
+
+	KASSERT(rw->rwlock_writer != curthread);
+
+	/* Wait behind any writer, running or waiting. */
+	if (rw->rwlock_writer != NULL || rw->rwlock_wwaiting > 0) {
+		HANGMAN_WAIT(&curthread->t_hangman, &rw->rwlock_hangman);
+		while (rw->rwlock_writer != NULL || rw->rwlock_wwaiting > 0) {
+			wchan_sleep(rw->rwlock_rwchan, &rw->rwlock_lock);
+		}
+		HANGMAN_GIVEUP(&curthread->t_hangman, &rw->rwlock_hangman);
+	}
+	rw->rwlock_readers++;
+
+	spinlock_release(&rw->rwlock_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlock_lock);
+
+	KASSERT(rw->rwlock_readers > 0);
+	KASSERT(rw->rwlock_writer == NULL);
+	rw->rwlock_readers--;
+	if (rw->rwlock_readers == 0 && rw->rwlock_wwaiting > 0) {
+		wchan_wakeone(rw->rwlock_wwchan, &rw->rwlock_lock);
+	}
+
+	spinlock_release(&rw->rwlock_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rwlock_lock);
+
+	HANGMAN_WAIT(&curthread->t_hangman, &rw->rwlock_hangman);
+
+	KASSERT(rw->rwlock_writer != curthread);
+	if (rw->rwlock_writer != NULL || rw->rwlock_readers > 0) {
+		rw->rwlock_wwaiting++;
+		while (rw->rwlock_writer != NULL || rw->rwlock_readers > 0) {
+			wchan_sleep(rw->rwlock_wwchan, &rw->rwlock_lock);
+		}
+		rw->rwlock_wwaiting--;
+	}
+	rw->rwlock_writer = curthread;
+
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &rw->rwlock_hangman);
+
+	spinlock_release(&rw->rwlock_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlock_lock);
+
+	KASSERT(rw->rwlock_writer == curthread);
+	KASSERT(rw->rwlock_readers == 0);
+	rw->rwlock_writer = NULL;
+
+	/* Writers first; if there are none, let all the readers in. */
+	if (rw->rwlock_wwaiting > 0) {
+		wchan_wakeone(rw->rwlock_wwchan, &rw->rwlock_lock);
+	}
+	else {
+		wchan_wakeall(rw->rwlock_rwchan, &rw->rwlock_lock);
+	}
+
+	HANGMAN_RELEASE(&curthread->t_hangman, &rw->rwlock_hangman);
+
+	spinlock_release(&rw->rwlock_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rwlock_lock);
+	ret = (rw->rwlock_writer == curthread);
+	spinlock_release(&rw->rwlock_lock);
+
+	return ret;
+}
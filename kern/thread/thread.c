@@ -43,6 +43,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <callout.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
@@ -53,11 +54,23 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <sysprof.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Most threads that exit are soon replaced by new ones, so rather
+ * than freeing each dead thread and its stack and allocating them
+ * again in thread_fork, each cpu keeps up to this many around for
+ * reuse. See thread_pool_put and thread_pool_get.
+ */
+#define THREAD_POOL_MAX 16
+
+/* Affinity mask bit for a cpu. */
+#define CPUMASK(c)	((uint32_t)1 << (c)->c_number)
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -72,6 +85,12 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Timeout handler for wchan_timedsleep. */
+static void wchan_timeout(void *data);
+
+/* Used by thread_sendmovers. */
+static void thread_make_runnable(struct thread *target, bool already_have_lock);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -142,8 +161,13 @@ thread_create(const char *name)
 	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
+	thread->t_affinity = THREAD_AFFINITY_ALL;
 	thread->t_proc = NULL;
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	thread->t_wchan = NULL;
+	thread->t_sleeplock = NULL;
+	callout_init(&thread->t_timeout, wchan_timeout, thread);
+	thread->t_timedout = false;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -180,11 +204,13 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_movers);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
+	threadlist_init(&c->c_threadpool);
 	spinlock_init(&c->c_runqueue_lock);
 
 	c->c_ipi_pending = 0;
@@ -195,6 +221,7 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	SYSPROF_CPU_INIT(c->c_number);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -277,6 +304,8 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_wchan == NULL);
+	callout_cleanup(&thread->t_timeout);
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
 	}
@@ -290,9 +319,136 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Put a dead thread in the current cpu's pool for thread_fork to
+ * reuse. It keeps its name and stack; everything else is reset when
+ * it's taken out again. Returns false if the pool is full, or if the
+ * thread can't be reused because it's a cpu's boot thread without a
+ * stack of its own.
+ */
+static
+bool
+thread_pool_put(struct thread *thread)
+{
+	bool ret;
+
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_wchan == NULL);
+
+	if (thread->t_stack == NULL) {
+		return false;
+	}
+	thread_checkstack(thread);
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	ret = curcpu->c_threadpool.tl_count < THREAD_POOL_MAX;
+	if (ret) {
+		threadlist_addhead(&curcpu->c_threadpool, thread);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return ret;
+}
+
+/*
+ * Get a thread from the current cpu's pool and make it look like it
+ * came from thread_create, with the name NAME and a stack attached.
+ * Returns NULL if the pool is empty.
+ */
+static
+struct thread *
+thread_pool_get(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	spinlock_release(&curcpu->c_runqueue_lock);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	/* Forks mostly reuse the same few names; avoid the kstrdup. */
+	if (strlen(name) <= strlen(thread->t_name)) {
+		strcpy(thread->t_name, name);
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			thread_destroy(thread);
+			return NULL;
+		}
+		kfree(thread->t_name);
+		thread->t_name = newname;
+	}
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/*
+	 * Thread subsystem fields. t_machdep, t_listnode, and
+	 * t_timeout are left in their initial states by a thread
+	 * that exits, so don't need anything done.
+	 */
+	KASSERT(thread->t_stack != NULL);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_affinity = THREAD_AFFINITY_ALL;
+	KASSERT(thread->t_proc == NULL);
+	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	KASSERT(thread->t_wchan == NULL);
+	thread->t_sleeplock = NULL;
+	KASSERT(!callout_pending(&thread->t_timeout));
+	thread->t_timedout = false;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to reset it here too */
+
+	/* The stack itself is just scratch space, except for this. */
+	thread_checkstack_init(thread);
+
+	return thread;
+}
+
+/*
+ * Free all pooled threads on all cpus.
+ */
+unsigned
+thread_reclaim(void)
+{
+	struct threadlist victims;
+	struct thread *t;
+	struct cpu *c;
+	unsigned i, numcpus, count;
+
+	threadlist_init(&victims);
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		while ((t = threadlist_remhead(&c->c_threadpool)) != NULL) {
+			threadlist_addtail(&victims, t);
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	count = 0;
+	while ((t = threadlist_remhead(&victims)) != NULL) {
+		thread_destroy(t);
+		count++;
+	}
+	threadlist_cleanup(&victims);
+	return count;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Keep them for reuse if
+ * there's room in the pool.
  *
  * The list of zombies is per-cpu.
  */
@@ -305,7 +461,27 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_pool_put(z)) {
+			thread_destroy(z);
+		}
+	}
+}
+
+/*
+ * Send off threads that yielded on a cpu their affinity mask doesn't
+ * allow. (See thread_switch.) Like zombies, they can't be touched
+ * until we're off their stacks, so this is done by the next thread.
+ */
+static
+void
+thread_sendmovers(void)
+{
+	struct thread *t;
+
+	while ((t = threadlist_remhead(&curcpu->c_movers)) != NULL) {
+		KASSERT(t != curthread);
+		KASSERT(t->t_state == S_READY);
+		thread_make_runnable(t, false);
 	}
 }
 
@@ -445,16 +621,105 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Return the number of CPUs, running or not yet started.
+ */
+unsigned
+thread_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Rough measure of how busy a cpu is: the threads waiting to run,
+ * plus the one running if it isn't idle. This is read without the
+ * runqueue lock, so it's only a hint.
+ */
+static
+unsigned
+thread_cpuload(struct cpu *c)
+{
+	return c->c_runqueue.tl_count + (c->c_isidle ? 0 : 1);
+}
+
+/*
+ * Choose a cpu for a thread that's waking up (or new) to run on.
+ * PREV is the cpu it last ran on, whose runqueue lock we hold. Only
+ * cpus in the thread's affinity mask are considered.
+ *
+ *   - If PREV is idle, use it: it can start right away, and may
+ *     still have the thread's working set in its cache.
+ *   - Otherwise, if the waker is a thread (not an interrupt) and
+ *     nothing else is waiting on its cpu, use that: the waker will
+ *     likely block soon (producer/consumer handoff) and the woken
+ *     thread picks up where it left off, with the data it was
+ *     handed still warm.
+ *   - Otherwise use whichever cpu is least loaded, preferring PREV
+ *     and then the waker's cpu on ties.
+ */
+static
+struct cpu *
+thread_choose_cpu(struct thread *target, struct cpu *prev)
+{
+	struct cpu *best, *c, *mine;
+	unsigned i, numcpus, load, bestload;
+	uint32_t mask;
+
+	mask = target->t_affinity;
+
+	if (prev->c_isidle && (mask & CPUMASK(prev))) {
+		return prev;
+	}
+
+	mine = curcpu->c_self;
+	if ((mask & CPUMASK(mine)) && !curthread->t_in_interrupt &&
+	    !mine->c_isidle && mine->c_runqueue.tl_count == 0) {
+		return mine;
+	}
+
+	best = NULL;
+	bestload = 0;
+	if (mask & CPUMASK(prev)) {
+		best = prev;
+		bestload = thread_cpuload(prev);
+	}
+	if ((mask & CPUMASK(mine)) &&
+	    (best == NULL || thread_cpuload(mine) < bestload)) {
+		best = mine;
+		bestload = thread_cpuload(mine);
+	}
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus && (best == NULL || bestload > 0); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if ((mask & CPUMASK(c)) == 0) {
+			continue;
+		}
+		load = thread_cpuload(c);
+		if (best == NULL || load < bestload) {
+			best = c;
+			bestload = load;
+		}
+	}
+
+	/* thread_setaffinity doesn't allow masks with no cpus in them */
+	KASSERT(best != NULL);
+	return best;
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too.
+ * If ALREADY_HAVE_LOCK is set, the thread is curthread yielding, and
+ * goes back on its own cpu's run queue, which we have locked.
+ * Otherwise, it's a thread being woken up or a new thread, and we
+ * pick a cpu for it with thread_choose_cpu; targetcpu might be
+ * curcpu; it might not be, too.
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
-	struct cpu *targetcpu;
+	struct cpu *targetcpu, *newcpu;
 
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
@@ -464,7 +729,29 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
 	}
 	else {
+		/*
+		 * A thread going to sleep holds its cpu's runqueue
+		 * lock until it has finished switching out (see
+		 * thread_switch), so once we have this lock it's
+		 * safe to send the thread elsewhere -- unless the cpu
+		 * went idle, in which case it drops the lock while
+		 * still running on the thread's stack. Then the
+		 * thread is still its c_curthread, and has to stay.
+		 */
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		if (targetcpu->c_curthread == target) {
+			KASSERT(targetcpu->c_isidle);
+			newcpu = targetcpu;
+		}
+		else {
+			newcpu = thread_choose_cpu(target, targetcpu);
+		}
+		if (newcpu != targetcpu) {
+			spinlock_release(&targetcpu->c_runqueue_lock);
+			targetcpu = newcpu;
+			target->t_cpu = targetcpu;
+			spinlock_acquire(&targetcpu->c_runqueue_lock);
+		}
 	}
 
 	/* Target thread is now ready to run; put it on the run queue. */
@@ -492,7 +779,8 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  *
  * The new thread is created in the process P. If P is null, the
  * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * as the caller if that CPU has nothing else to do, and otherwise on
+ * the least busy one (see thread_choose_cpu).
  */
 int
 thread_fork(const char *name,
@@ -503,18 +791,22 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Reuse a dead thread if we have one; otherwise make one. */
+	newthread = thread_pool_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -522,6 +814,7 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_affinity = curthread->t_affinity;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -602,7 +895,19 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		if (cur->t_affinity & CPUMASK(curcpu)) {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
+		else {
+			/*
+			 * Not allowed here any more. We can't hand it
+			 * to another cpu while we're still on its
+			 * stack; the next thread sends it on its way.
+			 * (The run queue isn't empty, or we'd have
+			 * returned above, so there is a next thread.)
+			 */
+			threadlist_addtail(&curcpu->c_movers, cur);
+		}
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
@@ -615,6 +920,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 * on the list.
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
+		cur->t_sleeplock = lk;
 		spinlock_release(lk);
 		break;
 	    case S_ZOMBIE:
@@ -726,6 +1033,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Send off threads that have to move elsewhere. */
+	thread_sendmovers();
+
 	/* Turn interrupts back on. */
 	splx(spl);
 }
@@ -759,6 +1069,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Send off threads that have to move elsewhere. */
+	thread_sendmovers();
+
 	/* Enable interrupts. */
 	spl0();
 
@@ -816,6 +1129,86 @@ thread_yield(void)
 	thread_switch(S_READY, NULL, NULL);
 }
 
+/*
+ * Thread forked by thread_setaffinity to give the cpu something else
+ * to run while we leave it.
+ */
+static
+void
+thread_affinity_stepaside(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+}
+
+/*
+ * Set the current thread's affinity mask.
+ */
+int
+thread_setaffinity(uint32_t mask)
+{
+	struct cpu *here;
+	uint32_t online, oldmask;
+	unsigned i;
+	int spl, result;
+
+	online = 0;
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		online |= CPUMASK(cpuarray_get(&allcpus, i));
+	}
+	mask &= online;
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	oldmask = curthread->t_affinity;
+	while (1) {
+		spl = splhigh();
+		here = curcpu->c_self;
+		if (mask & CPUMASK(here)) {
+			/* Can stay (or have arrived) where we are. */
+			curthread->t_affinity = mask;
+			splx(spl);
+			return 0;
+		}
+
+		/*
+		 * We have to move. That happens when we yield (see
+		 * thread_switch) but only if there's another thread
+		 * here to yield to; if the cpu would otherwise go idle
+		 * it'd be idling on our stack and we couldn't leave.
+		 * So first fork a thread that does nothing, pinned here
+		 * (by inheriting our mask) so it goes on this cpu's
+		 * run queue.
+		 */
+		curthread->t_affinity = CPUMASK(here);
+		splx(spl);
+
+		result = thread_fork("affinity", kproc,
+				     thread_affinity_stepaside, NULL, 0);
+		if (result) {
+			curthread->t_affinity = oldmask;
+			return result;
+		}
+
+		/*
+		 * If we got preempted after forking, the new thread
+		 * may have come and gone already, in which case the
+		 * yield won't go anywhere and we go around again.
+		 */
+		spl = splhigh();
+		curthread->t_affinity = mask;
+		thread_yield();
+		splx(spl);
+	}
+}
+
+uint32_t
+thread_getaffinity(void)
+{
+	return curthread->t_affinity;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -922,6 +1315,16 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/*
+			 * Likewise skip threads whose affinity doesn't
+			 * allow them on this cpu.
+			 */
+			if ((t->t_affinity & CPUMASK(c)) == 0) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
+
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
 			DEBUG(DB_THREADS,
@@ -1020,9 +1423,71 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * Timeout handler for wchan_timedsleep, called from the timer
+ * interrupt. If the thread is still asleep, take it off its wait
+ * channel and wake it up. If someone already woke it, t_wchan has
+ * been cleared (under the same lock) and there's nothing to do.
  */
+static
 void
+wchan_timeout(void *data)
+{
+	struct thread *target = data;
+	struct spinlock *lk;
+
+	/* t_sleeplock is stable until the sleeper stops the callout */
+	lk = target->t_sleeplock;
+	KASSERT(lk != NULL);
+
+	spinlock_acquire(lk);
+	if (target->t_wchan != NULL) {
+		threadlist_remove(&target->t_wchan->wc_threads, target);
+		target->t_wchan = NULL;
+		target->t_timedout = true;
+		thread_make_runnable(target, false);
+	}
+	spinlock_release(lk);
+}
+
+/*
+ * Like wchan_sleep, but with a timeout. The timeout callout is armed
+ * while we still hold LK, so it can't run before we're on the
+ * channel; and it's stopped before we return, so it can't run after
+ * we've gone on to do something else.
+ */
+int
+wchan_timedsleep(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct thread *cur = curthread;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!cur->t_in_interrupt);
+
+	/* must hold the spinlock */
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* must not hold other spinlocks */
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	cur->t_timedout = false;
+	cur->t_sleeplock = lk;
+	callout_schedule(&cur->t_timeout, ticks);
+
+	thread_switch(S_SLEEP, wc, lk);
+
+	/* No locks held here, so it's safe to wait for the handler. */
+	callout_stop(&cur->t_timeout);
+	cur->t_sleeplock = NULL;
+
+	spinlock_acquire(lk);
+	return cur->t_timedout ? ETIMEDOUT : 0;
+}
+
+/*
+ * Wake up one thread sleeping on a wait channel. Returns true if
+ * there was one.
+ */
+bool
 wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *target;
@@ -1034,8 +1499,9 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
-		return;
+		return false;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1046,6 +1512,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 */
 
 	thread_make_runnable(target, false);
+	return true;
 }
 
 /*
@@ -1066,6 +1533,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
@@ -1081,6 +1549,26 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up one particular thread sleeping on a wait channel. Returns
+ * true if it was sleeping there.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct spinlock *lk, struct thread *target)
+{
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* t_wchan is set and cleared under LK, so this is stable. */
+	if (target->t_wchan != wc) {
+		return false;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+
+	thread_make_runnable(target, false);
+	return true;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1111,8 +1599,15 @@ ipi_send(struct cpu *target, int code)
 	KASSERT(code >= 0 && code < 32);
 
 	spinlock_acquire(&target->c_ipi_lock);
+	/*
+	 * If anything is already pending, an interrupt is already on
+	 * its way, and the handler will pick up this bit along with
+	 * the others; don't send another one.
+	 */
+	if (target->c_ipi_pending == 0) {
+		mainbus_send_ipi(target);
+	}
 	target->c_ipi_pending |= (uint32_t)1 << code;
-	mainbus_send_ipi(target);
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1161,8 +1656,11 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 		target->c_numshootdown = n+1;
 	}
 
+	/* As in ipi_send. */
+	if (target->c_ipi_pending == 0) {
+		mainbus_send_ipi(target);
+	}
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
 }
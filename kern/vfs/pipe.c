@@ -0,0 +1,684 @@
+/*
+ * Pipes.
+ *
+ * Data sits in a ring of page-sized buffers. Small writes are copied
+ * into the last buffer until it fills, and then into a fresh page.
+ *
+ * A large write from user memory that starts on a page boundary
+ * doesn't get copied in at all: the writer lends the pages of its
+ * buffer to the pipe, by putting their kernel addresses in the ring,
+ * and waits until the reader has copied them out. That way the data
+ * is copied once instead of twice. If the reader goes away first,
+ * only what it actually took counts as written. The lent pages stay put while the
+ * writer waits, because it's stuck inside write() and its address
+ * space can't be destroyed until it comes back out.
+ *
+ * Everything is protected by pp_lock, a sleep lock, since the copies
+ * in and out can fault. Pollers wait on pp_readpq and pp_writepq,
+ * which get woken along with the cvs.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+/* Number of page buffers in the ring. */
+#define PIPE_NBUFS	8
+
+struct pipebuf {
+	char *pb_data;			/* our page, or a lent one */
+	size_t pb_start;		/* first unread byte */
+	size_t pb_end;			/* end of the data */
+	bool pb_lent;			/* pb_data belongs to a writer */
+};
+
+struct pipe {
+	struct lock *pp_lock;
+	struct cv *pp_readcv;		/* readers wait here for data */
+	struct cv *pp_writecv;		/* writers wait here for room */
+	struct pollqueue pp_readpq;	/* pollers waiting to read */
+	struct pollqueue pp_writepq;	/* pollers waiting to write */
+	struct pipebuf pp_bufs[PIPE_NBUFS];
+	unsigned pp_head;		/* oldest buffer */
+	unsigned pp_nbufs;		/* buffers in use */
+	unsigned pp_nlent;		/* lent buffers among them */
+	size_t pp_lenttaken;		/* bytes read from lent buffers */
+	size_t pp_nbytes;		/* unread bytes */
+	char *pp_spare;			/* a free page, kept for reuse */
+	bool pp_nonblock;		/* EAGAIN instead of waiting */
+	bool pp_readopen;		/* read end still exists */
+	bool pp_writeopen;		/* write end still exists */
+	struct vnode pp_readvn;
+	struct vnode pp_writevn;
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+/*
+ * Wake up anyone waiting to read, or to write, including pollers.
+ */
+static
+void
+pipe_wakereaders(struct pipe *pp)
+{
+	cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	pollqueue_wakeup(&pp->pp_readpq);
+}
+
+static
+void
+pipe_wakewriters(struct pipe *pp)
+{
+	cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	pollqueue_wakeup(&pp->pp_writepq);
+}
+
+////////////////////////////////////////////////////////////
+// ring buffer
+
+/*
+ * Room for more copied-in data: what's left in the last buffer, if
+ * it's one of ours, plus the unused buffers.
+ */
+static
+size_t
+pipe_room(struct pipe *pp)
+{
+	struct pipebuf *pb;
+	size_t room;
+
+	room = (PIPE_NBUFS - pp->pp_nbufs) * PAGE_SIZE;
+	if (pp->pp_nbufs > 0) {
+		pb = &pp->pp_bufs[(pp->pp_head + pp->pp_nbufs - 1) % PIPE_NBUFS];
+		if (!pb->pb_lent) {
+			room += PAGE_SIZE - pb->pb_end;
+		}
+	}
+	return room;
+}
+
+/*
+ * Add a buffer to the end of the ring. DATA is either a page of ours
+ * or, if LENT is set, a writer's page, full of data.
+ */
+static
+void
+pipe_pushbuf(struct pipe *pp, char *data, bool lent)
+{
+	struct pipebuf *pb;
+
+	KASSERT(pp->pp_nbufs < PIPE_NBUFS);
+	pb = &pp->pp_bufs[(pp->pp_head + pp->pp_nbufs) % PIPE_NBUFS];
+	pb->pb_data = data;
+	pb->pb_start = 0;
+	pb->pb_end = lent ? PAGE_SIZE : 0;
+	pb->pb_lent = lent;
+	pp->pp_nbufs++;
+	if (lent) {
+		pp->pp_nlent++;
+		pp->pp_nbytes += PAGE_SIZE;
+	}
+}
+
+/*
+ * Drop the first buffer in the ring, freeing it if it's ours and
+ * giving it back if it's lent.
+ */
+static
+void
+pipe_popbuf(struct pipe *pp)
+{
+	struct pipebuf *pb;
+
+	KASSERT(pp->pp_nbufs > 0);
+	pb = &pp->pp_bufs[pp->pp_head];
+	pp->pp_nbytes -= pb->pb_end - pb->pb_start;
+	if (pb->pb_lent) {
+		KASSERT(pp->pp_nlent > 0);
+		pp->pp_nlent--;
+	}
+	else if (pp->pp_spare == NULL) {
+		pp->pp_spare = pb->pb_data;
+	}
+	else {
+		kfree(pb->pb_data);
+	}
+	pb->pb_data = NULL;
+	pp->pp_head = (pp->pp_head + 1) % PIPE_NBUFS;
+	pp->pp_nbufs--;
+}
+
+/*
+ * Copy in as much of UIO as fits.
+ */
+static
+int
+pipe_fill(struct pipe *pp, struct uio *uio)
+{
+	struct pipebuf *pb;
+	char *page;
+	size_t len;
+	int result;
+
+	while (uio->uio_resid > 0 && pipe_room(pp) > 0) {
+		pb = NULL;
+		if (pp->pp_nbufs > 0) {
+			pb = &pp->pp_bufs[(pp->pp_head + pp->pp_nbufs - 1)
+					  % PIPE_NBUFS];
+			if (pb->pb_lent || pb->pb_end == PAGE_SIZE) {
+				pb = NULL;
+			}
+		}
+		if (pb == NULL) {
+			page = pp->pp_spare;
+			pp->pp_spare = NULL;
+			if (page == NULL) {
+				page = kmalloc(PAGE_SIZE);
+				if (page == NULL) {
+					return ENOMEM;
+				}
+			}
+			pipe_pushbuf(pp, page, false);
+			pb = &pp->pp_bufs[(pp->pp_head + pp->pp_nbufs - 1)
+					  % PIPE_NBUFS];
+		}
+
+		len = PAGE_SIZE - pb->pb_end;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pb->pb_data + pb->pb_end, len, uio);
+		if (result) {
+			return result;
+		}
+		pb->pb_end += len;
+		pp->pp_nbytes += len;
+	}
+	return 0;
+}
+
+/*
+ * Check if the next part of UIO can be lent instead of copied: it
+ * must be user memory, start on a page boundary, and run for at least
+ * a page. Only one writer lends at a time.
+ */
+static
+bool
+pipe_canlend(struct pipe *pp, struct uio *uio)
+{
+	struct iovec *iov;
+
+	if (uio->uio_segflg != UIO_USERSPACE || pp->pp_nlent > 0 ||
+	    pp->pp_nbufs == PIPE_NBUFS) {
+		return false;
+	}
+
+	/* skip empty iovecs, as uiomove would */
+	while (uio->uio_iov->iov_len == 0 && uio->uio_iovcnt > 1) {
+		uio->uio_iov++;
+		uio->uio_iovcnt--;
+	}
+	iov = uio->uio_iov;
+
+	return ((vaddr_t)iov->iov_ubase % PAGE_SIZE == 0 &&
+		iov->iov_len >= PAGE_SIZE);
+}
+
+/*
+ * Lend whole pages from the front of UIO, as many as the ring has
+ * room for, and wait until the reader is done with them (or gone).
+ * UIO is advanced past what the reader took, which is all of it
+ * unless the read end was closed. Returns the number of pages lent;
+ * if that's 0, the caller should copy instead.
+ */
+static
+unsigned
+pipe_lend(struct pipe *pp, struct uio *uio)
+{
+	struct iovec *iov;
+	vaddr_t kpage;
+	unsigned i, npages;
+	size_t taken;
+
+	iov = uio->uio_iov;
+	npages = iov->iov_len / PAGE_SIZE;
+	if (npages > PIPE_NBUFS - pp->pp_nbufs) {
+		npages = PIPE_NBUFS - pp->pp_nbufs;
+	}
+
+	pp->pp_lenttaken = 0;
+	for (i=0; i<npages; i++) {
+		if (vm_getkpage((vaddr_t)iov->iov_ubase + i * PAGE_SIZE,
+				false, &kpage)) {
+			/* let the copying code sort it out */
+			break;
+		}
+		pipe_pushbuf(pp, (char *)kpage, true);
+	}
+	if (i == 0) {
+		return 0;
+	}
+
+	pipe_wakereaders(pp);
+	while (pp->pp_nlent > 0 && pp->pp_readopen) {
+		cv_wait(pp->pp_writecv, pp->pp_lock);
+	}
+
+	/* If the reader went away, the rest was thrown out unread. */
+	taken = pp->pp_lenttaken;
+	KASSERT(taken <= i * PAGE_SIZE);
+	KASSERT(taken == i * PAGE_SIZE || !pp->pp_readopen);
+	iov->iov_ubase += taken;
+	iov->iov_len -= taken;
+	uio->uio_resid -= taken;
+	uio->uio_offset += taken;
+	return i;
+}
+
+////////////////////////////////////////////////////////////
+// vnode operations
+
+/*
+ * Called for each open; pipes can't be opened by name, so this
+ * never happens.
+ */
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * Called when one end's last reference goes away. Closing the read
+ * end throws away whatever hasn't been read, and frees any writer
+ * waiting for its lent pages to be taken.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool gone;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		KASSERT(pp->pp_readopen);
+		pp->pp_readopen = false;
+		while (pp->pp_nbufs > 0) {
+			pipe_popbuf(pp);
+		}
+		pipe_wakewriters(pp);
+	}
+	else {
+		KASSERT(v == &pp->pp_writevn);
+		KASSERT(pp->pp_writeopen);
+		pp->pp_writeopen = false;
+		pipe_wakereaders(pp);
+	}
+	vnode_cleanup(v);
+	gone = !pp->pp_readopen && !pp->pp_writeopen;
+	lock_release(pp->pp_lock);
+
+	if (gone) {
+		/* the read end emptied the ring when it went */
+		KASSERT(pp->pp_nbufs == 0);
+		kfree(pp->pp_spare);
+		pollqueue_cleanup(&pp->pp_writepq);
+		pollqueue_cleanup(&pp->pp_readpq);
+		cv_destroy(pp->pp_writecv);
+		cv_destroy(pp->pp_readcv);
+		lock_destroy(pp->pp_lock);
+		kfree(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read whatever's there, up to the size of the request; wait only if
+ * there's nothing at all. Returns 0 bytes (EOF) once the pipe is
+ * empty and the write end is gone.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	struct pipebuf *pb;
+	size_t len, startresid;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	KASSERT(v == &pp->pp_readvn);
+
+	startresid = uio->uio_resid;
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_nbufs == 0) {
+		if (!pp->pp_writeopen || uio->uio_resid == 0) {
+			lock_release(pp->pp_lock);
+			return 0;
+		}
+		if (pp->pp_nonblock) {
+			lock_release(pp->pp_lock);
+			return EAGAIN;
+		}
+		cv_wait(pp->pp_readcv, pp->pp_lock);
+	}
+
+	while (uio->uio_resid > 0 && pp->pp_nbufs > 0) {
+		pb = &pp->pp_bufs[pp->pp_head];
+		len = pb->pb_end - pb->pb_start;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pb->pb_data + pb->pb_start, len, uio);
+		if (result) {
+			break;
+		}
+		pb->pb_start += len;
+		pp->pp_nbytes -= len;
+		if (pb->pb_lent) {
+			pp->pp_lenttaken += len;
+		}
+		if (pb->pb_start == pb->pb_end) {
+			pipe_popbuf(pp);
+		}
+	}
+
+	pipe_wakewriters(pp);
+	lock_release(pp->pp_lock);
+
+	if (result && uio->uio_resid < startresid) {
+		/* report what we got */
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Write all of UIO, waiting for room as needed. Writes of up to
+ * PIPE_BUF bytes go in all at once, so they don't get mixed up with
+ * other writers' data. Fails with EPIPE if the read end is gone
+ * before anything was written, and returns a short count if it goes
+ * part way through.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t room, startresid;
+	bool atomic;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	KASSERT(v == &pp->pp_writevn);
+
+	startresid = uio->uio_resid;
+	atomic = startresid <= PIPE_BUF;
+
+	lock_acquire(pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readopen) {
+			result = EPIPE;
+			break;
+		}
+		if (!pp->pp_nonblock && pipe_canlend(pp, uio) &&
+		    pipe_lend(pp, uio) > 0) {
+			continue;
+		}
+		room = pipe_room(pp);
+		if (room == 0 || (atomic && room < uio->uio_resid)) {
+			if (pp->pp_nonblock) {
+				result = EAGAIN;
+				break;
+			}
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+			continue;
+		}
+		result = pipe_fill(pp, uio);
+		pipe_wakereaders(pp);
+		if (result) {
+			break;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	if (result && uio->uio_resid < startresid) {
+		/* report what we wrote */
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * No ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+/*
+ * Called for fstat(). The size is the number of unread bytes.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_nbytes;
+	lock_release(pp->pp_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PAGE_SIZE;
+	return 0;
+}
+
+/*
+ * Return the type.
+ */
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+/*
+ * Pipes can't seek.
+ */
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+/*
+ * Check for readiness. The read end is readable when there's data or
+ * the write end is gone (so a read returns EOF). The write end is
+ * writable when a PIPE_BUF-sized write would go right in, or when the
+ * read end is gone (so a write fails right away).
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollentry *entry)
+{
+	struct pipe *pp = v->vn_data;
+	int ready = 0;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		pollqueue_add(&pp->pp_readpq, entry);
+		if (pp->pp_nbufs > 0) {
+			ready |= POLLIN;
+		}
+		if (!pp->pp_writeopen) {
+			ready |= POLLIN | POLLHUP;
+		}
+	}
+	else {
+		KASSERT(v == &pp->pp_writevn);
+		pollqueue_add(&pp->pp_writepq, entry);
+		if (!pp->pp_readopen) {
+			ready |= POLLOUT | POLLERR;
+		}
+		else if (pipe_room(pp) >= PIPE_BUF) {
+			ready |= POLLOUT;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	return ready & (events | POLLERR | POLLHUP);
+}
+
+/*
+ * fsync and ftruncate make no sense on a pipe.
+ */
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Pipes have no name.
+ */
+static
+int
+pipe_namefile(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return ENOTDIR;
+}
+
+/*
+ * Function table for pipe vnodes.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_poll = pipe_poll,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = pipe_namefile,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// creation
+
+/*
+ * Make a new pipe, returning a reference to each end.
+ */
+int
+pipe_create(bool nonblock, struct vnode **readvn, struct vnode **writevn)
+{
+	struct pipe *pp;
+	unsigned i;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		goto fail_pp;
+	}
+	pp->pp_readcv = cv_create("pipe read");
+	if (pp->pp_readcv == NULL) {
+		goto fail_lock;
+	}
+	pp->pp_writecv = cv_create("pipe write");
+	if (pp->pp_writecv == NULL) {
+		goto fail_readcv;
+	}
+
+	for (i=0; i<PIPE_NBUFS; i++) {
+		pp->pp_bufs[i].pb_data = NULL;
+	}
+	pp->pp_head = 0;
+	pp->pp_nbufs = 0;
+	pp->pp_nlent = 0;
+	pp->pp_lenttaken = 0;
+	pp->pp_nbytes = 0;
+	pp->pp_spare = NULL;
+	pp->pp_nonblock = nonblock;
+	pp->pp_readopen = true;
+	pp->pp_writeopen = true;
+	pollqueue_init(&pp->pp_readpq);
+	pollqueue_init(&pp->pp_writepq);
+
+	/* vnode_init can't fail */
+	vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+
+	*readvn = &pp->pp_readvn;
+	*writevn = &pp->pp_writevn;
+	return 0;
+
+ fail_readcv:
+	cv_destroy(pp->pp_readcv);
+ fail_lock:
+	lock_destroy(pp->pp_lock);
+ fail_pp:
+	kfree(pp);
+	return ENOMEM;
+}
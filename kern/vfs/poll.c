@@ -0,0 +1,144 @@
+/*
+ * Poll wait queues. See poll.h.
+ *
+ * Lock order: a queue's lock, then a poller's lock. Wakeups come in
+ * that order, and a poller never holds its own lock while touching a
+ * queue.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <poll.h>
+
+int
+poller_init(struct poller *pl)
+{
+	pl->pl_wchan = wchan_create("poll");
+	if (pl->pl_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pl->pl_lock);
+	pl->pl_woken = false;
+	return 0;
+}
+
+void
+poller_cleanup(struct poller *pl)
+{
+	spinlock_cleanup(&pl->pl_lock);
+	wchan_destroy(pl->pl_wchan);
+}
+
+void
+poller_reset(struct poller *pl)
+{
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_woken = false;
+	spinlock_release(&pl->pl_lock);
+}
+
+int
+poller_wait(struct poller *pl, bool timed, unsigned ticks)
+{
+	int result = 0;
+
+	spinlock_acquire(&pl->pl_lock);
+	while (!pl->pl_woken) {
+		if (!timed) {
+			wchan_sleep(pl->pl_wchan, &pl->pl_lock);
+		}
+		else {
+			result = wchan_timedsleep(pl->pl_wchan, &pl->pl_lock,
+						  ticks);
+			/* the caller works out how much time is left */
+			break;
+		}
+	}
+	if (pl->pl_woken) {
+		result = 0;
+	}
+	spinlock_release(&pl->pl_lock);
+	return result;
+}
+
+void
+pollentry_init(struct pollentry *pe, struct poller *pl)
+{
+	pe->pe_poller = pl;
+	pe->pe_queue = NULL;
+	pe->pe_next = NULL;
+	pe->pe_prevp = NULL;
+}
+
+void
+pollentry_remove(struct pollentry *pe)
+{
+	struct pollqueue *pq = pe->pe_queue;
+
+	if (pq == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&pq->pq_lock);
+	*pe->pe_prevp = pe->pe_next;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prevp = pe->pe_prevp;
+	}
+	spinlock_release(&pq->pq_lock);
+
+	pe->pe_queue = NULL;
+	pe->pe_next = NULL;
+	pe->pe_prevp = NULL;
+}
+
+void
+pollqueue_init(struct pollqueue *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_entries = NULL;
+}
+
+void
+pollqueue_cleanup(struct pollqueue *pq)
+{
+	KASSERT(pq->pq_entries == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+void
+pollqueue_add(struct pollqueue *pq, struct pollentry *pe)
+{
+	if (pe == NULL) {
+		return;
+	}
+	KASSERT(pe->pe_queue == NULL);
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_queue = pq;
+	pe->pe_next = pq->pq_entries;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prevp = &pe->pe_next;
+	}
+	pe->pe_prevp = &pq->pq_entries;
+	pq->pq_entries = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+void
+pollqueue_wakeup(struct pollqueue *pq)
+{
+	struct pollentry *pe;
+	struct poller *pl;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_entries; pe != NULL; pe = pe->pe_next) {
+		pl = pe->pe_poller;
+		spinlock_acquire(&pl->pl_lock);
+		pl->pl_woken = true;
+		wchan_wakeall(pl->pl_wchan, &pl->pl_lock);
+		spinlock_release(&pl->pl_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
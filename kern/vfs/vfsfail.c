@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <vnode.h>
 
 /*
@@ -262,3 +263,13 @@ vopfail_lookparent_notdir(struct vnode *vn, char *path, struct vnode **result,
 	return ENOTDIR;
 }
 
+////////////////////////////////////////////////////////////
+// poll (not a failure, but the same sort of stub)
+
+int
+vopready_poll(struct vnode *vn, int events, struct pollentry *entry)
+{
+	(void)vn;
+	(void)entry;
+	return events & (POLLIN | POLLOUT);
+}
@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/vdso.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
@@ -125,6 +126,11 @@ static int define_memory(struct addrspace *as, vaddr_t addr,
                 entry_lo |= HPTABLE_SWRITE;
 
                 spinlock_acquire(&hpt_lock);
+                if (find(as, entry_hi) != NULL) {
+                        /* Already defined (e.g. a reused thread stack) */
+                        spinlock_release(&hpt_lock);
+                        continue;
+                }
                 if (!insert_page_table_entry(as, entry_hi, entry_lo)) {
 
                         spinlock_release(&hpt_lock);
@@ -210,7 +216,8 @@ int as_copy(struct addrspace *old, struct addrspace **ret) {
                         vaddr_t old_entry_lo = ptr->entry_lo & PAGE_FRAME;
                         vaddr_t new_entry_lo = old_entry_lo;
 
-                        if (old_entry_lo != 0) {
+                        if (old_entry_lo != 0 &&
+                            !(ptr->entry_lo & HPTABLE_SHARED)) {
                                 new_entry_lo = alloc_kpages(1);
                                 if (new_entry_lo == 0) {
                                         spinlock_release(&hpt_lock);
@@ -234,6 +241,7 @@ int as_copy(struct addrspace *old, struct addrspace **ret) {
                                 return ENOMEM;
                         }
 
+                        ptr = ptr->next;
                 }
         }
         spinlock_release(&hpt_lock);
@@ -263,7 +271,9 @@ void as_destroy(struct addrspace *as) {
                                 ptr = ptr->next;
                                 continue;
                         }
-                        free_kpages(ptr->entry_lo & PAGE_FRAME);
+                        if (!(ptr->entry_lo & HPTABLE_SHARED)) {
+                                free_kpages(ptr->entry_lo & PAGE_FRAME);
+                        }
                         struct hpt_entry * temp = ptr->next;
                         if (prev_ptr == NULL) {
                                 hpt[i] = temp;
@@ -376,6 +386,78 @@ int as_define_stack(struct addrspace *as, vaddr_t *stackptr) {
 
 
 
+/*
+ * Stacks for additional user threads go below the main one, each
+ * with an unmapped page below it to catch overflows. Defining one
+ * that already exists just reuses it.
+ */
+int as_define_threadstack(struct addrspace *as, unsigned slot,
+                          vaddr_t *stackptr) {
+
+        vaddr_t top = USERSTACK - slot * THREADSTACK_STRIDE;
+        vaddr_t location = top - (PAGE_SIZE * STACK_PAGE);
+
+        KASSERT(slot > 0);
+
+        int result = define_memory(as, location, PAGE_SIZE * STACK_PAGE,
+                                   HPTABLE_STACK_RW << 1);
+        if (result) {
+                return ENOMEM;
+        }
+        *stackptr = top;
+        return 0;
+}
+
+
+
+/*
+ * The vdso pages are read-only, and already have their frames. The
+ * clock page is shared, so it's marked to keep as_copy and as_destroy
+ * away from its frame.
+ */
+int as_define_vdso(struct addrspace *as, vaddr_t clockpage) {
+
+        vaddr_t procpage = alloc_kpages(1);
+        if (procpage == 0) {
+                return ENOMEM;
+        }
+        bzero((void *) procpage, PAGE_SIZE);
+
+        uint32_t entry_lo = (1 << HPTABLE_VALID) | (1 << HPTABLE_GLOBAL) |
+                            HPTABLE_READ;
+
+        spinlock_acquire(&hpt_lock);
+        if (find(as, VDSO_PROC) != NULL || find(as, VDSO_CLOCK) != NULL) {
+                /* the program is in the way */
+                spinlock_release(&hpt_lock);
+                free_kpages(procpage);
+                return ENOEXEC;
+        }
+        insert_page_table_entry(as, VDSO_PROC, procpage | entry_lo);
+        insert_page_table_entry(as, VDSO_CLOCK,
+                                clockpage | entry_lo | HPTABLE_SHARED);
+        spinlock_release(&hpt_lock);
+
+        return 0;
+}
+
+
+
+void *as_vdso_proc(struct addrspace *as) {
+        vaddr_t procpage = 0;
+
+        spinlock_acquire(&hpt_lock);
+        struct hpt_entry *ptr = find(as, VDSO_PROC);
+        if (ptr != NULL) {
+                procpage = ptr->entry_lo & PAGE_FRAME;
+        }
+        spinlock_release(&hpt_lock);
+
+        return (void *) procpage;
+}
+
+
+
 void as_activate(void) {
         struct addrspace *as;
 
@@ -95,6 +95,7 @@ void init_ft_hpt() {
 vaddr_t alloc_kpages(unsigned int npages) {
         paddr_t paddr;
 
+retry:
         spinlock_acquire(&ft_lock);
 
         if (ft == NULL) {
@@ -104,6 +105,10 @@ vaddr_t alloc_kpages(unsigned int npages) {
 
         } else if (npages != 1 || ft_next_free == NO_NEXT_FRAME) {
                 spinlock_release(&ft_lock);
+                /* out of frames: free the stacks of pooled dead threads */
+                if (npages == 1 && thread_reclaim() > 0) {
+                        goto retry;
+                }
                 return 0;
 
         } else {
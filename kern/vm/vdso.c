@@ -0,0 +1,98 @@
+/*
+ * The vdso pages. See vdso.h and <kern/vdso.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/vdso.h>
+#include <lib.h>
+#include <spl.h>
+#include <membar.h>
+#include <clock.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vdso.h>
+
+/* The clock page, shared by every address space; 0 until bootstrap. */
+static vaddr_t vdso_clockpage;
+
+void
+vdso_bootstrap(void)
+{
+	int spl;
+
+	COMPILE_ASSERT(VDSO_PAGESIZE == PAGE_SIZE);
+
+	vdso_clockpage = alloc_kpages(1);
+	if (vdso_clockpage == 0) {
+		panic("vdso_bootstrap: Out of memory\n");
+	}
+	bzero((void *)vdso_clockpage, PAGE_SIZE);
+
+	/* Fill it in now, as if from hardclock (we're on cpu 0). */
+	spl = splhigh();
+	vdso_hardclock();
+	splx(spl);
+}
+
+/*
+ * Called from hardclock, on cpu 0 only, so there's only ever one
+ * writer.
+ */
+void
+vdso_hardclock(void)
+{
+	struct vdso_clock *vc;
+	struct timespec ts;
+
+	if (vdso_clockpage == 0) {
+		return;
+	}
+	vc = (struct vdso_clock *)vdso_clockpage;
+
+	gettime(&ts);
+	vc->vc_seq++;
+	membar_store_store();
+	vc->vc_sec = ts.tv_sec;
+	vc->vc_nsec = ts.tv_nsec;
+	membar_store_store();
+	vc->vc_seq++;
+}
+
+int
+vdso_define(struct addrspace *as, struct proc *proc)
+{
+	int result;
+
+	KASSERT(vdso_clockpage != 0);
+
+	result = as_define_vdso(as, vdso_clockpage);
+	if (result) {
+		return result;
+	}
+	vdso_setproc(as, proc);
+	return 0;
+}
+
+/*
+ * Put PROC's ids in the process page of AS.
+ *
+ * A vfork child borrows its parent's AS and so sees the parent's ids
+ * there; rewriting them would give them to the parent's other threads
+ * too. libc's getpid and getppid trap instead in the child.
+ */
+void
+vdso_setproc(struct addrspace *as, struct proc *proc)
+{
+	struct vdso_proc *vp;
+
+	vp = as_vdso_proc(as);
+	if (vp == NULL) {
+		/* not mapped (e.g. vfork from a kernel-only process) */
+		return;
+	}
+	vp->vp_pid = proc->p_pid;
+	vp->vp_ppid = proc->p_ppid;
+}
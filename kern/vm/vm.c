@@ -68,6 +68,45 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
         return 0;
 }
 
+/*
+ * Find the kernel address of the page holding user address uaddr in
+ * the current address space, giving it a frame if it hasn't been
+ * touched yet. If write is set, the page must be writable. Frames
+ * aren't moved or freed until the address space is destroyed, so the
+ * result stays good as long as that can't happen.
+ */
+int vm_getkpage(vaddr_t uaddr, bool write, vaddr_t *ret) {
+        struct addrspace *as;
+        as = proc_getas();
+
+        if (as == NULL || uaddr >= MIPS_KSEG0) {
+                return EFAULT;
+        }
+
+        spinlock_acquire(&hpt_lock);
+
+        struct hpt_entry *ptr = find(as, uaddr & PAGE_FRAME);
+        if (ptr == NULL || !(ptr->entry_lo & HPTABLE_READ) ||
+            (write &&
+            !(ptr->entry_lo & (HPTABLE_WRITE | HPTABLE_SWRITE)))) {
+                spinlock_release(&hpt_lock);
+                return EFAULT;
+        }
+
+        if ((ptr->entry_lo & PAGE_FRAME) == 0) {
+                int result = allocate_memory(ptr);
+                if (result) {
+                        spinlock_release(&hpt_lock);
+                        return result;
+                }
+        }
+
+        *ret = ptr->entry_lo & PAGE_FRAME;
+
+        spinlock_release(&hpt_lock);
+        return 0;
+}
+
 void vm_tlbshootdown(const struct tlbshootdown *ts) {
         (void) ts;
         panic("vm tried to do tlb shootdown?!\n");
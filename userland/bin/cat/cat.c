@@ -36,6 +36,9 @@
  * Usage: cat [files]
  */
 
+/* How much to ask the kernel to copy at once. */
+#define COPYCHUNK (1024*1024)
+
 
 
 /* Print a file that's already been opened. */
@@ -43,31 +46,21 @@ static
 void
 docat(const char *name, int fd)
 {
-	char buf[1024];
-	int len, wr, wrtot;
+	int len;
 
 	/*
-	 * As long as we get more than zero bytes, we haven't hit EOF.
-	 * Zero means EOF. Less than zero means an error occurred.
-	 * We may read less than we asked for, though, in various cases
-	 * for various reasons.
+	 * Have the kernel copy the data to stdout, without bringing it
+	 * out here. As long as it copies more than zero bytes, we
+	 * haven't hit EOF. Zero means EOF. Less than zero means an
+	 * error occurred. (It stops early after a short read from a
+	 * pipe or the console, so interactive input still flows.)
 	 */
-	while ((len = read(fd, buf, sizeof(buf)))>0) {
-		/*
-		 * Likewise, we may actually write less than we attempted
-		 * to. So loop until we're done.
-		 */
-		wrtot = 0;
-		while (wrtot < len) {
-			wr = write(STDOUT_FILENO, buf+wrtot, len-wrtot);
-			if (wr<0) {
-				err(1, "stdout");
-			}
-			wrtot += wr;
-		}
+	while ((len = copy_file_range(fd, NULL, STDOUT_FILENO, NULL,
+				      COPYCHUNK, 0))>0) {
+		/* nothing */
 	}
 	/*
-	 * If we got a read error, print it and exit.
+	 * If we got an error, print it and exit.
 	 */
 	if (len<0) {
 		err(1, "%s", name);
@@ -75,17 +75,20 @@ static pid_t bgpids[MAXBG];
 
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for enough open slots for NJOBS jobs.
  */
 static
 int
-can_bg(void)
+can_bg(int njobs)
 {
 	int i;
 
 	for (i = 0; i < MAXBG; i++) {
 		if (bgpids[i] == 0) {
-			return 1;
+			njobs--;
+			if (njobs == 0) {
+				return 1;
+			}
 		}
 	}
 
@@ -212,41 +215,46 @@ dowait(pid_t pid)
 #ifdef WNOHANG
 /*
  * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * like dowait, but collects any child and uses WNOHANG. returns the
+ * pid we got, or 0 if nothing had exited.
  */
 static
-int
-dowaitpoll(pid_t pid)
+pid_t
+dowaitpoll(void)
 {
 	struct exitinfo ei;
 	pid_t foundpid;
 	int status;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
+	foundpid = waitpid(-1, &status, WNOHANG);
 	if (foundpid < 0) {
-		warn("pid %d", pid);
+		if (errno != ECHILD) {
+			warn("waitpid");
+		}
+		return 0;
 	}
 	else if (foundpid != 0) {
-		printf("pid %d: ", pid);
+		printf("pid %d: ", foundpid);
 		readstatus(status, &ei);
 		printstatus(&ei, 1);
-		return 1;
 	}
-	return 0;
+	return foundpid;
 }
 
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * collect all background jobs that have exited.
  */
 static
 void
 waitpoll(void)
 {
+	pid_t pid;
 	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
+
+	while ((pid = dowaitpoll()) != 0) {
+		for (i=0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
 				bgpids[i] = 0;
 			}
 		}
@@ -355,21 +363,85 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * runstage
+ * starts one command of a pipeline and returns its pid, or -1 on error.
+ * if INFD or OUTFD isn't -1, the command gets it as its standard input
+ * or output. CLOSEFD, if not -1, is the read end of the pipe OUTFD
+ * writes to; the command mustn't hold it open or the next command will
+ * never see end of file.
+ */
+static
+pid_t
+runstage(char **args, int infd, int outfd, int closefd)
+{
+	pid_t pid;
+
+	/*
+	 * The child only execs, so use vfork to avoid copying our
+	 * address space; we stay suspended until it has exec'd or
+	 * exited.
+	 */
+	pid = vfork();
+	switch (pid) {
+		case -1:
+			/* error */
+			warn("vfork");
+			return -1;
+		case 0:
+			/* child */
+			if (infd >= 0) {
+				if (dup2(infd, STDIN_FILENO) < 0) {
+					warn("dup2");
+					_exit(1);
+				}
+				close(infd);
+			}
+			if (outfd >= 0) {
+				if (dup2(outfd, STDOUT_FILENO) < 0) {
+					warn("dup2");
+					_exit(1);
+				}
+				close(outfd);
+			}
+			if (closefd >= 0) {
+				close(closefd);
+			}
+			execvp(args[0], args);
+			warn("%s", args[0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		default:
+			break;
+	}
+	return pid;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or a pipeline of them separated
+ * by '|'.  check for the '&', try to background the job if possible,
+ * otherwise just run it and wait on it.  a pipeline's exit status is
+ * that of its last command.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stages[NARG_MAX + 1];
+	pid_t pids[NARG_MAX + 1];
+	int nargs, nstages, nstarted, i;
+	int fds[2], infd, outfd, nextfd;
 	char *s;
-	pid_t pid;
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
@@ -394,71 +466,109 @@ docommand(char *buf, struct exitinfo *ei)
 		return;
 	}
 
-	for (i=0; builtins[i].name; i++) {
-		if (!strcmp(builtins[i].name, args[0])) {
-			builtins[i].func(nargs, args, ei);
-			return;
+	/* split into pipeline stages at each "|" */
+	stages[0] = args;
+	nstages = 1;
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			args[i] = NULL;
+			stages[nstages++] = &args[i+1];
 		}
 	}
 
-	/* Not a builtin; run it */
+	if (nstages == 1) {
+		for (i=0; builtins[i].name; i++) {
+			if (!strcmp(builtins[i].name, args[0])) {
+				builtins[i].func(nargs, args, ei);
+				return;
+			}
+		}
+	}
 
-	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
+	if (args[nargs-1] != NULL && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			exitinfo_exit(ei, 1);
-			return;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	for (i=0; i<nstages; i++) {
+		if (stages[i][0] == NULL) {
+			printf("sh: Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
+	/* Not a builtin; run it */
+
+	if (bg && !can_bg(nstages)) {
+		printf("%s: Too many background jobs; wait for "
+		       "some to finish before starting more\n",
+		       args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/*
+	 * Start the commands left to right, each reading from the pipe
+	 * the one before it writes to. We close our copies of the pipe
+	 * ends as we go, so each pipe ends up held only by the two
+	 * commands using it.
+	 */
+	infd = -1;
+	for (nstarted = 0; nstarted < nstages; nstarted++) {
+		if (nstarted < nstages-1) {
+			if (pipe(fds) < 0) {
+				warn("pipe");
+				break;
+			}
+			outfd = fds[1];
+			nextfd = fds[0];
+		}
+		else {
+			outfd = nextfd = -1;
+		}
+		pids[nstarted] = runstage(stages[nstarted], infd, outfd,
+					  nextfd);
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (outfd >= 0) {
+			close(outfd);
+		}
+		infd = nextfd;
+		if (pids[nstarted] < 0) {
 			break;
+		}
+	}
+	if (infd >= 0) {
+		close(infd);
 	}
 
 	/* parent */
 	if (bg) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
-		exitinfo_exit(ei, 0);
+		for (i=0; i<nstarted; i++) {
+			remember_bg(pids[i]);
+			printf("[%d] %s ... &\n", pids[i], stages[i][0]);
+		}
+		exitinfo_exit(ei, nstarted < nstages ? 255 : 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	exitinfo_exit(ei, 255);
+	for (i=0; i<nstarted; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+		}
+		else if (i == nstages-1) {
+			readstatus(status, ei);
+		}
 	}
 
 	if (timing) {
@@ -0,0 +1,45 @@
+#ifndef _SPAWN_H_
+#define _SPAWN_H_
+
+#include <sys/types.h>
+#include <kern/spawn.h>
+
+/*
+ * POSIX process spawning, on top of the __spawn system call. The file
+ * actions object collects the list of struct spawn_fdaction that
+ * __spawn takes.
+ *
+ * Spawn attributes are not supported; pass NULL. The environment
+ * argument is ignored, the same as for execv.
+ *
+ * These return 0 or an error number; they do not set errno.
+ */
+
+typedef struct {
+	int sfa_num;			/* Actions in use */
+	int sfa_max;			/* Room allocated */
+	struct spawn_fdaction *sfa_actions;
+} posix_spawn_file_actions_t;
+
+typedef struct __posix_spawnattr posix_spawnattr_t;
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa,
+				      int fd);
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa,
+				     int fd, int newfd);
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa,
+				     int fd, const char *path, int flags,
+				     mode_t mode);
+
+int posix_spawn(pid_t *pid, const char *path,
+		const posix_spawn_file_actions_t *fa,
+		const posix_spawnattr_t *attr,
+		char *const *argv, char *const *envp);
+int posix_spawnp(pid_t *pid, const char *prog,
+		 const posix_spawn_file_actions_t *fa,
+		 const posix_spawnattr_t *attr,
+		 char *const *argv, char *const *envp);
+
+#endif /* _SPAWN_H_ */
@@ -40,8 +40,13 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/poll.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/spawn.h>
+#include <kern/sysbatch.h>
+#include <kern/sysprof.h>
 #include <kern/time.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
@@ -129,6 +134,7 @@ int rmdir(const char *dirname);
 
 /* Recommended. */
 pid_t getpid(void);
+pid_t getppid(void);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
 int fsync(int filehandle);
@@ -140,16 +146,43 @@ int link(const char *oldfile, const char *newfile);
 int chdir(const char *path);
 
 /* Optional. */
+pid_t vfork(void);
+pid_t __spawn(const char *prog, char *const *args,
+	      const struct spawn_fdaction *actions, int nactions);
 void *sbrk(__intptr_t change);
 ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int pipe2(int filehandles[2], int flags);
+ssize_t copy_file_range(int infile, off_t *inpos, int outfile, off_t *outpos,
+			size_t len, unsigned flags);
+int uring_setup(void *ring, unsigned entries);
+int uring_enter(unsigned tosubmit, unsigned mincomplete);
+int syscall_batch(struct sysbatch_call *calls, unsigned ncalls, int flags);
+int sysprof(struct sysprof_stat *stats, unsigned nstats, int flags);
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+	   struct timeval *timeout);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int sched_setaffinity(pid_t pid, size_t size, const unsigned *mask);
+int sched_getaffinity(pid_t pid, size_t size, unsigned *mask);
+int __thread_create(void (*start)(void *, void *), void *arg0, void *arg1,
+		    int flags);
+__DEAD void thread_exit(void *result);
+int thread_join(int tid, void **result);
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int count);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
+int access(const char *path, int mode);
 
 /*
  * These are not themselves system calls, but wrapper routines in libc.
@@ -158,6 +191,8 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int thread_create(void *(*func)(void *), void *arg); /* calls __thread_create */
+int threadfork(void (*func)(void));		/* calls __thread_create */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
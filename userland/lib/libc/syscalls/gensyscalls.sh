@@ -13,6 +13,10 @@ awk '
     /^\/\*CALLBEGIN\*\// { look=1; }
     /^\/\*CALLEND\*\// { look=0; }
 
+    # Skip calls that libc does itself from the vdso page (see
+    # <kern/vdso.h>), and vfork, which syscalls-MACHINE.S does by hand.
+    look && /^#define SYS_(getpid|getppid|vfork) / { next; }
+
     # And, do not read lines that do not match the approximate right pattern.
     look && /^#define SYS_/ && NF==3 {
 	sub("^SYS_", "", $2);
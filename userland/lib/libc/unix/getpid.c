@@ -0,0 +1,34 @@
+/*
+ * getpid and getppid: the kernel keeps the answers in the process's
+ * vdso page (see <kern/vdso.h>), so there's no need to ask it. But a
+ * vfork child borrows its parent's page, ids and all, so while one
+ * has our memory (which vfork in syscalls.S marks) we trap instead.
+ */
+
+#include <unistd.h>
+#include <kern/vdso.h>
+
+/* Nonzero while a vfork child has the address space. */
+volatile int __vfork_child;
+
+/* The real system calls, in syscalls.S. */
+pid_t __getpid_trap(void);
+pid_t __getppid_trap(void);
+
+pid_t
+getpid(void)
+{
+	if (__vfork_child) {
+		return __getpid_trap();
+	}
+	return ((const volatile struct vdso_proc *)VDSO_PROC)->vp_pid;
+}
+
+pid_t
+getppid(void)
+{
+	if (__vfork_child) {
+		return __getppid_trap();
+	}
+	return ((const volatile struct vdso_proc *)VDSO_PROC)->vp_ppid;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+
+/*
+ * POSIX process spawning. The file actions are kept in exactly the
+ * form the __spawn system call takes, so spawning just hands over the
+ * array.
+ */
+
+int
+posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa)
+{
+	fa->sfa_num = 0;
+	fa->sfa_max = 0;
+	fa->sfa_actions = NULL;
+	return 0;
+}
+
+int
+posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa)
+{
+	int i;
+
+	for (i=0; i<fa->sfa_num; i++) {
+		if (fa->sfa_actions[i].sfa_op == SPAWN_FDA_OPEN) {
+			free((char *)fa->sfa_actions[i].sfa_path);
+		}
+	}
+	free(fa->sfa_actions);
+	fa->sfa_num = 0;
+	fa->sfa_max = 0;
+	fa->sfa_actions = NULL;
+	return 0;
+}
+
+/*
+ * Make room for one more action, and return it.
+ */
+static
+struct spawn_fdaction *
+spawn_newaction(posix_spawn_file_actions_t *fa)
+{
+	struct spawn_fdaction *newactions;
+	int newmax;
+
+	if (fa->sfa_num == fa->sfa_max) {
+		if (fa->sfa_max == SPAWN_MAXACTIONS) {
+			return NULL;
+		}
+		newmax = fa->sfa_max == 0 ? 4 : fa->sfa_max * 2;
+		if (newmax > SPAWN_MAXACTIONS) {
+			newmax = SPAWN_MAXACTIONS;
+		}
+		newactions = malloc(newmax * sizeof(*newactions));
+		if (newactions == NULL) {
+			return NULL;
+		}
+		if (fa->sfa_num > 0) {
+			memcpy(newactions, fa->sfa_actions,
+			       fa->sfa_num * sizeof(*newactions));
+		}
+		free(fa->sfa_actions);
+		fa->sfa_actions = newactions;
+		fa->sfa_max = newmax;
+	}
+	return &fa->sfa_actions[fa->sfa_num++];
+}
+
+int
+posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd)
+{
+	struct spawn_fdaction *sfa;
+
+	if (fd < 0) {
+		return EBADF;
+	}
+	sfa = spawn_newaction(fa);
+	if (sfa == NULL) {
+		return ENOMEM;
+	}
+	sfa->sfa_op = SPAWN_FDA_CLOSE;
+	sfa->sfa_fd = fd;
+	sfa->sfa_oldfd = -1;
+	sfa->sfa_flags = 0;
+	sfa->sfa_mode = 0;
+	sfa->sfa_path = NULL;
+	return 0;
+}
+
+int
+posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa,
+				 int fd, int newfd)
+{
+	struct spawn_fdaction *sfa;
+
+	if (fd < 0 || newfd < 0) {
+		return EBADF;
+	}
+	sfa = spawn_newaction(fa);
+	if (sfa == NULL) {
+		return ENOMEM;
+	}
+	sfa->sfa_op = SPAWN_FDA_DUP2;
+	sfa->sfa_fd = newfd;
+	sfa->sfa_oldfd = fd;
+	sfa->sfa_flags = 0;
+	sfa->sfa_mode = 0;
+	sfa->sfa_path = NULL;
+	return 0;
+}
+
+int
+posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa,
+				 int fd, const char *path, int flags,
+				 mode_t mode)
+{
+	struct spawn_fdaction *sfa;
+	char *pathcopy;
+
+	if (fd < 0) {
+		return EBADF;
+	}
+	/* The caller is allowed to free the path afterwards. */
+	pathcopy = malloc(strlen(path) + 1);
+	if (pathcopy == NULL) {
+		return ENOMEM;
+	}
+	strcpy(pathcopy, path);
+
+	sfa = spawn_newaction(fa);
+	if (sfa == NULL) {
+		free(pathcopy);
+		return ENOMEM;
+	}
+	sfa->sfa_op = SPAWN_FDA_OPEN;
+	sfa->sfa_fd = fd;
+	sfa->sfa_oldfd = -1;
+	sfa->sfa_flags = flags;
+	sfa->sfa_mode = mode;
+	sfa->sfa_path = pathcopy;
+	return 0;
+}
+
+/*
+ * Start PATH running with ARGV in a new process, and put its pid in
+ * *PID.
+ */
+int
+posix_spawn(pid_t *pid, const char *path,
+	    const posix_spawn_file_actions_t *fa,
+	    const posix_spawnattr_t *attr,
+	    char *const *argv, char *const *envp)
+{
+	pid_t newpid;
+
+	(void)envp;
+
+	if (attr != NULL) {
+		return EINVAL;
+	}
+
+	newpid = __spawn(path, argv,
+			 fa == NULL ? NULL : fa->sfa_actions,
+			 fa == NULL ? 0 : fa->sfa_num);
+	if (newpid < 0) {
+		return errno;
+	}
+	if (pid != NULL) {
+		*pid = newpid;
+	}
+	return 0;
+}
+
+/*
+ * Same, but look for PROG on the search path, like execvp.
+ */
+int
+posix_spawnp(pid_t *pid, const char *prog,
+	     const posix_spawn_file_actions_t *fa,
+	     const posix_spawnattr_t *attr,
+	     char *const *argv, char *const *envp)
+{
+	const char *searchpath, *s, *t;
+	char progpath[PATH_MAX];
+	size_t len;
+	int result;
+
+	if (strchr(prog, '/') != NULL) {
+		return posix_spawn(pid, prog, fa, attr, argv, envp);
+	}
+
+	searchpath = getenv("PATH");
+	if (searchpath == NULL) {
+		return ENOENT;
+	}
+
+	for (s = searchpath; s != NULL; s = t) {
+		t = strchr(s, ':');
+		if (t != NULL) {
+			len = t - s;
+			/* advance past the colon */
+			t++;
+		}
+		else {
+			len = strlen(s);
+		}
+		if (len == 0) {
+			continue;
+		}
+		if (len >= sizeof(progpath)) {
+			continue;
+		}
+		memcpy(progpath, s, len);
+		snprintf(progpath + len, sizeof(progpath) - len, "/%s", prog);
+		result = posix_spawn(pid, progpath, fa, attr, argv, envp);
+		switch (result) {
+		    case ENOENT:
+		    case ENOTDIR:
+		    case ENOEXEC:
+			/* routine errors, try next dir */
+			break;
+		    default:
+			/* success, or oops, let's fail */
+			return result;
+		}
+	}
+	return ENOENT;
+}
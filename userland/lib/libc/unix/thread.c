@@ -0,0 +1,52 @@
+#include <unistd.h>
+
+/*
+ * User-level thread creation. The system call __thread_create starts
+ * the new thread in a function of ours that gets two arguments; these
+ * call the thread's real function and then thread_exit, since a
+ * thread started by the kernel has nowhere to return to.
+ */
+
+static
+void
+thread_start(void *func, void *arg)
+{
+	void *(*f)(void *) = (void *(*)(void *))func;
+
+	thread_exit(f(arg));
+}
+
+static
+void
+threadfork_start(void *func, void *unused)
+{
+	void (*f)(void) = (void (*)(void))func;
+
+	(void)unused;
+	f();
+	thread_exit(NULL);
+}
+
+/*
+ * Start a thread running FUNC(ARG). Returns its thread id, to pass to
+ * thread_join, or -1 on error.
+ */
+int
+thread_create(void *(*func)(void *), void *arg)
+{
+	return __thread_create(thread_start, (void *)func, arg, 0);
+}
+
+/*
+ * Start a thread running FUNC(). Nothing can join it; it just goes
+ * away when FUNC returns. Returns 0, or -1 on error.
+ */
+int
+threadfork(void (*func)(void))
+{
+	if (__thread_create(threadfork_start, (void *)func, NULL,
+			    THREAD_CREATE_DETACHED) < 0) {
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * batchtest - test syscall_batch.
+ *
+ * Runs a batch of file calls, one of which fails, and checks every
+ * call ran and reported its own result, including lseek's 64-bit
+ * one; runs it again with SYSBATCH_STOPONERR and checks nothing ran
+ * after the failure; checks the calls that can't be batched (batches
+ * within batches among them) fail on their own without ending the
+ * batch; and checks the EINVAL and EFAULT cases for the batch itself.
+ *
+ * Leaves nothing behind in the current directory if it succeeds.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <kern/syscall.h>
+
+#define FILENAME	"batchtest.tmp"
+#define UNTOUCHED	12345		/* sbc_err of calls that didn't run */
+
+static struct sysbatch_call calls[SYSBATCH_MAX + 1];
+
+/*
+ * Fill in call NUM.
+ */
+static
+void
+setcall(unsigned num, int callno, __u32 a0, __u32 a1, __u32 a2, __u32 a3,
+	__u32 a4)
+{
+	memset(&calls[num], 0, sizeof(calls[num]));
+	calls[num].sbc_callno = callno;
+	calls[num].sbc_args[0] = a0;
+	calls[num].sbc_args[1] = a1;
+	calls[num].sbc_args[2] = a2;
+	calls[num].sbc_args[3] = a3;
+	calls[num].sbc_args[4] = a4;
+	calls[num].sbc_err = UNTOUCHED;
+}
+
+static
+void
+batch(unsigned n, int flags, unsigned want)
+{
+	int r;
+
+	r = syscall_batch(calls, n, flags);
+	if (r < 0) {
+		err(1, "syscall_batch");
+	}
+	if ((unsigned)r != want) {
+		errx(1, "syscall_batch made %d calls, expected %u", r, want);
+	}
+}
+
+static
+void
+checkcall(unsigned num, int wanterr, __u32 wantret)
+{
+	if (calls[num].sbc_err != wanterr) {
+		errx(1, "call %u: error %d, expected %d", num,
+		     calls[num].sbc_err, wanterr);
+	}
+	if (calls[num].sbc_ret[0] != wantret) {
+		errx(1, "call %u: returned %u, expected %u", num,
+		     calls[num].sbc_ret[0], wantret);
+	}
+}
+
+/*
+ * Write, seek back (the 64-bit position takes a2/a3, and whence goes
+ * on the stack), fail a close, read, and get our pid.
+ */
+static
+unsigned
+filecalls(int fd, char *buf)
+{
+	setcall(0, SYS_write, fd, (__u32)"abcdef", 6, 0, 0);
+	setcall(1, SYS_lseek, fd, 0, 0, 2, SEEK_SET);
+	setcall(2, SYS_close, -1, 0, 0, 0, 0);
+	setcall(3, SYS_read, fd, (__u32)buf, 10, 0, 0);
+	setcall(4, SYS_getpid, 0, 0, 0, 0, 0);
+	return 5;
+}
+
+static
+void
+test_calls(void)
+{
+	char buf[10];
+	unsigned n;
+	int fd;
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	printf("A batch with a failure in it...\n");
+	memset(buf, 0, sizeof(buf));
+	n = filecalls(fd, buf);
+	batch(n, 0, n);
+	checkcall(0, 0, 6);
+	checkcall(1, 0, 0);
+	if (calls[1].sbc_ret[1] != 2) {
+		errx(1, "lseek: returned %u, expected 2", calls[1].sbc_ret[1]);
+	}
+	checkcall(2, EBADF, 0);
+	checkcall(3, 0, 4);
+	if (memcmp(buf, "cdef", 4)) {
+		errx(1, "read: wrong data");
+	}
+	checkcall(4, 0, getpid());
+	printf("Passed.\n");
+
+	printf("The same, stopping on error...\n");
+	if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "resetting %s", FILENAME);
+	}
+	memset(buf, 0, sizeof(buf));
+	n = filecalls(fd, buf);
+	batch(n, SYSBATCH_STOPONERR, 3);
+	checkcall(0, 0, 6);
+	checkcall(1, 0, 0);
+	checkcall(2, EBADF, 0);
+	checkcall(3, UNTOUCHED, 0);
+	checkcall(4, UNTOUCHED, 0);
+	if (buf[0] != 0) {
+		errx(1, "read ran after the failure");
+	}
+	printf("Passed.\n");
+
+	close(fd);
+}
+
+static
+void
+test_unbatchable(void)
+{
+	static const int callnos[] = {
+		SYS_fork, SYS_vfork, SYS_execv, SYS__exit,
+		SYS___thread_create, SYS_thread_exit, SYS_syscall_batch,
+	};
+	unsigned n, i;
+
+	printf("Calls that can't be batched...\n");
+	n = sizeof(callnos) / sizeof(callnos[0]);
+	for (i=0; i<n; i++) {
+		setcall(i, callnos[i], 0, 0, 0, 0, 0);
+	}
+	/* The nested batch points at real calls; it mustn't run them. */
+	setcall(n - 1, SYS_syscall_batch, (__u32)&calls[n], 1, 0, 0, 0);
+	setcall(n, SYS_getpid, 0, 0, 0, 0, 0);
+	batch(n + 1, 0, n + 1);
+	for (i=0; i<n; i++) {
+		checkcall(i, EINVAL, 0);
+	}
+	checkcall(n, 0, getpid());
+
+	/* Calls past the end of the batch don't run either. */
+	setcall(0, SYS_syscall_batch, (__u32)&calls[1], 1, 0, 0, 0);
+	setcall(1, SYS_getpid, 0, 0, 0, 0, 0);
+	batch(1, 0, 1);
+	checkcall(0, EINVAL, 0);
+	checkcall(1, UNTOUCHED, 0);
+	printf("Passed.\n");
+}
+
+static
+void
+test_errors(void)
+{
+	printf("Errors...\n");
+	setcall(0, SYS_getpid, 0, 0, 0, 0, 0);
+	if (syscall_batch(calls, 1, 2) >= 0 || errno != EINVAL) {
+		errx(1, "syscall_batch with bad flags didn't fail with EINVAL");
+	}
+	if (syscall_batch(calls, SYSBATCH_MAX + 1, 0) >= 0 ||
+	    errno != EINVAL) {
+		errx(1, "syscall_batch of SYSBATCH_MAX+1 calls didn't fail "
+		     "with EINVAL");
+	}
+	if (syscall_batch(NULL, 1, 0) >= 0 || errno != EFAULT) {
+		errx(1, "syscall_batch of NULL didn't fail with EFAULT");
+	}
+	batch(0, 0, 0);
+	checkcall(0, UNTOUCHED, 0);
+	printf("Passed.\n");
+}
+
+int
+main(void)
+{
+	test_calls();
+	test_unbatchable();
+	test_errors();
+	if (remove(FILENAME) < 0) {
+		err(1, "remove %s", FILENAME);
+	}
+	printf("batchtest done.\n");
+	return 0;
+}
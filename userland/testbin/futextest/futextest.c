@@ -0,0 +1,180 @@
+/*
+ * futextest - test futex_wait and futex_wake.
+ *
+ * Checks the argument errors and the EAGAIN case, and then puts some
+ * threads to sleep on a word and wakes them a few at a time, checking
+ * that futex_wake reports and wakes the right number each time.
+ *
+ * The wakeup counts assume the threads have gone to sleep within a
+ * reasonable time of arriving; on a badly overloaded system this can
+ * fail spuriously.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define NWAITERS	4
+
+static int word;
+static int otherword;
+static int unaligned[2];
+
+static volatile int arrived[NWAITERS];
+static volatile int woke[NWAITERS];
+
+/*
+ * Sleep for a while, so other threads get where they're going.
+ */
+static
+void
+dawdle(void)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200 * 1000 * 1000;
+	nanosleep(&ts, NULL);
+}
+
+static
+unsigned
+count(volatile int *flags)
+{
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<NWAITERS; i++) {
+		n += flags[i];
+	}
+	return n;
+}
+
+static
+void
+test_errors(void)
+{
+	volatile int *bad;
+
+	printf("Errors...\n");
+	bad = (volatile int *)((char *)unaligned + 1);
+	if (futex_wait(bad, 0) == 0 || errno != EINVAL) {
+		errx(1, "futex_wait of an unaligned word didn't fail "
+		     "with EINVAL");
+	}
+	if (futex_wake(bad, 1) == 0 || errno != EINVAL) {
+		errx(1, "futex_wake of an unaligned word didn't fail "
+		     "with EINVAL");
+	}
+	if (futex_wait(NULL, 0) == 0 || errno != EFAULT) {
+		errx(1, "futex_wait of NULL didn't fail with EFAULT");
+	}
+
+	/* The word doesn't hold what we say, so don't sleep. */
+	word = 5;
+	if (futex_wait(&word, 4) == 0 || errno != EAGAIN) {
+		errx(1, "futex_wait with the wrong value didn't fail "
+		     "with EAGAIN");
+	}
+	word = 0;
+
+	if (futex_wake(&word, 10) != 0) {
+		errx(1, "futex_wake with no waiters didn't return 0");
+	}
+	printf("Passed.\n");
+}
+
+static
+void *
+waiter(void *arg)
+{
+	unsigned num = (uintptr_t)arg;
+	int result;
+
+	arrived[num] = 1;
+	result = futex_wait(&word, 0);
+	woke[num] = 1;
+	return (void *)(intptr_t)(result < 0 ? errno : 0);
+}
+
+/*
+ * Wake up to N threads, and check that WANT were woken.
+ */
+static
+void
+wake(int n, unsigned want, unsigned totalwant)
+{
+	int result;
+
+	result = futex_wake(&word, n);
+	if (result < 0) {
+		err(1, "futex_wake");
+	}
+	if ((unsigned)result != want) {
+		errx(1, "futex_wake(%d) woke %d, expected %u", n, result,
+		     want);
+	}
+	dawdle();
+	if (count(woke) != totalwant) {
+		errx(1, "after futex_wake(%d), %u threads awake, expected %u",
+		     n, count(woke), totalwant);
+	}
+}
+
+static
+void
+test_wake(void)
+{
+	int tids[NWAITERS];
+	void *result;
+	unsigned i;
+
+	printf("Wakeups...\n");
+	word = 0;
+	for (i=0; i<NWAITERS; i++) {
+		tids[i] = thread_create(waiter, (void *)(uintptr_t)i);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	while (count(arrived) < NWAITERS) {
+		/* spin */
+	}
+	dawdle();
+	if (count(woke) != 0) {
+		errx(1, "%u threads didn't sleep", count(woke));
+	}
+
+	/* Waking some other word shouldn't wake anyone. */
+	if (futex_wake(&otherword, NWAITERS) != 0) {
+		errx(1, "futex_wake of another word woke someone");
+	}
+
+	wake(0, 0, 0);
+	wake(1, 1, 1);
+	wake(2, 2, 3);
+	wake(NWAITERS, NWAITERS - 3, NWAITERS);
+	wake(NWAITERS, 0, NWAITERS);
+
+	for (i=0; i<NWAITERS; i++) {
+		if (thread_join(tids[i], &result) < 0) {
+			err(1, "thread_join");
+		}
+		if (result != NULL) {
+			errno = (intptr_t)result;
+			err(1, "thread %u: futex_wait", i);
+		}
+	}
+	printf("Passed.\n");
+}
+
+int
+main(void)
+{
+	test_errors();
+	test_wake();
+	printf("futextest done.\n");
+	return 0;
+}
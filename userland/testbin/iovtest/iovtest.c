@@ -0,0 +1,214 @@
+/*
+ * iovtest - test readv and writev.
+ *
+ * Gathers a file's contents from several buffers (some of them empty)
+ * and scatters them back into differently sized ones; does the same
+ * with more buffers than the kernel keeps on its stack, and with
+ * exactly IOV_MAX; and checks the EINVAL and EFAULT cases.
+ *
+ * Leaves nothing behind in the current directory if it succeeds.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME	"iovtest.tmp"
+
+static struct iovec iov[IOV_MAX + 1];
+static char data[IOV_MAX * 3];
+static char back[IOV_MAX * 3];
+
+static
+int
+openfile(void)
+{
+	int fd;
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	return fd;
+}
+
+static
+void
+backtostart(int fd)
+{
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+}
+
+static
+void
+checkcount(ssize_t r, size_t want, const char *what)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if ((size_t)r != want) {
+		errx(1, "%s: got %ld bytes, expected %lu", what, (long)r,
+		     (unsigned long)want);
+	}
+}
+
+static
+void
+expecterr(ssize_t r, int want, const char *what)
+{
+	if (r >= 0) {
+		errx(1, "%s succeeded", what);
+	}
+	if (errno != want) {
+		err(1, "%s: expected error %d, got", what, want);
+	}
+}
+
+/*
+ * A few buffers, including empty ones, with different splits on the
+ * way out and on the way back.
+ */
+static
+void
+test_small(void)
+{
+	char a[3], b[5], c[2], d[3], e[3];
+	ssize_t r;
+	int fd;
+
+	printf("Gather and scatter...\n");
+	fd = openfile();
+
+	memcpy(a, "abc", 3);
+	memcpy(b, "defgh", 5);
+	iov[0].iov_base = a;
+	iov[0].iov_len = 3;
+	iov[1].iov_base = NULL;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = b;
+	iov[2].iov_len = 5;
+	checkcount(writev(fd, iov, 3), 8, "writev");
+
+	backtostart(fd);
+	iov[0].iov_base = c;
+	iov[0].iov_len = 2;
+	iov[1].iov_base = d;
+	iov[1].iov_len = 3;
+	iov[2].iov_base = a;
+	iov[2].iov_len = 0;
+	iov[3].iov_base = e;
+	iov[3].iov_len = 3;
+	checkcount(readv(fd, iov, 4), 8, "readv");
+	if (memcmp(c, "ab", 2) || memcmp(d, "cde", 3) ||
+	    memcmp(e, "fgh", 3)) {
+		errx(1, "readv: wrong data");
+	}
+
+	/* The seek position moved; there's nothing more to read. */
+	r = readv(fd, iov, 4);
+	checkcount(r, 0, "readv at EOF");
+
+	/* Nothing but empty buffers. */
+	iov[0].iov_len = 0;
+	iov[1].iov_len = 0;
+	checkcount(writev(fd, iov, 2), 0, "empty writev");
+
+	close(fd);
+	printf("Passed.\n");
+}
+
+/*
+ * N buffers of varying sizes, from 1 to 3 bytes.
+ */
+static
+void
+test_many(unsigned n)
+{
+	unsigned i;
+	size_t pos, len;
+	int fd;
+
+	printf("%u buffers...\n", n);
+	fd = openfile();
+
+	for (i=0; i<sizeof(data); i++) {
+		data[i] = 'a' + (i * 7 + n) % 26;
+	}
+
+	pos = 0;
+	for (i=0; i<n; i++) {
+		iov[i].iov_base = data + pos;
+		iov[i].iov_len = i % 3 + 1;
+		pos += iov[i].iov_len;
+	}
+	len = pos;
+	checkcount(writev(fd, iov, n), len, "writev");
+
+	/*
+	 * Read it back in the opposite sizes. That asks for a little
+	 * more than there is, so the last buffer or two come up short.
+	 */
+	backtostart(fd);
+	memset(back, 0, sizeof(back));
+	pos = 0;
+	for (i=0; i<n; i++) {
+		iov[i].iov_base = back + pos;
+		iov[i].iov_len = 3 - i % 3;
+		pos += iov[i].iov_len;
+	}
+	checkcount(readv(fd, iov, n), len, "readv");
+	if (memcmp(data, back, len)) {
+		errx(1, "readv with %u buffers: wrong data", n);
+	}
+
+	close(fd);
+	printf("Passed.\n");
+}
+
+static
+void
+test_errors(void)
+{
+	char buf[4];
+	int fd;
+
+	printf("Errors...\n");
+	fd = openfile();
+
+	iov[0].iov_base = buf;
+	iov[0].iov_len = sizeof(buf);
+	expecterr(writev(fd, iov, 0), EINVAL, "writev of 0 buffers");
+	expecterr(readv(fd, iov, -1), EINVAL, "readv of -1 buffers");
+	expecterr(writev(fd, iov, IOV_MAX + 1), EINVAL,
+		  "writev of IOV_MAX+1 buffers");
+	expecterr(writev(fd, NULL, 1), EFAULT, "writev with a NULL array");
+	iov[0].iov_base = (void *)0x80000000;
+	expecterr(writev(fd, iov, 1), EFAULT,
+		  "writev from a kernel address");
+	expecterr(readv(-1, iov, 1), EBADF, "readv on fd -1");
+
+	close(fd);
+	printf("Passed.\n");
+}
+
+int
+main(void)
+{
+	test_small();
+	test_many(64);
+	test_many(IOV_MAX);
+	test_errors();
+	if (remove(FILENAME) < 0) {
+		err(1, "remove %s", FILENAME);
+	}
+	printf("iovtest done.\n");
+	return 0;
+}
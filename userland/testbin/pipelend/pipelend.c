@@ -0,0 +1,207 @@
+/*
+ * pipelend - test big pipe writes from page-aligned buffers.
+ *
+ * The kernel lends the pages of such a buffer to the pipe instead of
+ * copying them in, and the writer waits for the reader to take them.
+ * This checks the data gets through intact, across more pages than
+ * the pipe holds at once and with an unaligned tail, and that when
+ * the reader goes away part way, write returns only what it read,
+ * or fails with EPIPE if it read nothing.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define PAGESIZE	4096
+#define NPAGES		20		/* more than the pipe's ring */
+#define TAIL		100		/* not a whole page */
+#define PARTIAL		(PAGESIZE + PAGESIZE / 2)
+
+static char space[(NPAGES + 2) * PAGESIZE];
+static char *buf;
+
+static
+char
+pattern(size_t i)
+{
+	return 'a' + (i * 7 + i / PAGESIZE) % 26;
+}
+
+/*
+ * Fork a reader on the read end of FDS, which runs FUNC and exits
+ * with what it returns; close the read end here.
+ */
+static
+pid_t
+startreader(int fds[2], int (*func)(int))
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		_exit(func(fds[0]));
+	}
+	close(fds[0]);
+	return pid;
+}
+
+static
+void
+waitreader(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "reader failed (status 0x%x)", status);
+	}
+}
+
+/*
+ * Read everything and check it.
+ */
+static
+int
+readall(int fd)
+{
+	char rbuf[1000];
+	size_t total, i;
+	ssize_t r;
+
+	total = 0;
+	while ((r = read(fd, rbuf, sizeof(rbuf))) > 0) {
+		for (i=0; i<(size_t)r; i++) {
+			if (rbuf[i] != pattern(total + i)) {
+				warnx("reader: wrong data at byte %lu",
+				      (unsigned long)(total + i));
+				return 1;
+			}
+		}
+		total += r;
+	}
+	if (r < 0) {
+		warn("reader: read");
+		return 1;
+	}
+	if (total != NPAGES * PAGESIZE + TAIL) {
+		warnx("reader: got %lu bytes", (unsigned long)total);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Read PARTIAL bytes and go away.
+ */
+static
+int
+readsome(int fd)
+{
+	static char rbuf[PARTIAL];
+	size_t total;
+	ssize_t r;
+
+	total = 0;
+	while (total < PARTIAL) {
+		r = read(fd, rbuf, PARTIAL - total);
+		if (r <= 0) {
+			warnx("reader: read returned %ld", (long)r);
+			return 1;
+		}
+		total += r;
+	}
+	return 0;
+}
+
+/*
+ * Read nothing; go away once the writer is surely waiting.
+ */
+static
+int
+readnone(int fd)
+{
+	struct timespec ts;
+
+	(void)fd;
+	ts.tv_sec = 0;
+	ts.tv_nsec = 300 * 1000 * 1000;
+	nanosleep(&ts, NULL);
+	return 0;
+}
+
+int
+main(void)
+{
+	int fds[2];
+	pid_t pid;
+	ssize_t r;
+	size_t i;
+
+	buf = (char *)(((uintptr_t)space + PAGESIZE - 1) &
+		       ~(uintptr_t)(PAGESIZE - 1));
+	for (i=0; i<NPAGES * PAGESIZE + TAIL; i++) {
+		buf[i] = pattern(i);
+	}
+
+	printf("Whole write...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = startreader(fds, readall);
+	r = write(fds[1], buf, NPAGES * PAGESIZE + TAIL);
+	if (r < 0) {
+		err(1, "write");
+	}
+	if (r != NPAGES * PAGESIZE + TAIL) {
+		errx(1, "write returned %ld", (long)r);
+	}
+	close(fds[1]);
+	waitreader(pid);
+	printf("Passed.\n");
+
+	printf("Reader leaves part way...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = startreader(fds, readsome);
+	r = write(fds[1], buf, 4 * PAGESIZE);
+	if (r < 0) {
+		err(1, "write");
+	}
+	if (r != PARTIAL) {
+		errx(1, "write returned %ld, expected %d", (long)r, PARTIAL);
+	}
+	close(fds[1]);
+	waitreader(pid);
+	printf("Passed.\n");
+
+	printf("Reader leaves without reading...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = startreader(fds, readnone);
+	r = write(fds[1], buf, 4 * PAGESIZE);
+	if (r >= 0) {
+		errx(1, "write returned %ld, expected EPIPE", (long)r);
+	}
+	if (errno != EPIPE) {
+		err(1, "write: expected EPIPE, got");
+	}
+	close(fds[1]);
+	waitreader(pid);
+	printf("Passed.\n");
+
+	printf("pipelend done.\n");
+	return 0;
+}
@@ -0,0 +1,424 @@
+/*
+ * polltest - test poll and select.
+ *
+ * Checks that timeouts last about as long as asked and no longer than
+ * it takes for something to turn up; that a sleeping poll or select
+ * wakes and reports the right handle when another process writes to
+ * one of several pipes; that poll copies results back for more
+ * handles than it copies at once, and reports POLLNVAL, while select
+ * fails with EBADF instead; that select reads and writes only the
+ * words of each set below nfds; and that a hangup or error on a pipe
+ * shows up in whichever of the read and write sets asked about it.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define PAGESIZE	4096
+#define NMANY		40		/* more than the kernel copies at once */
+
+/*
+ * Milliseconds since some point in the past.
+ */
+static
+unsigned long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return secs * 1000 + nsecs / 1000000;
+}
+
+static
+void
+mkpipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+void
+closepipe(int fds[2])
+{
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/*
+ * Fork a child that writes a byte to FD after MS milliseconds.
+ */
+static
+pid_t
+latewrite(int fd, unsigned ms)
+{
+	struct timespec ts;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000;
+		nanosleep(&ts, NULL);
+		if (write(fd, "x", 1) != 1) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+	return pid;
+}
+
+static
+void
+waitwriter(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "writer failed (status 0x%x)", status);
+	}
+}
+
+/*
+ * Check that something took between LO and HI milliseconds.
+ */
+static
+void
+checktime(unsigned long start, unsigned long lo, unsigned long hi,
+	  const char *what)
+{
+	unsigned long took;
+
+	took = now() - start;
+	if (took < lo || took > hi) {
+		errx(1, "%s took %lu ms, expected %lu to %lu", what, took,
+		     lo, hi);
+	}
+}
+
+static
+void
+test_timeout(void)
+{
+	struct pollfd pfd;
+	struct timeval tv;
+	fd_set rset;
+	unsigned long start;
+	int fds[2], r;
+
+	printf("Timeouts...\n");
+	mkpipe(fds);
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+
+	start = now();
+	r = poll(&pfd, 1, 0);
+	if (r != 0) {
+		errx(1, "poll of an empty pipe returned %d", r);
+	}
+	checktime(start, 0, 100, "poll with no timeout");
+
+	start = now();
+	r = poll(&pfd, 1, 300);
+	if (r != 0) {
+		errx(1, "poll of an empty pipe returned %d", r);
+	}
+	checktime(start, 250, 1000, "poll for 300 ms");
+
+	/* Seconds and microseconds both count. */
+	FD_ZERO(&rset);
+	FD_SET(fds[0], &rset);
+	tv.tv_sec = 1;
+	tv.tv_usec = 200000;
+	start = now();
+	r = select(fds[0] + 1, &rset, NULL, NULL, &tv);
+	if (r != 0) {
+		errx(1, "select of an empty pipe returned %d", r);
+	}
+	checktime(start, 1150, 2000, "select for 1.2 s");
+	if (FD_ISSET(fds[0], &rset)) {
+		errx(1, "select left an unready handle in the set");
+	}
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 1000000;
+	if (select(fds[0] + 1, &rset, NULL, NULL, &tv) >= 0 ||
+	    errno != EINVAL) {
+		errx(1, "select with 1000000 us didn't fail with EINVAL");
+	}
+
+	closepipe(fds);
+	printf("Passed.\n");
+}
+
+/*
+ * Wait on two empty pipes until a child writes to the second, once
+ * with no timeout and once with one much longer than the wait.
+ */
+static
+void
+test_wakeup(void)
+{
+	struct pollfd pfds[2];
+	struct timeval tv;
+	fd_set rset;
+	unsigned long start;
+	int a[2], b[2], r;
+	char c;
+	pid_t pid;
+
+	printf("Waking up...\n");
+	mkpipe(a);
+	mkpipe(b);
+	pfds[0].fd = a[0];
+	pfds[0].events = POLLIN;
+	pfds[1].fd = b[0];
+	pfds[1].events = POLLIN;
+
+	pid = latewrite(b[1], 200);
+	r = poll(pfds, 2, -1);
+	if (r != 1 || pfds[0].revents != 0 || pfds[1].revents != POLLIN) {
+		errx(1, "poll returned %d, revents 0x%x and 0x%x", r,
+		     pfds[0].revents, pfds[1].revents);
+	}
+	waitwriter(pid);
+	if (read(b[0], &c, 1) != 1) {
+		err(1, "read");
+	}
+
+	pid = latewrite(b[1], 200);
+	start = now();
+	r = poll(pfds, 2, 10000);
+	if (r != 1 || pfds[1].revents != POLLIN) {
+		errx(1, "poll returned %d, revents 0x%x", r, pfds[1].revents);
+	}
+	checktime(start, 100, 5000, "poll woken by a write");
+	waitwriter(pid);
+	if (read(b[0], &c, 1) != 1) {
+		err(1, "read");
+	}
+
+	pid = latewrite(b[1], 200);
+	FD_ZERO(&rset);
+	FD_SET(a[0], &rset);
+	FD_SET(b[0], &rset);
+	tv.tv_sec = 10;
+	tv.tv_usec = 0;
+	r = select((a[0] > b[0] ? a[0] : b[0]) + 1, &rset, NULL, NULL, &tv);
+	if (r != 1 || FD_ISSET(a[0], &rset) || !FD_ISSET(b[0], &rset)) {
+		errx(1, "select returned %d with the wrong handles set", r);
+	}
+	waitwriter(pid);
+
+	closepipe(a);
+	closepipe(b);
+	printf("Passed.\n");
+}
+
+/*
+ * Poll NMANY entries, mostly skipped, with a writable handle and a
+ * closed one near the end.
+ */
+static
+void
+test_many(void)
+{
+	struct pollfd pfds[NMANY];
+	fd_set rset;
+	unsigned i;
+	int fds[2], bad, r;
+
+	printf("Many handles and bad handles...\n");
+	mkpipe(fds);
+	bad = 50;
+	if (dup2(fds[0], bad) < 0) {
+		err(1, "dup2");
+	}
+	close(bad);
+
+	for (i=0; i<NMANY; i++) {
+		pfds[i].fd = -1;
+		pfds[i].events = POLLIN | POLLOUT;
+		pfds[i].revents = 0x7fff;
+	}
+	pfds[NMANY - 5].fd = fds[1];
+	pfds[NMANY - 1].fd = bad;
+	r = poll(pfds, NMANY, 0);
+	if (r != 2) {
+		errx(1, "poll returned %d, expected 2", r);
+	}
+	for (i=0; i<NMANY; i++) {
+		if (i == NMANY - 5 && pfds[i].revents != POLLOUT) {
+			errx(1, "poll: write end got revents 0x%x",
+			     pfds[i].revents);
+		}
+		else if (i == NMANY - 1 && pfds[i].revents != POLLNVAL) {
+			errx(1, "poll: closed handle got revents 0x%x",
+			     pfds[i].revents);
+		}
+		else if (i != NMANY - 5 && i != NMANY - 1 &&
+			 pfds[i].revents != 0) {
+			errx(1, "poll: skipped entry %u got revents 0x%x", i,
+			     pfds[i].revents);
+		}
+	}
+
+	FD_ZERO(&rset);
+	FD_SET(fds[0], &rset);
+	FD_SET(bad, &rset);
+	if (select(bad + 1, &rset, NULL, NULL, NULL) >= 0 ||
+	    errno != EBADF) {
+		errx(1, "select with a closed handle didn't fail with EBADF");
+	}
+
+	closepipe(fds);
+	printf("Passed.\n");
+}
+
+/*
+ * select should only touch the words of the sets it needs for NFDS:
+ * bits past those aren't looked at or cleared, and a set can end
+ * right at the end of valid memory.
+ */
+static
+void
+test_partial(void)
+{
+	struct timeval tv;
+	fd_set big;
+	fd_set *edge;
+	char *brk;
+	int fds[2], r;
+
+	printf("Partial sets...\n");
+	mkpipe(fds);
+	if (fds[1] >= __NFDBITS) {
+		errx(1, "pipe handles too big for this test");
+	}
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+
+	/* Handle 40 isn't open; if select looked at it, EBADF. */
+	FD_ZERO(&big);
+	FD_SET(fds[1], &big);
+	FD_SET(40, &big);
+	r = select(__NFDBITS, NULL, &big, NULL, &tv);
+	if (r != 1 || !FD_ISSET(fds[1], &big) || !FD_ISSET(40, &big)) {
+		errx(1, "select read or wrote past nfds");
+	}
+
+	/* Put a one-word set at the very end of the heap. */
+	brk = sbrk(0);
+	if (sbrk(PAGESIZE - (uintptr_t)brk % PAGESIZE + PAGESIZE) ==
+	    (void *)-1) {
+		err(1, "sbrk");
+	}
+	brk = sbrk(0);
+	edge = (fd_set *)(brk - sizeof(big.fds_bits[0]));
+	edge->fds_bits[0] = 0;
+	FD_SET(fds[1], edge);
+	r = select(fds[1] + 1, NULL, edge, NULL, &tv);
+	if (r != 1 || !FD_ISSET(fds[1], edge)) {
+		errx(1, "select of a set at the end of memory returned %d",
+		     r);
+	}
+	if (select(__NFDBITS + 1, NULL, edge, NULL, &tv) >= 0 ||
+	    errno != EFAULT) {
+		errx(1, "select past the end of memory didn't fail "
+		     "with EFAULT");
+	}
+
+	closepipe(fds);
+	printf("Passed.\n");
+}
+
+/*
+ * A pipe with its write end closed hangs up, and one with its read
+ * end closed has an error. Either counts as ready for reading and
+ * writing both, whichever end was asked about.
+ */
+static
+void
+test_hangup(void)
+{
+	struct pollfd pfd;
+	struct timeval tv;
+	fd_set rset, wset;
+	int hup[2], perr[2], live[2], maxfd, r;
+
+	printf("Hangups and errors...\n");
+	mkpipe(hup);
+	mkpipe(perr);
+	mkpipe(live);
+	close(hup[1]);
+	close(perr[0]);
+	maxfd = hup[0];
+	if (perr[1] > maxfd) {
+		maxfd = perr[1];
+	}
+	if (live[0] > maxfd) {
+		maxfd = live[0];
+	}
+	if (live[1] > maxfd) {
+		maxfd = live[1];
+	}
+
+	pfd.fd = hup[0];
+	pfd.events = 0;
+	if (poll(&pfd, 1, 0) != 1 || pfd.revents != POLLHUP) {
+		errx(1, "poll: hung-up pipe got revents 0x%x", pfd.revents);
+	}
+	pfd.fd = perr[1];
+	if (poll(&pfd, 1, 0) != 1 || pfd.revents != POLLERR) {
+		errx(1, "poll: broken pipe got revents 0x%x", pfd.revents);
+	}
+
+	/* Ask the wrong way round; only the hangup and error count. */
+	FD_ZERO(&rset);
+	FD_ZERO(&wset);
+	FD_SET(perr[1], &rset);
+	FD_SET(live[1], &rset);
+	FD_SET(hup[0], &wset);
+	FD_SET(live[0], &wset);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	r = select(maxfd + 1, &rset, &wset, NULL, &tv);
+	if (r != 2 || !FD_ISSET(perr[1], &rset) || FD_ISSET(live[1], &rset)
+	    || !FD_ISSET(hup[0], &wset) || FD_ISSET(live[0], &wset)) {
+		errx(1, "select returned %d with the wrong handles set", r);
+	}
+
+	close(hup[0]);
+	close(perr[1]);
+	closepipe(live);
+	printf("Passed.\n");
+}
+
+int
+main(void)
+{
+	test_timeout();
+	test_wakeup();
+	test_many();
+	test_hangup();
+	test_partial();
+	printf("polltest done.\n");
+	return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * preadtest - test pread and pwrite.
+ *
+ * Writes a file a block at a time, out of order, with pwrite, and
+ * reads it back with pread, checking that neither moves the seek
+ * position. Positions past 4G check that the 64-bit position gets to
+ * the kernel intact. Also checks the EINVAL, EBADF, and ESPIPE cases.
+ *
+ * Leaves nothing behind in the current directory if it succeeds.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME	"preadtest.tmp"
+#define BLOCKSIZE	512
+#define NBLOCKS		8
+#define SEEKPOS		100
+
+static char buf[BLOCKSIZE];
+
+static
+void
+fillblock(unsigned num)
+{
+	unsigned i;
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		buf[i] = 'a' + (num * 7 + i) % 26;
+	}
+}
+
+static
+void
+checkblock(unsigned num)
+{
+	unsigned i;
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		if (buf[i] != (char)('a' + (num * 7 + i) % 26)) {
+			errx(1, "block %u: wrong data at offset %u", num, i);
+		}
+	}
+}
+
+/*
+ * Make sure the seek position is where we left it.
+ */
+static
+void
+checkpos(int fd, const char *what)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "lseek");
+	}
+	if (pos != SEEKPOS) {
+		errx(1, "%s moved the seek position to %lld", what,
+		     (long long)pos);
+	}
+}
+
+static
+void
+expecterr(ssize_t result, int want, const char *what)
+{
+	if (result >= 0) {
+		errx(1, "%s succeeded", what);
+	}
+	if (errno != want) {
+		err(1, "%s: expected error %d, got", what, want);
+	}
+}
+
+int
+main(void)
+{
+	static const unsigned order[NBLOCKS] = { 5, 0, 7, 2, 1, 6, 3, 4 };
+	off_t big = (off_t)1 << 32;
+	int rfd, wfd, fds[2];
+	unsigned i;
+	ssize_t r;
+
+	wfd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (wfd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	rfd = open(FILENAME, O_RDONLY);
+	if (rfd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	if (lseek(wfd, SEEKPOS, SEEK_SET) < 0 ||
+	    lseek(rfd, SEEKPOS, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+
+	printf("pwrite...\n");
+	for (i=0; i<NBLOCKS; i++) {
+		fillblock(order[i]);
+		r = pwrite(wfd, buf, BLOCKSIZE, order[i] * BLOCKSIZE);
+		if (r < 0) {
+			err(1, "pwrite");
+		}
+		if (r != BLOCKSIZE) {
+			errx(1, "pwrite: short count %ld", (long)r);
+		}
+		checkpos(wfd, "pwrite");
+	}
+
+	printf("pread...\n");
+	for (i=0; i<NBLOCKS; i++) {
+		memset(buf, 0, sizeof(buf));
+		r = pread(rfd, buf, BLOCKSIZE, order[NBLOCKS-1-i] * BLOCKSIZE);
+		if (r < 0) {
+			err(1, "pread");
+		}
+		if (r != BLOCKSIZE) {
+			errx(1, "pread: short count %ld", (long)r);
+		}
+		checkblock(order[NBLOCKS-1-i]);
+		checkpos(rfd, "pread");
+	}
+
+	/* Reading at EOF gets nothing. */
+	r = pread(rfd, buf, BLOCKSIZE, NBLOCKS * BLOCKSIZE);
+	if (r != 0) {
+		errx(1, "pread at EOF returned %ld", (long)r);
+	}
+
+	/*
+	 * Past 4G is past EOF too; if the upper half of the position
+	 * got lost on the way, we'd be reading block 0 or 1 instead.
+	 */
+	printf("64-bit positions...\n");
+	r = pread(rfd, buf, BLOCKSIZE, big);
+	if (r != 0) {
+		errx(1, "pread at 4G returned %ld", (long)r);
+	}
+	r = pread(rfd, buf, BLOCKSIZE, big + BLOCKSIZE);
+	if (r != 0) {
+		errx(1, "pread at 4G+%d returned %ld", BLOCKSIZE, (long)r);
+	}
+	checkpos(rfd, "pread");
+
+	printf("Errors...\n");
+	expecterr(pread(rfd, buf, BLOCKSIZE, -1), EINVAL,
+		  "pread at a negative position");
+	expecterr(pwrite(wfd, buf, BLOCKSIZE, -big), EINVAL,
+		  "pwrite at a negative position");
+	expecterr(pread(wfd, buf, BLOCKSIZE, 0), EBADF,
+		  "pread on a write-only file");
+	expecterr(pwrite(rfd, buf, BLOCKSIZE, 0), EBADF,
+		  "pwrite on a read-only file");
+	expecterr(pread(-1, buf, BLOCKSIZE, 0), EBADF,
+		  "pread on fd -1");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	expecterr(pwrite(fds[1], buf, BLOCKSIZE, 0), ESPIPE,
+		  "pwrite on a pipe");
+	expecterr(pread(fds[0], buf, BLOCKSIZE, 0), ESPIPE,
+		  "pread on a pipe");
+	close(fds[0]);
+	close(fds[1]);
+
+	close(rfd);
+	close(wfd);
+	if (remove(FILENAME) < 0) {
+		err(1, "remove %s", FILENAME);
+	}
+	printf("preadtest done.\n");
+	return 0;
+}
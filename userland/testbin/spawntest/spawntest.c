@@ -0,0 +1,215 @@
+/*
+ * spawntest - test vfork and posix_spawn.
+ *
+ * vfork children that _exit, that exec, and whose exec fails; in
+ * each case the child writes to memory first, and the parent checks
+ * it sees the write once it has its address space back. Then spawns
+ * that succeed, that run file actions, and that fail, which must
+ * leave no child behind.
+ *
+ * The test runs itself as the program to exec, with "child STATUS"
+ * (exit with STATUS) or "isopen FD" (exit with 1 if FD is open, 0 if
+ * not) as arguments.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <spawn.h>
+
+#define PROG "/testbin/spawntest"
+
+/* Written by vfork children; must be seen by the parent. */
+static volatile int borrowed;
+
+/*
+ * Wait for PID and check it exited with WANT.
+ */
+static
+void
+checkexit(pid_t pid, int want, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "%s: waitpid", what);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != want) {
+		errx(1, "%s: exit status 0x%x, expected %d", what, status,
+		     want);
+	}
+}
+
+/*
+ * Check there are no children left over.
+ */
+static
+void
+checknokids(const char *what)
+{
+	if (waitpid(-1, NULL, WNOHANG) >= 0 || errno != ECHILD) {
+		errx(1, "%s: child left behind", what);
+	}
+}
+
+static
+void
+test_vfork(void)
+{
+	char *args[4];
+	volatile int onstack;
+	pid_t pid;
+
+	printf("vfork and _exit...\n");
+	borrowed = 0;
+	onstack = 1;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		borrowed = 1;
+		_exit(5);
+	}
+	checkexit(pid, 5, "vfork/_exit");
+	if (borrowed != 1 || onstack != 1) {
+		errx(1, "vfork/_exit: parent's memory not as the child "
+		     "left it");
+	}
+
+	printf("vfork and exec...\n");
+	args[0] = (char *)"spawntest";
+	args[1] = (char *)"child";
+	args[2] = (char *)"7";
+	args[3] = NULL;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		borrowed = 2;
+		execv(PROG, args);
+		_exit(99);
+	}
+	checkexit(pid, 7, "vfork/exec");
+	if (borrowed != 2 || onstack != 1) {
+		errx(1, "vfork/exec: parent's memory not as the child "
+		     "left it");
+	}
+
+	printf("vfork and failed exec...\n");
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		borrowed = 3;
+		execv("/nonexistent/program", args);
+		_exit(errno == ENOENT ? 8 : 9);
+	}
+	checkexit(pid, 8, "vfork/failed exec");
+	if (borrowed != 3 || onstack != 1) {
+		errx(1, "vfork/failed exec: parent's memory not as the "
+		     "child left it");
+	}
+
+	checknokids("vfork");
+	printf("Passed.\n");
+}
+
+static
+void
+test_spawn(void)
+{
+	posix_spawn_file_actions_t fa;
+	char *args[4];
+	char fdstr[16];
+	pid_t pid;
+	int fd, result;
+
+	printf("spawn...\n");
+	args[0] = (char *)"spawntest";
+	args[1] = (char *)"child";
+	args[2] = (char *)"3";
+	args[3] = NULL;
+	result = posix_spawn(&pid, PROG, NULL, NULL, args, NULL);
+	if (result) {
+		errno = result;
+		err(1, "posix_spawn");
+	}
+	checkexit(pid, 3, "spawn");
+
+	printf("spawn with file actions...\n");
+	fd = open(PROG, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", PROG);
+	}
+	snprintf(fdstr, sizeof(fdstr), "%d", fd);
+	args[1] = (char *)"isopen";
+	args[2] = fdstr;
+
+	result = posix_spawn(&pid, PROG, NULL, NULL, args, NULL);
+	if (result) {
+		errno = result;
+		err(1, "posix_spawn");
+	}
+	checkexit(pid, 1, "spawn, fd inherited");
+
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addclose(&fa, fd);
+	result = posix_spawn(&pid, PROG, &fa, NULL, args, NULL);
+	if (result) {
+		errno = result;
+		err(1, "posix_spawn");
+	}
+	checkexit(pid, 0, "spawn, fd closed");
+	posix_spawn_file_actions_destroy(&fa);
+	close(fd);
+
+	printf("failed spawns...\n");
+	result = posix_spawn(&pid, "/nonexistent/program", NULL, NULL, args,
+			     NULL);
+	if (result != ENOENT) {
+		errx(1, "spawn of a missing program returned %d, "
+		     "expected ENOENT", result);
+	}
+	checknokids("spawn of a missing program");
+
+	/* fd was just closed, so closing it again fails. */
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addclose(&fa, fd);
+	result = posix_spawn(&pid, PROG, &fa, NULL, args, NULL);
+	if (result != EBADF) {
+		errx(1, "spawn with a bad file action returned %d, "
+		     "expected EBADF", result);
+	}
+	posix_spawn_file_actions_destroy(&fa);
+	checknokids("spawn with a bad file action");
+
+	printf("Passed.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct stat st;
+
+	if (argc == 3 && !strcmp(argv[1], "child")) {
+		return atoi(argv[2]);
+	}
+	if (argc == 3 && !strcmp(argv[1], "isopen")) {
+		return fstat(atoi(argv[2]), &st) == 0;
+	}
+
+	test_vfork();
+	test_spawn();
+	printf("spawntest done.\n");
+	return 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * uringtest - test uring_setup and uring_enter.
+ *
+ * Runs NOPs, writes, reads, and fsyncs through the rings, including
+ * ones that fail; then keeps more operations blocked at once than the
+ * kernel keeps worker threads, and checks other operations still get
+ * done; then has processes exit and exec while they have operations
+ * that can't finish, and checks they go away anyway.
+ *
+ * The test runs itself as the program to exec, with "child STATUS"
+ * (exit with STATUS) as arguments.
+ *
+ * Leaves nothing behind in the current directory if it succeeds.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <kern/uring.h>
+
+#define PROG		"/testbin/uringtest"
+#define FILENAME	"uringtest.tmp"
+#define NENTRIES	16
+#define NBLOCKED	10		/* between idle and most workers */
+
+static char space[URING_SIZE(NENTRIES) + URING_PAGESIZE];
+static struct uring_hdr *hdr;
+static struct uring_sqe *sq;
+static struct uring_cqe *cq;
+
+static
+void
+setup(void)
+{
+	char *mem;
+
+	mem = (char *)(((uintptr_t)space + URING_PAGESIZE - 1) &
+		       ~(uintptr_t)(URING_PAGESIZE - 1));
+	if (uring_setup(mem, NENTRIES) < 0) {
+		err(1, "uring_setup");
+	}
+	hdr = (struct uring_hdr *)mem;
+	sq = (struct uring_sqe *)(mem + URING_SQOFFSET(NENTRIES));
+	cq = (struct uring_cqe *)(mem + URING_CQOFFSET(NENTRIES));
+}
+
+/*
+ * Queue up an operation; it isn't submitted until enter().
+ */
+static
+void
+queue(int op, int fd, void *buf, size_t len, off_t pos, unsigned data)
+{
+	struct uring_sqe *sqe;
+
+	sqe = &sq[hdr->sq_tail % NENTRIES];
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_pos = pos;
+	sqe->sqe_data = data;
+	sqe->sqe_flags = 0;
+	hdr->sq_tail++;
+}
+
+/*
+ * Submit everything queued and wait for MINCOMPLETE completions.
+ */
+static
+void
+enter(unsigned tosubmit, unsigned mincomplete)
+{
+	int r;
+
+	r = uring_enter(tosubmit, mincomplete);
+	if (r < 0) {
+		err(1, "uring_enter");
+	}
+	if ((unsigned)r != tosubmit) {
+		errx(1, "uring_enter submitted %d of %u", r, tosubmit);
+	}
+}
+
+/*
+ * Take the next completion, which must exist, and return its result,
+ * checking it's for the operation we expect.
+ */
+static
+int
+reap(unsigned data)
+{
+	struct uring_cqe *cqe;
+	int res;
+
+	if (hdr->cq_head == hdr->cq_tail) {
+		errx(1, "no completion for operation %u", data);
+	}
+	cqe = &cq[hdr->cq_head % NENTRIES];
+	if (cqe->cqe_data != data) {
+		errx(1, "completion for operation %u, expected %u",
+		     cqe->cqe_data, data);
+	}
+	res = cqe->cqe_res;
+	hdr->cq_head++;
+	return res;
+}
+
+static
+void
+checkres(int res, int want, const char *what)
+{
+	if (res != want) {
+		errx(1, "%s: result %d, expected %d", what, res, want);
+	}
+}
+
+static
+void
+checkexit(pid_t pid, int want, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "%s: waitpid", what);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != want) {
+		errx(1, "%s: exit status 0x%x, expected %d", what, status,
+		     want);
+	}
+}
+
+static
+void
+test_basic(void)
+{
+	char buf[16];
+	int fd;
+
+	printf("NOP, write, read, fsync...\n");
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	queue(URING_OP_NOP, -1, NULL, 0, 0, 1);
+	enter(1, 1);
+	checkres(reap(1), 0, "NOP");
+
+	queue(URING_OP_WRITE, fd, (void *)"hello world", 11, 0, 2);
+	enter(1, 1);
+	checkres(reap(2), 11, "write");
+
+	queue(URING_OP_READ, fd, buf, sizeof(buf), 6, 3);
+	queue(URING_OP_FSYNC, fd, NULL, 0, 0, 4);
+	enter(1, 1);
+	checkres(reap(3), 5, "read");
+	if (memcmp(buf, "world", 5)) {
+		errx(1, "read: wrong data");
+	}
+	enter(1, 1);
+	checkres(reap(4), 0, "fsync");
+
+	printf("Failed operations...\n");
+	queue(URING_OP_READ, -1, buf, sizeof(buf), 0, 5);
+	queue(URING_OP_READ, fd, (void *)0x80000000, sizeof(buf), 0, 6);
+	queue(99, fd, NULL, 0, 0, 7);
+	enter(3, 3);
+	checkres(reap(5), -EBADF, "read of fd -1");
+	checkres(reap(6), -EFAULT, "read into a kernel address");
+	checkres(reap(7), -EINVAL, "unknown operation");
+
+	/* Nothing outstanding: asking for more completions doesn't wait. */
+	enter(0, 1);
+
+	close(fd);
+	printf("Passed.\n");
+}
+
+/*
+ * Block reads on NBLOCKED empty pipes, then check a write to a file
+ * still completes, then feed the pipes.
+ */
+static
+void
+test_blocked(void)
+{
+	int fds[NBLOCKED][2];
+	char buf[NBLOCKED];
+	unsigned i;
+	int fd;
+
+	printf("More blocked operations than workers...\n");
+	for (i=0; i<NBLOCKED; i++) {
+		if (pipe(fds[i]) < 0) {
+			err(1, "pipe");
+		}
+		queue(URING_OP_READ, fds[i][0], &buf[i], 1, -1, 100 + i);
+	}
+	enter(NBLOCKED, 0);
+
+	fd = open(FILENAME, O_WRONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	queue(URING_OP_WRITE, fd, (void *)"x", 1, 0, 200);
+	enter(1, 1);
+	checkres(reap(200), 1, "write behind blocked reads");
+	close(fd);
+
+	for (i=0; i<NBLOCKED; i++) {
+		if (write(fds[i][1], "p", 1) != 1) {
+			err(1, "write to pipe");
+		}
+		enter(0, 1);
+		checkres(reap(100 + i), 1, "pipe read");
+		if (buf[i] != 'p') {
+			errx(1, "pipe read: wrong data");
+		}
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	printf("Passed.\n");
+}
+
+/*
+ * Fork a child that sets up rings, blocks a read on its own pipe and
+ * one on OTHERFD, whose write end we keep, and then exits or execs.
+ */
+static
+void
+test_leave(int otherfd, int doexec)
+{
+	char *args[4];
+	char buf[2];
+	int fds[2];
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		setup();
+		if (pipe(fds) < 0) {
+			err(1, "pipe");
+		}
+		queue(URING_OP_READ, fds[0], &buf[0], 1, -1, 1);
+		queue(URING_OP_READ, otherfd, &buf[1], 1, -1, 2);
+		enter(2, 0);
+		if (doexec) {
+			args[0] = (char *)"uringtest";
+			args[1] = (char *)"child";
+			args[2] = (char *)"4";
+			args[3] = NULL;
+			execv(PROG, args);
+			err(1, "%s", PROG);
+		}
+		_exit(3);
+	}
+	checkexit(pid, doexec ? 4 : 3, doexec ? "exec" : "exit");
+}
+
+static
+void
+test_leaving(void)
+{
+	int fds[2];
+
+	printf("Exit and exec with operations outstanding...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	test_leave(fds[0], 0);
+	test_leave(fds[0], 1);
+
+	/* Let the leftover reads finish, so the kernel can clean up. */
+	if (write(fds[1], "qq", 2) != 2) {
+		err(1, "write to pipe");
+	}
+	close(fds[0]);
+	close(fds[1]);
+	printf("Passed.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc == 3 && !strcmp(argv[1], "child")) {
+		return atoi(argv[2]);
+	}
+
+	setup();
+	if (uring_setup(hdr, NENTRIES) == 0 || errno != EBUSY) {
+		errx(1, "second uring_setup didn't fail with EBUSY");
+	}
+	test_basic();
+	test_blocked();
+	test_leaving();
+
+	if (remove(FILENAME) < 0) {
+		err(1, "remove %s", FILENAME);
+	}
+	printf("uringtest done.\n");
+	return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * uthreadtest - test __thread_create, thread_exit, and thread_join.
+ *
+ * Starts joinable threads in several rounds (more in all than fit in
+ * the thread table at once, so slots and stacks get reused) and
+ * checks what they return; checks the join errors; runs some
+ * detached threads; and checks that a process keeps going until its
+ * last thread exits, and exits with the status of the last _exit;
+ * and checks that a thread that faults dies by itself, but the
+ * process then exits with the fault's signal whatever it _exits with.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <err.h>
+
+#define NROUNDS		4
+#define NJOINABLE	16
+#define NDETACHED	8
+
+static volatile int detached_done[NDETACHED];
+
+/*
+ * Sleep for a while, so the other threads get to go first.
+ */
+static
+void
+dawdle(void)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200 * 1000 * 1000;
+	nanosleep(&ts, NULL);
+}
+
+////////////////////////////////////////////////////////////
+// joinable threads
+
+static
+void *
+joinable(void *arg)
+{
+	return (void *)((uintptr_t)arg * 2 + 1);
+}
+
+static
+void
+test_join(void)
+{
+	int tids[NJOINABLE];
+	void *result;
+	unsigned round, i;
+
+	printf("Joinable threads...\n");
+	for (round=0; round<NROUNDS; round++) {
+		for (i=0; i<NJOINABLE; i++) {
+			tids[i] = thread_create(joinable,
+						(void *)(uintptr_t)i);
+			if (tids[i] < 0) {
+				err(1, "thread_create");
+			}
+		}
+		for (i=0; i<NJOINABLE; i++) {
+			if (thread_join(tids[i], &result) < 0) {
+				err(1, "thread_join");
+			}
+			if ((uintptr_t)result != i * 2 + 1) {
+				errx(1, "thread %u returned %lu", i,
+				     (unsigned long)(uintptr_t)result);
+			}
+		}
+	}
+
+	/* Each thread can only be joined once. */
+	if (thread_join(tids[0], &result) == 0 || errno != ESRCH) {
+		errx(1, "second thread_join didn't fail with ESRCH");
+	}
+	if (thread_join(0, NULL) == 0 || errno != ESRCH) {
+		errx(1, "thread_join of tid 0 didn't fail with ESRCH");
+	}
+	if (thread_join(-1, NULL) == 0 || errno != ESRCH) {
+		errx(1, "thread_join of tid -1 didn't fail with ESRCH");
+	}
+	if (__thread_create(NULL, NULL, NULL, 0x100) == 0 ||
+	    errno != EINVAL) {
+		errx(1, "__thread_create with bad flags didn't fail "
+		     "with EINVAL");
+	}
+	printf("Passed.\n");
+}
+
+////////////////////////////////////////////////////////////
+// detached threads
+
+static
+void
+detached(void *arg, void *unused)
+{
+	(void)unused;
+
+	detached_done[(uintptr_t)arg] = 1;
+	thread_exit(NULL);
+}
+
+static
+void
+test_detached(void)
+{
+	int tids[NDETACHED];
+	unsigned i, ndone;
+
+	printf("Detached threads...\n");
+	for (i=0; i<NDETACHED; i++) {
+		tids[i] = __thread_create(detached, (void *)(uintptr_t)i,
+					  NULL, THREAD_CREATE_DETACHED);
+		if (tids[i] < 0) {
+			err(1, "__thread_create");
+		}
+	}
+
+	/* Nothing can join them. */
+	for (i=0; i<NDETACHED; i++) {
+		if (thread_join(tids[i], NULL) == 0) {
+			errx(1, "thread_join of a detached thread succeeded");
+		}
+		/* EINVAL if it's still running, ESRCH if it's gone */
+		if (errno != EINVAL && errno != ESRCH) {
+			err(1, "thread_join of a detached thread");
+		}
+	}
+
+	do {
+		ndone = 0;
+		for (i=0; i<NDETACHED; i++) {
+			ndone += detached_done[i];
+		}
+	} while (ndone < NDETACHED);
+	printf("Passed.\n");
+}
+
+////////////////////////////////////////////////////////////
+// process exit
+
+static
+void
+lastexit_thread(void *status, void *unused)
+{
+	(void)unused;
+
+	dawdle();
+	if (status == NULL) {
+		thread_exit(NULL);
+	}
+	_exit((uintptr_t)status);
+}
+
+/*
+ * Fork a child whose main thread leaves right away, by calling _exit
+ * with MAINSTATUS (or thread_exit, if it's -1). Its other thread
+ * hangs around for a while first and then does the same with
+ * LASTSTATUS. The child should exit with the status of the last
+ * _exit (or 0 if there was none).
+ */
+static
+void
+lastexit(int mainstatus, int laststatus, int expected)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (__thread_create(lastexit_thread,
+				    laststatus < 0 ? NULL :
+				    (void *)(uintptr_t)laststatus,
+				    NULL, THREAD_CREATE_DETACHED) < 0) {
+			err(1, "__thread_create");
+		}
+		if (mainstatus < 0) {
+			thread_exit(NULL);
+		}
+		_exit(mainstatus);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != expected) {
+		errx(1, "child (%d, %d) exited with status 0x%x, "
+		     "expected %d", mainstatus, laststatus, status, expected);
+	}
+}
+
+static
+void
+test_lastexit(void)
+{
+	printf("Process exit...\n");
+	lastexit(3, 9, 9);
+	lastexit(-1, 9, 9);
+	lastexit(3, -1, 3);
+	lastexit(-1, -1, 0);
+	printf("Passed.\n");
+}
+
+static
+void *
+faulter(void *unused)
+{
+	(void)unused;
+
+	*(volatile int *)NULL = 0;
+	return (void *)1;
+}
+
+/*
+ * Fork a child with a thread that faults. The faulting thread dies
+ * on its own; the main thread joins it, says so through a pipe, and
+ * calls _exit, but the child should still exit with SIGSEGV.
+ */
+static
+void
+test_fault(void)
+{
+	void *result;
+	int fds[2], tid, status;
+	pid_t pid;
+	char c;
+
+	printf("A thread that faults (one thread should die)...\n");
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		tid = thread_create(faulter, NULL);
+		if (tid < 0) {
+			err(1, "thread_create");
+		}
+		if (thread_join(tid, &result) < 0) {
+			err(1, "thread_join");
+		}
+		if (write(fds[1], result == NULL ? "y" : "n", 1) != 1) {
+			err(1, "write");
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+	if (read(fds[0], &c, 1) != 1) {
+		errx(1, "child died with its faulting thread");
+	}
+	if (c != 'y') {
+		errx(1, "joining the faulting thread didn't return NULL");
+	}
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+		errx(1, "child exited with status 0x%x, expected SIGSEGV",
+		     status);
+	}
+	printf("Passed.\n");
+}
+
+int
+main(void)
+{
+	test_join();
+	test_detached();
+	test_lastexit();
+	test_fault();
+	printf("uthreadtest done.\n");
+	return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * vdsotest - test the vdso pages.
+ *
+ * getpid and getppid read the process's vdso page, so check them
+ * against the kernel's own answers (asked for with syscall_batch),
+ * in fork children, in the parent once a vfork child is done with its
+ * memory, and in vfork children, which find the parent's ids in the
+ * page they borrow and so have to ask the kernel. Check the clock page keeps
+ * up with __time, and that writing to either page gets the writer
+ * killed. Fork copies a few pages of heap too, to check the whole
+ * address space comes across.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <err.h>
+#include <kern/syscall.h>
+#include <kern/vdso.h>
+
+#define HEAPPAGES	5
+
+/* Written by vfork children; read by the parent afterward. */
+static volatile pid_t vforkpid, vforkppid, vforkpage;
+
+/*
+ * What the kernel says getpid and getppid should be.
+ */
+static
+void
+realids(pid_t *pid, pid_t *ppid)
+{
+	struct sysbatch_call calls[2];
+
+	memset(calls, 0, sizeof(calls));
+	calls[0].sbc_callno = SYS_getpid;
+	calls[1].sbc_callno = SYS_getppid;
+	if (syscall_batch(calls, 2, SYSBATCH_STOPONERR) != 2) {
+		err(1, "syscall_batch");
+	}
+	if (calls[0].sbc_err || calls[1].sbc_err) {
+		errno = calls[0].sbc_err ? calls[0].sbc_err : calls[1].sbc_err;
+		err(1, "getpid/getppid");
+	}
+	*pid = calls[0].sbc_ret[0];
+	*ppid = calls[1].sbc_ret[0];
+}
+
+/*
+ * Check the vdso page agrees with the kernel; return 0 if so.
+ */
+static
+int
+idsok(const char *who)
+{
+	pid_t pid, ppid;
+
+	realids(&pid, &ppid);
+	if (getpid() != pid || getppid() != ppid) {
+		warnx("%s: vdso says pid %d ppid %d; kernel says %d and %d",
+		      who, getpid(), getppid(), pid, ppid);
+		return 1;
+	}
+	return 0;
+}
+
+static
+void
+checkexit(pid_t pid, int want, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "%s: waitpid", what);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != want) {
+		errx(1, "%s: exit status 0x%x, expected %d", what, status,
+		     want);
+	}
+}
+
+static
+void
+test_fork(void)
+{
+	char *heap;
+	unsigned i;
+	pid_t me, pid;
+
+	printf("fork...\n");
+	if (idsok("parent")) {
+		exit(1);
+	}
+	me = getpid();
+
+	heap = malloc(HEAPPAGES * 4096);
+	if (heap == NULL) {
+		errx(1, "malloc failed");
+	}
+	for (i=0; i<HEAPPAGES * 4096; i++) {
+		heap[i] = 'a' + i % 26;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (idsok("fork child") || getppid() != me ||
+		    getpid() == me) {
+			_exit(1);
+		}
+		for (i=0; i<HEAPPAGES * 4096; i++) {
+			if (heap[i] != (char)('a' + i % 26)) {
+				warnx("fork child: heap byte %u is wrong", i);
+				_exit(2);
+			}
+			heap[i] = 0;
+		}
+		_exit(0);
+	}
+	checkexit(pid, 0, "fork");
+
+	if (getpid() != me || idsok("parent after fork")) {
+		errx(1, "parent's ids changed after fork");
+	}
+	for (i=0; i<HEAPPAGES * 4096; i++) {
+		if (heap[i] != (char)('a' + i % 26)) {
+			errx(1, "fork child's write reached the parent");
+		}
+	}
+	free(heap);
+	printf("Passed.\n");
+}
+
+static
+void
+test_vfork(void)
+{
+	pid_t me, myparent, pid;
+
+	printf("vfork...\n");
+	me = getpid();
+	myparent = getppid();
+
+	vforkpid = vforkppid = vforkpage = -1;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		vforkpid = getpid();
+		vforkppid = getppid();
+		vforkpage =
+		    ((const volatile struct vdso_proc *)VDSO_PROC)->vp_pid;
+		_exit(idsok("vfork child"));
+	}
+	checkexit(pid, 0, "vfork");
+	if (vforkpid != pid || vforkppid != me) {
+		errx(1, "vfork child saw pid %d ppid %d, expected %d and %d",
+		     vforkpid, vforkppid, pid, me);
+	}
+	/* The page is the parent's, and so are the ids in it. */
+	if (vforkpage != me) {
+		errx(1, "vfork child's vdso page says pid %d, expected %d",
+		     vforkpage, me);
+	}
+	if (getpid() != me || getppid() != myparent ||
+	    idsok("parent after vfork")) {
+		errx(1, "parent didn't get its ids back after vfork");
+	}
+	printf("Passed.\n");
+}
+
+/*
+ * Read the clock page the way time() does.
+ */
+static
+void
+vdsoclock(unsigned *seq, time_t *sec, unsigned long *nsec)
+{
+	const volatile struct vdso_clock *vc;
+
+	vc = (const volatile struct vdso_clock *)VDSO_CLOCK;
+	do {
+		do {
+			*seq = vc->vc_seq;
+		} while (*seq & 1);
+		*sec = vc->vc_sec;
+		*nsec = vc->vc_nsec;
+	} while (vc->vc_seq != *seq);
+}
+
+static
+long
+msdiff(time_t s1, unsigned long ns1, time_t s0, unsigned long ns0)
+{
+	return (s1 - s0) * 1000 + ((long)ns1 - (long)ns0) / 1000000;
+}
+
+static
+void
+test_clock(void)
+{
+	struct timespec ts;
+	unsigned seq0, seq1;
+	time_t sec0, sec1, ksec;
+	unsigned long nsec0, nsec1, knsec;
+	long ms;
+
+	printf("Clock page...\n");
+	vdsoclock(&seq0, &sec0, &nsec0);
+	ts.tv_sec = 0;
+	ts.tv_nsec = 300 * 1000 * 1000;
+	nanosleep(&ts, NULL);
+	vdsoclock(&seq1, &sec1, &nsec1);
+	if (__time(&ksec, &knsec) < 0) {
+		err(1, "__time");
+	}
+
+	if (seq1 == seq0) {
+		errx(1, "clock page wasn't updated in 300 ms");
+	}
+	ms = msdiff(sec1, nsec1, sec0, nsec0);
+	if (ms < 250 || ms > 2000) {
+		errx(1, "clock page moved %ld ms in a 300 ms sleep", ms);
+	}
+	/* It's only updated every tick, so allow a few. */
+	ms = msdiff(ksec, knsec, sec1, nsec1);
+	if (ms < 0 || ms > 200) {
+		errx(1, "clock page is %ld ms behind __time", ms);
+	}
+	if (time(NULL) < sec1) {
+		errx(1, "time() went backward");
+	}
+	printf("Passed.\n");
+}
+
+/*
+ * Fork a child that writes to ADDR; it should be killed for it.
+ */
+static
+void
+writeto(unsigned long addr, const char *what)
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		*(volatile int *)addr = 0;
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+		errx(1, "writing to the %s page: status 0x%x, expected "
+		     "SIGSEGV", what, status);
+	}
+}
+
+static
+void
+test_readonly(void)
+{
+	printf("Writing to the pages (two processes should die)...\n");
+	writeto(VDSO_PROC, "process");
+	writeto(VDSO_CLOCK, "clock");
+	if (idsok("after the writes")) {
+		exit(1);
+	}
+	printf("Passed.\n");
+}
+
+int
+main(void)
+{
+	test_fork();
+	test_vfork();
+	test_clock();
+	test_readonly();
+	printf("vdsotest done.\n");
+	return 0;
+}